@@ -16,18 +16,32 @@
 #include <queue>
 #include <algorithm>
 #include "MsgStructs.hpp"
+#include "LockProfiler.hpp"
+#include "MetricsServer.hpp"
+#include "FlightStats.hpp"
+#include "SimContext.hpp"
+#include "WireFormat.hpp"
+#include "AVNOutbox.hpp"
+#include "AVNInbox.hpp"
+#include "AvnShard.hpp"
 #include <cstring>
 
+// Number of completed flights kept for the final history table (0 keeps none)
+const size_t kFlightHistoryCapacity = 1000;
+
 class ATCSystem{
 public:
-    int atcs_to_avn[2];
-    int avn_to_atcs[2];
+    std::vector<IpcChannel> atcs_to_avn; // one per AVN generator shard
+    std::vector<IpcChannel> avn_to_atcs;
+    AVNOutbox* avnOutbox; // feeds atcs_to_avn from its own thread; null when headless
+    AVNInbox* avnInbox;   // applies clearances from avn_to_atcs on its own thread; null when headless
     
     std::vector<Airline> airlines;
     std::vector<Flight*> flights; //fcfs and priority based queue
     std::vector<AVN> avns;
     std::vector<AVN> TotalAVNs;
-    std::vector<std::pair<Flight,time_t>> TotalFlights;
+    FlightStats flightStats;          // streaming wait-time aggregates of completed flights
+    FlightHistoryLog flightHistory;   // most recent completed flights, bounded
     std::map<std::string, int> violationsByAirline;
     pthread_mutex_t flightMutex;
     pthread_mutex_t runwayMutex;
@@ -36,24 +50,64 @@ public:
     bool runwayStatus[3]; // false means runway is available
     time_t simulationStartTime;
     bool simulationRunning;
+    bool headless; // no textures, threads, sleeps or IPC; driven by runHeadless()
+
+    // Next spawn time per direction, advanced by generatorTick()
+    time_t northTime, southTime, eastTime, westTime;
+    // When flights in a terminal state are due to leave the system
+    std::map<Flight*, time_t> arrivalCompletionTimes;
+    std::map<Flight*, time_t> departureCompletionTimes;
+
+    SimulationMetrics metrics; // lock-free snapshot for the metrics endpoint
+    MetricsServer metricsServer;
 
     bool isRunwayAvailable(Runway runway){
         return !runwayStatus[static_cast<int>(runway)];
     }
     void occupyRunway(Runway runway){
         runwayStatus[static_cast<int>(runway)] = true;
+        metrics.runwayOccupied[static_cast<int>(runway)] = true;
     }
     void releaseRunway(Runway runway){
         runwayStatus[static_cast<int>(runway)] = false;
+        metrics.runwayOccupied[static_cast<int>(runway)] = false;
+    }
+
+    // Refresh the flight gauges of the metrics snapshot (caller holds flightMutex)
+    void publishFlightMetrics(){
+        long byState[kAircraftStateCount] = {0};
+        for (auto flight : flights){
+            byState[static_cast<int>(flight->state)]++;
+        }
+        for (int i = 0; i < kAircraftStateCount; i++){
+            metrics.flightsByState[i] = byState[i];
+        }
+        metrics.activeFlights = flights.size();
+    }
+
+    void initMetrics(){
+        for (auto& airline : airlines){
+            metrics.airlineNames.push_back(airline.name);
+        }
+        flightStats = FlightStats(airlines.size());
+        flightHistory.setCapacity(kFlightHistoryCapacity);
+    }
+
+    // Fold a finished flight into the aggregates (caller holds flightMutex)
+    void recordCompletedFlight(const Flight& flight, time_t completionTime){
+        int airlineIndex = static_cast<int>(flight.airline - &airlines[0]);
+        flightStats.record(flight, airlineIndex, completionTime);
+        flightHistory.append(flight, airlineIndex, completionTime);
+        metrics.completedFlights++;
     }
 
     Runway assignRunway(Flight* flight){
-        pthread_mutex_lock(&runwayMutex);
+        PROFILED_LOCK(runwayMutex);
 
         if (flight->type == AirCraftType::cargo){
             if(isRunwayAvailable(Runway::RWY_C)){
                 occupyRunway(Runway::RWY_C);
-                pthread_mutex_unlock(&runwayMutex);
+                PROFILED_UNLOCK(runwayMutex);
                 return Runway::RWY_C;
             }
         }
@@ -61,7 +115,7 @@ public:
         if (flight->type == AirCraftType::emergency){
             if (isRunwayAvailable(Runway::RWY_C)){
                 occupyRunway(Runway::RWY_C);
-                pthread_mutex_unlock(&runwayMutex);
+                PROFILED_UNLOCK(runwayMutex);
                 return Runway::RWY_C;
             }
         }
@@ -69,20 +123,20 @@ public:
         if (flight->isArrival()){
             if (isRunwayAvailable(Runway::RWY_A)){
                 occupyRunway(Runway::RWY_A);
-                pthread_mutex_unlock(&runwayMutex);
+                PROFILED_UNLOCK(runwayMutex);
                 return Runway::RWY_A;
             }
         } 
         else if (flight->isDeparture()){
             if (isRunwayAvailable(Runway::RWY_B)){
                 occupyRunway(Runway::RWY_B);
-                pthread_mutex_unlock(&runwayMutex);
+                PROFILED_UNLOCK(runwayMutex);
                 return Runway::RWY_B;
             }
         }
 
         //no runway available?
-        pthread_mutex_unlock(&runwayMutex);
+        PROFILED_UNLOCK(runwayMutex);
 
         // If no runway is available, return the default runway based on direction
         // dont occupy runway, just return the default
@@ -98,7 +152,7 @@ public:
     void generateEmergency(){
         // Check probability based on direction
         for (auto flight : flights){    //(need to fix probabilities)
-            int emergencyChance = rand() % 100 + 1; // Use a larger range for more granular control
+            int emergencyChance = simRand() % 100 + 1; // Use a larger range for more granular control
             bool makeEmergency = false;
 
             switch (flight->direction){
@@ -117,7 +171,7 @@ public:
             }
 
             if (makeEmergency && !flight->isEmergency){
-                pthread_mutex_lock(&flightMutex);
+                PROFILED_LOCK(flightMutex);
                 // Double-check that flight still exists and isn't already an emergency
                 bool flightExists = false;
                 for (auto f : flights) {
@@ -130,16 +184,20 @@ public:
                 if (flightExists && !flight->isEmergency) {
                     flight->isEmergency = true;
                     flight->priority = flight->calculatePriority();
-                    std::cout << "❌ EMERGENCY DECLARED: Flight " << flight->flightNumber << " (" << flight->airline->name << ")\n";
+                    if (simLogging()) {
+                        std::cout << "❌ EMERGENCY DECLARED: Flight " << flight->flightNumber << " (" << flight->airline->name << ")\n";
+                    }
                 }
-                pthread_mutex_unlock(&flightMutex);
+                PROFILED_UNLOCK(flightMutex);
+            }
+            if (!headless) {
+                sleep(1);
             }
-            sleep(1);
         }
     }
 
     void checkSpeedViolations() { //not being used
-        pthread_mutex_lock(&flightMutex);
+        PROFILED_LOCK(flightMutex);
         
         for (auto flight : flights) {
             if (flight->speedViolation() && !flight->hasActiveAVN) {
@@ -172,7 +230,7 @@ public:
                         break;
                 }
                 
-                pthread_mutex_lock(&avnMutex);
+                PROFILED_LOCK(avnMutex);
                 AVN avn(flight, flight->speed, allowedSpeed);
                 avns.push_back(avn);
                 violationsByAirline[avn.flight->airline->name]++;
@@ -180,11 +238,11 @@ public:
                 flight->hasActiveAVN = true;
                 
                 std::cout << "💸 AVN ISSUED: Flight " << flight->flightNumber << " (" << flight->airline->name << ") - Speed: " << flight->speed << " km/h, Allowed: " << allowedSpeed << " km/h, State: " << flight->getStateString() << "\n";
-                pthread_mutex_unlock(&avnMutex);
+                PROFILED_UNLOCK(avnMutex);
             }
         }
         
-        pthread_mutex_unlock(&flightMutex);
+        PROFILED_UNLOCK(flightMutex);
     }
 
     static void* flightGeneratorThreadFunc(void* arg) {
@@ -212,12 +270,16 @@ public:
     }
 
 public:
-    ATCSystem(int* atcs_to_avn, int* avn_to_atcs) {
-        // Initialize pipe file descriptors
-        this->atcs_to_avn[0] = atcs_to_avn[0];
-        this->atcs_to_avn[1] = atcs_to_avn[1];
-        this->avn_to_atcs[0] = avn_to_atcs[0];
-        this->avn_to_atcs[1] = avn_to_atcs[1];
+    ATCSystem(const std::vector<IpcChannel>& atcs_to_avn, const std::vector<IpcChannel>& avn_to_atcs,
+              const OutboxOptions& outboxOptions = OutboxOptions(), const Supervisor* supervisor = nullptr) {
+        // Channels to and from the AVN generator processes, one pair per shard
+        this->atcs_to_avn = atcs_to_avn;
+        this->avn_to_atcs = avn_to_atcs;
+        metrics.ipcBacklogChannels = &this->atcs_to_avn;
+        metrics.supervisor = supervisor;
+        avnOutbox = new AVNOutbox(this->atcs_to_avn, &metrics, outboxOptions);
+        avnInbox = new AVNInbox(this->avn_to_atcs, &metrics,
+                                [this](const std::vector<ViolationClearance>& batch) { applyClearances(batch); });
 
         pthread_mutex_init(&flightMutex, NULL);
         pthread_mutex_init(&runwayMutex, NULL);
@@ -259,6 +321,7 @@ public:
         airlines[3].planeSprite.setOrigin(airlines[3].planeTexture.getSize().x / 2, airlines[3].planeTexture.getSize().y / 2);
         airlines[4].planeSprite.setOrigin(airlines[4].planeTexture.getSize().x / 2, airlines[4].planeTexture.getSize().y / 2);
         airlines[5].planeSprite.setOrigin(airlines[5].planeTexture.getSize().x / 2, airlines[5].planeTexture.getSize().y / 2);
+        initMetrics();
         // airlines[0].planeSprite.setPosition(100, 100);
         // airlines[1].planeSprite.setPosition(200, 200);
         // airlines[2].planeSprite.setPosition(300, 300);
@@ -267,10 +330,13 @@ public:
         // airlines[5].planeSprite.setPosition(600, 600);
 
         simulationRunning = false;
+        headless = false;
     }
 
     // Keep the default constructor for backward compatibility
     ATCSystem() {
+        avnOutbox = nullptr;
+        avnInbox = nullptr;
         pthread_mutex_init(&flightMutex, NULL);
         pthread_mutex_init(&runwayMutex, NULL);
         pthread_mutex_init(&avnMutex, NULL);
@@ -311,6 +377,7 @@ public:
         airlines[3].planeSprite.setOrigin(airlines[3].planeTexture.getSize().x / 2, airlines[3].planeTexture.getSize().y / 2);
         airlines[4].planeSprite.setOrigin(airlines[4].planeTexture.getSize().x / 2, airlines[4].planeTexture.getSize().y / 2);
         airlines[5].planeSprite.setOrigin(airlines[5].planeTexture.getSize().x / 2, airlines[5].planeTexture.getSize().y / 2);
+        initMetrics();
         // airlines[0].planeSprite.setPosition(100, 100);
         // airlines[1].planeSprite.setPosition(200, 200);
         // airlines[2].planeSprite.setPosition(300, 300);
@@ -318,9 +385,37 @@ public:
         // airlines[4].planeSprite.setPosition(500, 500);
         // airlines[5].planeSprite.setPosition(600, 600);
         simulationRunning = false;
+        headless = false;
+    }
+
+    // Headless instance for batch replications: no textures, no pipes, virtual clock via runHeadless()
+    explicit ATCSystem(bool headlessMode) {
+        avnOutbox = nullptr;
+        avnInbox = nullptr;
+        pthread_mutex_init(&flightMutex, NULL);
+        pthread_mutex_init(&runwayMutex, NULL);
+        pthread_mutex_init(&avnMutex, NULL);
+
+        runwayStatus[0] = false; // RWY_A
+        runwayStatus[1] = false; // RWY_B
+        runwayStatus[2] = false; // RWY_C
+
+        airlines = {
+            {"PIA", AirCraftType::commercial, 6, 4},
+            {"AirBlue", AirCraftType::commercial, 4, 4},
+            {"FedEx", AirCraftType::cargo, 3, 2},
+            {"PAF", AirCraftType::emergency, 2, 1},
+            {"BDart", AirCraftType::cargo, 2, 2},
+            {"AK Amb", AirCraftType::emergency, 2, 1}
+        };
+        initMetrics();
+        simulationRunning = false;
+        headless = headlessMode;
     }
 
     ~ATCSystem(){
+        delete avnInbox;
+        delete avnOutbox;
 
         for (auto flight : flights){
             delete flight;
@@ -334,6 +429,11 @@ public:
     void startSimulation(){
         simulationRunning = true;
         simulationStartTime = time(0);
+        metrics.startTime = simulationStartTime;
+        metrics.running = true;
+        metricsServer.start(&metrics, MetricsServer::defaultSocketPath());
+        if (avnOutbox) avnOutbox->start();
+        if (avnInbox) avnInbox->start();
 
         createInitialFlights();
 
@@ -349,6 +449,7 @@ public:
 
         // Stop simulation
         simulationRunning = false;
+        metrics.running = false;
 
         // Join threads
         pthread_join(flightGeneratorThread, NULL);
@@ -356,19 +457,24 @@ public:
         pthread_join(displayThread, NULL);
         pthread_join(radarThread, NULL);
 
+        if (avnOutbox) avnOutbox->stop(); // hands every queued notice to the AVN generator first
+        if (avnInbox) avnInbox->stop();
+        traceFlush();
         displayFinalStats();
+        dumpLockProfile(); // no-op unless built with -DLOCK_PROFILING
+        metricsServer.stop();
 
     }
 
     void createInitialFlights(){
-        pthread_mutex_lock(&flightMutex);
+        PROFILED_LOCK(flightMutex);
 
         for (auto& airline : airlines){
             for (int i = 0 ; i < airline.flightsInOperation; i++){
 
                 std::string flightNum = airline.name + "-" + std::to_string(100 + i);
 
-                Direction direction = static_cast<Direction> (rand() % 4);
+                Direction direction = static_cast<Direction> (simRand() % 4);
 
                 Flight* flight = new Flight(flightNum, &airline, direction);
                 flight->priority = flight->calculatePriority(); 
@@ -376,63 +482,68 @@ public:
                 
             }
         }
-        pthread_mutex_unlock(&flightMutex);
+        publishFlightMetrics();
+        PROFILED_UNLOCK(flightMutex);
     }
 
-    void flightGeneratorLoop() {
+    void scheduleFlightGeneration(time_t now) {
+        northTime = now + 180;
+        southTime = now + 120;
+        eastTime = now + 150;
+        westTime = now + 240;
+    }
+
+    void generatorTick(time_t now) {
+        // Generate North arrivals (every 3 minutes)
+        if (now >= northTime) {
+            generateFlight(Direction::north);
+            northTime = now + 180;
+        }
+        
+        // Generate South arrivals (every 2 minutes)
+        if (now >= southTime) {
+            generateFlight(Direction::south);
+            southTime = now + 120;
+        }
+        
+        // Generate East departures (every 2.5 minutes)
+        if (now >= eastTime) {
+            generateFlight(Direction::east);
+            eastTime = now + 150;
+        }
+        
+        // Generate West departures (every 4 minutes)
+        if (now >= westTime) {
+            generateFlight(Direction::west);
+            westTime = now + 240;
+        }
+        
+        if (now % 60 == 0) { // Every minute
+            generateEmergency();
+        }
+    }
 
-        time_t northTime = time(0) + 180;
-        time_t southTime = time(0) + 120;
-        time_t eastTime = time(0) + 150;
-        time_t westTime = time(0) + 240;
+    void flightGeneratorLoop() {
+        scheduleFlightGeneration(time(0));
         
         while (simulationRunning) {
-            time_t now = time(0);
-            
-            // Generate North arrivals (every 3 minutes)
-            if (now >= northTime) {
-                generateFlight(Direction::north);
-                northTime = now + 180;
-            }
-            
-            // Generate South arrivals (every 2 minutes)
-            if (now >= southTime) {
-                generateFlight(Direction::south);
-                southTime = now + 120;
-            }
-            
-            // Generate East departures (every 2.5 minutes)
-            if (now >= eastTime) {
-                generateFlight(Direction::east);
-                eastTime = now + 150;
-            }
-            
-            // Generate West departures (every 4 minutes)
-            if (now >= westTime) {
-                generateFlight(Direction::west);
-                westTime = now + 240;
-            }
-            
-            if (now % 60 == 0) { // Every minute
-                generateEmergency();
-            }
-            
+            generatorTick(time(0));
             usleep(500000); 
         }
     }
 
     void generateFlight(Direction dir) {
-        pthread_mutex_lock(&flightMutex);
+        PROFILED_LOCK(flightMutex);
         
-        Airline& airline = airlines[rand() % airlines.size()];
+        Airline& airline = airlines[simRand() % airlines.size()];
         
         if (airline.type == AirCraftType::cargo) {
-            pthread_mutex_lock(&runwayMutex);
+            PROFILED_LOCK(runwayMutex);
             bool runwayCAvailable = isRunwayAvailable(Runway::RWY_C);
-            pthread_mutex_unlock(&runwayMutex);
+            PROFILED_UNLOCK(runwayMutex);
             
             if (!runwayCAvailable) {
-                pthread_mutex_unlock(&flightMutex);
+                PROFILED_UNLOCK(flightMutex);
                 return;
             }
         }
@@ -440,7 +551,7 @@ public:
         std::string flightNum = airline.name + "-" + std::to_string(200 + flights.size());
         
         bool isEmergency = false;
-        int emergencyChance = rand() % 100 + 1;
+        int emergencyChance = simRand() % 100 + 1;
         
         switch (dir) {
             case Direction::north:
@@ -462,16 +573,19 @@ public:
         flights.push_back(flight);
 
         
-        std::cout << "NEW FLIGHT: " << flightNum << " (" << airline.name << ") - " 
-                  << flight->getTypeString() << " - Direction: " << flight->getDirectionString();
-        
-        if (isEmergency) {
-            std::cout << " - EMERGENCY";
+        if (simLogging()) {
+            std::cout << "NEW FLIGHT: " << flightNum << " (" << airline.name << ") - " 
+                      << flight->getTypeString() << " - Direction: " << flight->getDirectionString();
+            
+            if (isEmergency) {
+                std::cout << " - EMERGENCY";
+            }
+            
+            std::cout << "\n";
         }
         
-        std::cout << "\n";
-        
-        pthread_mutex_unlock(&flightMutex);
+        publishFlightMetrics();
+        PROFILED_UNLOCK(flightMutex);
     }
 
     static bool comparisonFunction(Flight* a, Flight* b) {
@@ -481,155 +595,173 @@ public:
         return a->priority > b->priority; // Higher priority first
     }
 
-    void flightProcessorLoop() {
-        usleep(3000000); // 3 seconds to see initail states 
-        while (simulationRunning) {
-            pthread_mutex_lock(&flightMutex);
+    // One scheduling pass over all flights
+    void processFlights() {
+        PROFILED_LOCK(flightMutex);
 
-            //priority queue and fcfs
-            std::sort(flights.begin(), flights.end(), comparisonFunction);
+        //priority queue and fcfs
+        std::sort(flights.begin(), flights.end(), comparisonFunction);
 
-            // Process each flight
-            for (auto it = flights.begin(); it != flights.end();) {
-                Flight* flight = *it;
-                bool shouldAdvanceIterator = true;
-                bool stateChanged = false;
-                
-                // Process differently based on current state
-                switch(flight->state) {
-                    case AirCraftState::holding:
-                        // Holding -> Approach (no runway needed)
+        // Process each flight
+        for (auto it = flights.begin(); it != flights.end();) {
+            Flight* flight = *it;
+            bool shouldAdvanceIterator = true;
+            bool stateChanged = false;
+            
+            // Process differently based on current state
+            switch(flight->state) {
+                case AirCraftState::holding:
+                    // Holding -> Approach (no runway needed)
+                    flight->updateState();
+                    stateChanged = true;
+                    break;
+                    
+                case AirCraftState::approach:
+                    // Approach -> Landing (needs runway)
+                    PROFILED_LOCK(runwayMutex);
+                    if (isRunwayAvailable(flight->runway)) {
+                        occupyRunway(flight->runway);
+                        PROFILED_UNLOCK(runwayMutex);
+                        
                         flight->updateState();
                         stateChanged = true;
-                        break;
                         
-                    case AirCraftState::approach:
-                        // Approach -> Landing (needs runway)
-                        pthread_mutex_lock(&runwayMutex);
-                        if (isRunwayAvailable(flight->runway)) {
-                            occupyRunway(flight->runway);
-                            pthread_mutex_unlock(&runwayMutex);
-                            
-                            flight->updateState();
-                            stateChanged = true;
-                            
+                        if (simLogging()) {
                             std::cout << "Flight " << flight->flightNumber << " is landing on " 
                                       << flight->getRunwayString() << std::endl;
-                        } else {
-                            pthread_mutex_unlock(&runwayMutex);
-                            // If runway not available, flight remains in approach state
                         }
-                        break;
-                        
-                    case AirCraftState::landing:
-                        // Landing -> Taxi (release runway after landing)
-                        flight->updateState();
-                        stateChanged = true;
-                        
-                        // Release runway after landing is complete
-                        pthread_mutex_lock(&runwayMutex);
-                        releaseRunway(flight->runway);
-                        pthread_mutex_unlock(&runwayMutex);
-                        
+                    } else {
+                        PROFILED_UNLOCK(runwayMutex);
+                        // If runway not available, flight remains in approach state
+                    }
+                    break;
+                    
+                case AirCraftState::landing:
+                    // Landing -> Taxi (release runway after landing)
+                    flight->updateState();
+                    stateChanged = true;
+                    
+                    // Release runway after landing is complete
+                    PROFILED_LOCK(runwayMutex);
+                    releaseRunway(flight->runway);
+                    PROFILED_UNLOCK(runwayMutex);
+                    
+                    if (simLogging()) {
                         std::cout << "Flight " << flight->flightNumber 
                                   << " completed landing, runway " 
                                   << flight->getRunwayString() << " released" << std::endl;
-                        break;
-                        
-                    case AirCraftState::taxi:
-                        if (flight->isArrival()) {
-                            // Taxi -> At Gate for arrivals
+                    }
+                    break;
+                    
+                case AirCraftState::taxi:
+                    if (flight->isArrival()) {
+                        // Taxi -> At Gate for arrivals
+                        flight->updateState();
+                        stateChanged = true;
+                    } else {
+                        // For departures, taxi -> takeoff_roll (needs runway)
+                        PROFILED_LOCK(runwayMutex);
+                        if (isRunwayAvailable(flight->runway)) {
+                            occupyRunway(flight->runway);
+                            PROFILED_UNLOCK(runwayMutex);
+                            
                             flight->updateState();
                             stateChanged = true;
-                        } else {
-                            // For departures, taxi -> takeoff_roll (needs runway)
-                            pthread_mutex_lock(&runwayMutex);
-                            if (isRunwayAvailable(flight->runway)) {
-                                occupyRunway(flight->runway);
-                                pthread_mutex_unlock(&runwayMutex);
-                                
-                                flight->updateState();
-                                stateChanged = true;
-                                
+                            
+                            if (simLogging()) {
                                 std::cout << "Flight " << flight->flightNumber 
                                           << " is taking off on " << flight->getRunwayString() << std::endl;
-                            } else {
-                                pthread_mutex_unlock(&runwayMutex);
-                                // If runway not available, flight remains in taxi state
                             }
+                        } else {
+                            PROFILED_UNLOCK(runwayMutex);
+                            // If runway not available, flight remains in taxi state
                         }
-                        break;
+                    }
+                    break;
+                    
+                case AirCraftState::at_gate:
+                    if (flight->isDeparture()) {
+                        // At Gate -> Taxi for departures
+                        flight->updateState();
+                        stateChanged = true;
+                    } else {
+                        // For arrivals, this is a terminal state. Check if it's time to remove the flight
+                        time_t now = simTime();
                         
-                    case AirCraftState::at_gate:
-                        if (flight->isDeparture()) {
-                            // At Gate -> Taxi for departures
-                            flight->updateState();
-                            stateChanged = true;
-                        } else {
-                            // For arrivals, this is a terminal state. Check if it's time to remove the flight
-                            time_t now = time(nullptr);
-                            static std::map<Flight*, time_t> arrivalCompletionTimes;
+                        if (arrivalCompletionTimes.find(flight) == arrivalCompletionTimes.end()) {
+                            arrivalCompletionTimes[flight] = now + 15; // 15 seconds at gate before removal
+                        } else if (now >= arrivalCompletionTimes[flight]) {
+                            recordCompletedFlight(*flight, now);
+                            arrivalCompletionTimes.erase(flight); // keep the map bounded to live flights
+                            delete flight;
+                            it = flights.erase(it);
+                            shouldAdvanceIterator = false;
                             
-                            if (arrivalCompletionTimes.find(flight) == arrivalCompletionTimes.end()) {
-                                arrivalCompletionTimes[flight] = now + 15; // 15 seconds at gate before removal
-                            } else if (now >= arrivalCompletionTimes[flight]) {
-                                TotalFlights.push_back(std::make_pair(*flight, now));
-                                delete flight;
-                                it = flights.erase(it);
-                                shouldAdvanceIterator = false;
-                                
+                            if (simLogging()) {
                                 std::cout << "Arrival flight completed and removed from system" << std::endl;
                             }
                         }
-                        break;
-                        
-                    case AirCraftState::takeoff_roll:
-                        // Takeoff Roll -> Climb
-                        flight->updateState();
-                        stateChanged = true;
-                        break;
-                        
-                    case AirCraftState::climb:
-                        // Climb -> Departure (release runway after climbout)
-                        flight->updateState();
-                        stateChanged = true;
-                        
-                        // Release runway after takeoff is complete
-                        pthread_mutex_lock(&runwayMutex);
-                        releaseRunway(flight->runway);
-                        pthread_mutex_unlock(&runwayMutex);
-                        
+                    }
+                    break;
+                    
+                case AirCraftState::takeoff_roll:
+                    // Takeoff Roll -> Climb
+                    flight->updateState();
+                    stateChanged = true;
+                    break;
+                    
+                case AirCraftState::climb:
+                    // Climb -> Departure (release runway after climbout)
+                    flight->updateState();
+                    stateChanged = true;
+                    
+                    // Release runway after takeoff is complete
+                    PROFILED_LOCK(runwayMutex);
+                    releaseRunway(flight->runway);
+                    PROFILED_UNLOCK(runwayMutex);
+                    
+                    if (simLogging()) {
                         std::cout << "Flight " << flight->flightNumber 
                                   << " completed takeoff, runway " 
                                   << flight->getRunwayString() << " released" << std::endl;
-                        break;
+                    }
+                    break;
+                    
+                case AirCraftState::departure:
+                    // For departures, this is a terminal state. Check if it's time to remove the flight
+                    {
+                        time_t now = simTime();
                         
-                    case AirCraftState::departure:
-                        // For departures, this is a terminal state. Check if it's time to remove the flight
-                        {
-                            time_t now = time(nullptr);
-                            static std::map<Flight*, time_t> departureCompletionTimes;
+                        if (departureCompletionTimes.find(flight) == departureCompletionTimes.end()) {
+                            departureCompletionTimes[flight] = now + 10; // 10 seconds before departure removal
+                        } else if (now >= departureCompletionTimes[flight]) {
+                            recordCompletedFlight(*flight, now);
+                            departureCompletionTimes.erase(flight); // keep the map bounded to live flights
+                            delete flight;
+                            it = flights.erase(it);
+                            shouldAdvanceIterator = false;
                             
-                            if (departureCompletionTimes.find(flight) == departureCompletionTimes.end()) {
-                                departureCompletionTimes[flight] = now + 10; // 10 seconds before departure removal
-                            } else if (now >= departureCompletionTimes[flight]) {
-                                TotalFlights.push_back(std::make_pair(*flight, now));
-                                delete flight;
-                                it = flights.erase(it);
-                                shouldAdvanceIterator = false;
-                                
+                            if (simLogging()) {
                                 std::cout << "Departure flight completed and removed from system" << std::endl;
                             }
                         }
-                        break;
-                }
-                
-                if (shouldAdvanceIterator) {
-                    ++it;
-                }
+                    }
+                    break;
             }
             
-            pthread_mutex_unlock(&flightMutex);
+            if (shouldAdvanceIterator) {
+                ++it;
+            }
+        }
+        
+        publishFlightMetrics();
+        PROFILED_UNLOCK(flightMutex);
+    }
+
+    void flightProcessorLoop() {
+        usleep(3000000); // 3 seconds to see initail states 
+        while (simulationRunning) {
+            processFlights();
             
             // Sleep to avoid excessive CPU usage
             usleep(5000000); // 5 seconds -- Changed to 5 seconds so state is not changed rapidly
@@ -669,7 +801,7 @@ public:
     
             // Store current flights for validation
             std::vector<Flight*> currentFlights;
-            pthread_mutex_lock(&flightMutex);
+            PROFILED_LOCK(flightMutex);
             currentFlights = flights; // Make a copy of the pointers
             
             std::cout << "ACTIVE FLIGHTS: " << flights.size() << "\n";
@@ -695,17 +827,17 @@ public:
                           << (flight->isEmergency ? "YES" : "NO") 
                           << (flight->hasActiveAVN ? " (AVN)" : "") << "\n";
             }
-            pthread_mutex_unlock(&flightMutex);
+            PROFILED_UNLOCK(flightMutex);
             
-            pthread_mutex_lock(&runwayMutex);
+            PROFILED_LOCK(runwayMutex);
             std::cout << "\nRUNWAY STATUS:\n";
             std::cout << "RWY-A (North-South): " << (runwayStatus[0] ? "OCCUPIED" : "AVAILABLE") << "\n";
             std::cout << "RWY-B (East-West): " << (runwayStatus[1] ? "OCCUPIED" : "AVAILABLE") << "\n";
             std::cout << "RWY-C (Cargo/Emergency): " << (runwayStatus[2] ? "OCCUPIED" : "AVAILABLE") << "\n";
-            pthread_mutex_unlock(&runwayMutex);
+            PROFILED_UNLOCK(runwayMutex);
             
             // Display AVN information with safety checks
-            pthread_mutex_lock(&avnMutex);
+            PROFILED_LOCK(avnMutex);
             std::cout << "\nISSUED AVNs: " << avns.size() << "\n";
             
             // Check for and remove dangling AVNs
@@ -727,6 +859,7 @@ public:
                     ++it;
                 }
             }
+            metrics.activeAVNs = avns.size();
             
             // Now display the valid AVNs
             if (!avns.empty()) {
@@ -749,13 +882,13 @@ public:
                     }
                     
                     if (flightValid) {
-                        std::cout << std::left << std::setw(10) << "AVN-" + std::to_string(avn.id)
+                        std::cout << std::left << std::setw(10) << "AVN-" + formatAvnId(avn.id)
                                   << std::setw(15) << avn.flight->flightNumber
                                   << std::setw(15) << avn.flight->airline->name
                                   << std::setw(15) << avn.recordedSpeed
                                   << avn.allowedSpeed << "\n";
                     } else {
-                        std::cout << std::left << std::setw(10) << "AVN-" + std::to_string(avn.id)
+                        std::cout << std::left << std::setw(10) << "AVN-" + formatAvnId(avn.id)
                                   << std::setw(15) << "[deleted]"
                                   << std::setw(15) << "[deleted]"
                                   << std::setw(15) << avn.recordedSpeed
@@ -763,30 +896,95 @@ public:
                     }
                 }
             }
-            pthread_mutex_unlock(&avnMutex);
+            PROFILED_UNLOCK(avnMutex);
             
             sleep(1);
         }
     }
 
+    // One radar pass: issue AVNs for flights breaking their speed limit
+    void radarSweep() {
+        PROFILED_LOCK(flightMutex);
+        
+        for (auto flight : flights) {
+            if (flight->speedViolation() && !flight->hasActiveAVN) {
+                issueSpeedViolationAVN(flight);
+            }
+        }
+        retireWithdrawnAVNs();
+        
+        PROFILED_UNLOCK(flightMutex);
+    }
+
+    // Caller holds flightMutex. An AVN the outbox replaced or dropped never reaches the AVN
+    // generator, so no clearance will ever come for it: retire it here so its flight can be
+    // issued a new one.
+    void retireWithdrawnAVNs() {
+        if (!avnOutbox) return;
+        std::vector<AvnId> withdrawn = avnOutbox->takeWithdrawn();
+        if (withdrawn.empty()) return;
+        PROFILED_LOCK(avnMutex);
+        for (AvnId id : withdrawn) {
+            auto avn = std::find_if(avns.begin(), avns.end(), [&](const AVN& candidate) { return candidate.id == id; });
+            if (avn == avns.end()) continue;
+            Flight* flight = avn->flight;
+            avns.erase(avn);
+            metrics.withdrawnAVNs++;
+            // A coalesced notice was replaced by a newer AVN for the same flight, which stays
+            bool stillActive = std::any_of(avns.begin(), avns.end(), [&](const AVN& other) { return other.flight == flight; });
+            if (!stillActive && std::find(flights.begin(), flights.end(), flight) != flights.end()) {
+                flight->hasActiveAVN = false;
+            }
+        }
+        metrics.activeAVNs = avns.size();
+        PROFILED_UNLOCK(avnMutex);
+    }
+
     void radarLoop() {
 
         const int radarInterval = 200000; // 200ms
         
         while (simulationRunning) {
-            pthread_mutex_lock(&flightMutex);
-            
-            for (auto flight : flights) {
-                if (flight->speedViolation() && !flight->hasActiveAVN) {
-                    issueSpeedViolationAVN(flight);
-                }
-            }
-            
-            pthread_mutex_unlock(&flightMutex);
-            
+            radarSweep();
             usleep(radarInterval);
         }
     }
+
+    // Run one replication on the calling thread against a virtual clock. The generator, processor
+    // and radar passes are interleaved at the same periods as their threads in startSimulation(),
+    // without sleeping. The caller owns the seed so replications are reproducible.
+    void runHeadless(unsigned seed, int durationSeconds) {
+        SimContext context(seed);
+        ScopedSimContext scoped(context);
+
+        const long long tickMs = 100;
+        const long long generatorPeriodMs = 500;
+        const long long radarPeriodMs = 200;
+        const long long processorDelayMs = 3000;
+        const long long processorPeriodMs = 5000;
+
+        simulationRunning = true;
+        simulationStartTime = simTime();
+        createInitialFlights();
+        scheduleFlightGeneration(simTime());
+
+        long long nextProcessorMs = processorDelayMs;
+        for (long long t = 0; t < durationSeconds * 1000LL; t += tickMs) {
+            context.elapsedMs = t;
+            if (t % generatorPeriodMs == 0) {
+                generatorTick(simTime());
+            }
+            if (t >= nextProcessorMs) {
+                processFlights();
+                nextProcessorMs += processorPeriodMs;
+            }
+            if (t % radarPeriodMs == 0) {
+                radarSweep();
+            }
+        }
+
+        simulationRunning = false;
+    }
     
     void issueSpeedViolationAVN(Flight* flight) {
         double allowedSpeed = 0;
@@ -818,28 +1016,25 @@ public:
                 break;
         }
         
-        pthread_mutex_lock(&avnMutex);
+        PROFILED_LOCK(avnMutex);
         AVN avn(flight, flight->speed, allowedSpeed);
         avns.push_back(avn);
         violationsByAirline[avn.flight->airline->name]++;
         flight->hasActiveAVN = true;
+
+        int airlineIndex = static_cast<int>(flight->airline - &airlines[0]);
+        if (airlineIndex >= 0 && airlineIndex < kMaxMetricAirlines) {
+            metrics.violationsByAirline[airlineIndex]++;
+        }
+        metrics.totalAVNs++;
+        metrics.activeAVNs = avns.size();
         
-        // Properly copy strings to char arrays
         AVNNotice avnToGenerate;
         avnToGenerate.avnId = avn.id;
-        
-        strncpy(avnToGenerate.aircraftId, flight->flightNumber.c_str(), sizeof(avnToGenerate.aircraftId) - 1);
-        avnToGenerate.aircraftId[sizeof(avnToGenerate.aircraftId) - 1] = '\0'; // Ensure null termination
-        
-        strncpy(avnToGenerate.AirlineName, flight->airline->name.c_str(), sizeof(avnToGenerate.AirlineName) - 1);
-        avnToGenerate.AirlineName[sizeof(avnToGenerate.AirlineName) - 1] = '\0'; // Ensure null termination
-        
-        strncpy(avnToGenerate.aircraftType, flight->getTypeString().c_str(), sizeof(avnToGenerate.aircraftType) - 1);
-        avnToGenerate.aircraftType[sizeof(avnToGenerate.aircraftType) - 1] = '\0'; // Ensure null termination
-        
-        strncpy(avnToGenerate.flightNumber, flight->flightNumber.c_str(), sizeof(avnToGenerate.flightNumber) - 1);
-        avnToGenerate.flightNumber[sizeof(avnToGenerate.flightNumber) - 1] = '\0'; // Ensure null termination
-        
+        avnToGenerate.aircraftId = flight->flightNumber;
+        avnToGenerate.AirlineName = flight->airline->name;
+        avnToGenerate.aircraftType = Flight::typeName(flight->type);
+        avnToGenerate.flightNumber = flight->flightNumber;
         avnToGenerate.recordedSpeed = flight->speed;
         avnToGenerate.allowedSpeed = allowedSpeed;
         if (flight->type == AirCraftType::commercial) {
@@ -849,30 +1044,67 @@ public:
         } else if (flight->type == AirCraftType::emergency) {
             avnToGenerate.totalFine = 100000 * 1.15;
         }
-        avnToGenerate.timestamp = time(0);
+        avnToGenerate.timestamp = simTime();
+        avnToGenerate.trace = traceStart(avn.id);
         
-        // Don't close the read end, and don't close the write end here
-        // Only write to the pipe
-        write(atcs_to_avn[1], &avnToGenerate, sizeof(avnToGenerate));
+        // Queued for the outbox sender thread; headless instances have no AVN generator
+        if (avnOutbox) {
+            std::string frame;
+            encode(frame, avnToGenerate);
+            avnOutbox->enqueue(flight->flightNumber, avn.id, avnShardFor(flight->airline->name, static_cast<int>(atcs_to_avn.size())), frame);
+        }
         
-        std::cout << "AVN ISSUED: Flight " << flight->flightNumber 
-                  << " (" << flight->airline->name << ") - Speed Violation: " 
-                  << flight->speed << " km/h, Allowed: " << allowedSpeed 
-                  << " km/h, State: " << flight->getStateString() << "\n";
-        pthread_mutex_unlock(&avnMutex);
+        if (simLogging()) {
+            std::cout << "AVN ISSUED: Flight " << flight->flightNumber 
+                      << " (" << flight->airline->name << ") - Speed Violation: " 
+                      << flight->speed << " km/h, Allowed: " << allowedSpeed 
+                      << " km/h, State: " << flight->getStateString() << "\n";
+        }
+        PROFILED_UNLOCK(avnMutex);
+    }
+
+
+    // Inbox thread: a paid AVN is cleared. The flight loses its active AVN (so the radar may
+    // issue a new one) and the AVN leaves the active list. One lock round trip per batch.
+    void applyClearances(const std::vector<ViolationClearance>& batch) {
+        PROFILED_LOCK(flightMutex);
+        PROFILED_LOCK(avnMutex);
+        int64_t appliedNs = traceClockNs();
+        for (const ViolationClearance& clearance : batch) {
+            traceSpan(TraceStage::GeneratorToAtcs, clearance.trace, clearance.trace.sentNs, appliedNs);
+            auto avn = std::find_if(avns.begin(), avns.end(),
+                                    [&](const AVN& candidate) { return candidate.id == clearance.avnId; });
+            if (avn == avns.end()) {
+                // The flight had already left and its AVN was dropped from the active list
+                metrics.clearancesUnmatched++;
+                continue;
+            }
+            if (std::find(flights.begin(), flights.end(), avn->flight) != flights.end()) {
+                avn->flight->hasActiveAVN = false;
+                if (simLogging()) {
+                    std::cout << "AVN CLEARED: Flight " << avn->flight->flightNumber
+                              << " - AVN-" << formatAvnId(avn->id) << " " << clearance.status << "\n";
+                }
+            }
+            avns.erase(avn);
+            metrics.clearedAVNs++;
+            traceSpan(TraceStage::DetectToCleared, clearance.trace, clearance.trace.originNs, appliedNs);
+        }
+        metrics.activeAVNs = avns.size();
+        PROFILED_UNLOCK(avnMutex);
+        PROFILED_UNLOCK(flightMutex);
     }
 
-    
     void displayFinalStats() {
         std::cout << "\n==== AirControlX Simulation Final Statistics ====\n";
         
-        pthread_mutex_lock(&flightMutex);
-        pthread_mutex_lock(&avnMutex);
+        PROFILED_LOCK(flightMutex);
+        PROFILED_LOCK(avnMutex);
         
         // Make a copy of current flights for validation
         std::vector<Flight*> currentFlights = flights;
         
-        std::cout << "Total Flights Processed: " << TotalFlights.size() << "\n";
+        std::cout << "Total Flights Processed: " << flightStats.completedFlights << "\n";
         
         // Clean up AVNs with invalid flight pointers
         for (auto it = avns.begin(); it != avns.end();) {
@@ -890,11 +1122,18 @@ public:
                 ++it;
             }
         }
+        metrics.activeAVNs = avns.size();
         
         std::cout << "Total AVNs Issued: " << violationsByAirline.size() << "\n";
+        std::cout << "AVNs Cleared After Payment: " << metrics.clearedAVNs.load() << "\n";
+        std::cout << "AVNs Withdrawn Undelivered: " << metrics.withdrawnAVNs.load() << "\n";
         
-        // Display table of all processed flights with details
+        // Display table of the most recent processed flights with details
         std::cout << "\n==== FLIGHT HISTORY TABLE ====\n";
+        if (flightHistory.droppedRows() > 0) {
+            std::cout << "(showing the last " << flightHistory.size() << " flights, "
+                      << flightHistory.droppedRows() << " older flights only counted in the averages)\n";
+        }
         std::cout << "------------------------------------------------------------------------------------------------------------------------------------------------\n";
         std::cout << std::left << std::setw(15) << "Flight" 
                   << std::setw(20) << "Airline" 
@@ -908,66 +1147,57 @@ public:
                   << "Emergency\n";
         std::cout << "------------------------------------------------------------------------------------------------------------------------------------------------\n";
         
-        for (const auto& flightPair : TotalFlights) {
-            const Flight& flight = flightPair.first;
-            time_t completionTime = flightPair.second;
-            time_t waitTime = completionTime - flight.scheduleTime;
+        for (size_t i = 0; i < flightHistory.size(); i++) {
+            FlightHistoryLog::Row flight = flightHistory.row(i);
+            time_t waitTime = flight.completionTime - flight.scheduleTime;
             
             char scheduleTimeBuffer[26];
             char completionTimeBuffer[26];
             
             // Format the time values
             std::strftime(scheduleTimeBuffer, 26, "%H:%M:%S", std::localtime(&flight.scheduleTime));
-            std::strftime(completionTimeBuffer, 26, "%H:%M:%S", std::localtime(&completionTime));
+            std::strftime(completionTimeBuffer, 26, "%H:%M:%S", std::localtime(&flight.completionTime));
             
             std::cout << std::left << std::setw(15) << flight.flightNumber 
-                      << std::setw(20) << flight.airline->name 
-                      << std::setw(12) << flight.getTypeString()
-                      << std::setw(12) << flight.getDirectionString() 
-                      << std::setw(12) << flight.getStateString() 
+                      << std::setw(20) << airlines[flight.airlineIndex].name 
+                      << std::setw(12) << Flight::typeName(flight.type)
+                      << std::setw(12) << Flight::directionName(flight.direction) 
+                      << std::setw(12) << Flight::stateName(flight.state) 
                       << std::setw(15) << flight.priority
                       << std::setw(20) << scheduleTimeBuffer
                       << std::setw(20) << completionTimeBuffer
                       << std::setw(15) << waitTime
                       << (flight.isEmergency ? "YES" : "NO")
-                      << (flight.hasActiveAVN ? " (AVN)" : "") << "\n";
+                      << (flight.hadAVN ? " (AVN)" : "") << "\n";
         }
         std::cout << "------------------------------------------------------------------------------------------------------------------------------------------------\n";
         
-        // Add statistics about average wait times by priority and type
-        std::map<int, std::pair<int, int>> waitTimesByPriority; // priority -> (total wait time, count)
-        std::map<AirCraftType, std::pair<int, int>> waitTimesByType; // type -> (total wait time, count)
-        
-        for (const auto& flightPair : TotalFlights) {
-            const Flight& flight = flightPair.first;
-            time_t completionTime = flightPair.second;
-            int waitTime = static_cast<int>(completionTime - flight.scheduleTime);
-            
-            waitTimesByPriority[flight.priority].first += waitTime;
-            waitTimesByPriority[flight.priority].second++;
-            
-            waitTimesByType[flight.type].first += waitTime;
-            waitTimesByType[flight.type].second++;
-        }
-        
+        // Average wait times come from the aggregates kept at completion time
         std::cout << "\n==== AVERAGE WAIT TIMES ====\n";
         std::cout << "\nBy Priority:\n";
-        for (const auto& pair : waitTimesByPriority) {
-            int avgWaitTime = pair.second.first / (pair.second.second > 0 ? pair.second.second : 1);
-            std::cout << "Priority " << pair.first << ": " << avgWaitTime << " seconds\n";
+        for (const auto& pair : flightStats.byPriority) {
+            std::cout << "Priority " << pair.first << ": " << static_cast<int>(pair.second.mean()) << " seconds\n";
         }
         
         std::cout << "\nBy Aircraft Type:\n";
-        for (const auto& pair : waitTimesByType) {
-            int avgWaitTime = pair.second.first / (pair.second.second > 0 ? pair.second.second : 1);
-            std::string typeStr;
-            switch(pair.first) {
-                case AirCraftType::commercial: typeStr = "Commercial"; break;
-                case AirCraftType::cargo: typeStr = "Cargo"; break;
-                case AirCraftType::emergency: typeStr = "Emergency"; break;
-                default: typeStr = "Unknown";
-            }
-            std::cout << typeStr << ": " << avgWaitTime << " seconds\n";
+        for (int i = 0; i < 3; i++) {
+            if (flightStats.byType[i].count == 0) continue;
+            std::cout << Flight::typeName(static_cast<AirCraftType>(i)) << ": "
+                      << static_cast<int>(flightStats.byType[i].mean()) << " seconds\n";
+        }
+        
+        std::cout << "\nBy Direction:\n";
+        for (int i = 0; i < 4; i++) {
+            if (flightStats.byDirection[i].count == 0) continue;
+            std::cout << Flight::directionName(static_cast<Direction>(i)) << ": "
+                      << static_cast<int>(flightStats.byDirection[i].mean()) << " seconds\n";
+        }
+        
+        std::cout << "\nBy Airline:\n";
+        for (size_t i = 0; i < flightStats.byAirline.size(); i++) {
+            if (flightStats.byAirline[i].count == 0) continue;
+            std::cout << airlines[i].name << ": " << static_cast<int>(flightStats.byAirline[i].mean()) << " seconds"
+                      << " (p95 " << flightStats.byAirline[i].percentile(0.95) << "s)\n";
         }
         
         std::cout << "\nAVNs by Airline:\n";
@@ -975,8 +1205,8 @@ public:
             std::cout << pair.first << ": " << pair.second << "\n";
         }
         
-        pthread_mutex_unlock(&avnMutex);
-        pthread_mutex_unlock(&flightMutex);
+        PROFILED_UNLOCK(avnMutex);
+        PROFILED_UNLOCK(flightMutex);
         
         std::cout << "\nSimulation completed." << std::endl;
     }
@@ -985,25 +1215,25 @@ public:
     
     // Get runway status (thread-safe)
     bool getRunwayStatus(int index) {
-        pthread_mutex_lock(&runwayMutex);
+        PROFILED_LOCK(runwayMutex);
         bool status = runwayStatus[index];
-        pthread_mutex_unlock(&runwayMutex);
+        PROFILED_UNLOCK(runwayMutex);
         return status;
     }
     
     // Get flight count (thread-safe)
     size_t getFlightCount() {
-        pthread_mutex_lock(&flightMutex);
+        PROFILED_LOCK(flightMutex);
         size_t count = flights.size();
-        pthread_mutex_unlock(&flightMutex);
+        PROFILED_UNLOCK(flightMutex);
         return count;
     }
     
     // Get AVN count (thread-safe)
     size_t getAVNCount() {
-        pthread_mutex_lock(&avnMutex);
+        PROFILED_LOCK(avnMutex);
         size_t count = avns.size();
-        pthread_mutex_unlock(&avnMutex);
+        PROFILED_UNLOCK(avnMutex);
         return count;
     }
     
@@ -1016,17 +1246,17 @@ public:
     
     // Get a thread-safe copy of the flights vector
     std::vector<Flight*> getFlightsCopy() {
-        pthread_mutex_lock(&flightMutex);
+        PROFILED_LOCK(flightMutex);
         std::vector<Flight*> flightsCopy = flights;
-        pthread_mutex_unlock(&flightMutex);
+        PROFILED_UNLOCK(flightMutex);
         return flightsCopy;
     }
     
     // Get a thread-safe copy of the AVNs vector
     std::vector<AVN> getAVNsCopy() {
-        pthread_mutex_lock(&avnMutex);
+        PROFILED_LOCK(avnMutex);
         std::vector<AVN> avnsCopy = avns;
-        pthread_mutex_unlock(&avnMutex);
+        PROFILED_UNLOCK(avnMutex);
         return avnsCopy;
     }
     
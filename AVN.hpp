@@ -1,10 +1,12 @@
 #pragma once
 
 #include <string>
+#include <atomic>
 #include "Flight.hpp"
+#include "AvnId.hpp"
 
 struct AVN{
-    int id;
+    AvnId id;
     Flight* flight;
     double recordedSpeed;
     double allowedSpeed;
@@ -12,9 +14,8 @@ struct AVN{
     time_t issueTime;
     AVN(Flight* flight, double recordedSpeed, double allowedSpeed, bool isPaid = false)
         : flight(flight), recordedSpeed(recordedSpeed), allowedSpeed(allowedSpeed), isPaid(isPaid) {
-        static int nextId = 1;
-        id = nextId++;
-        issueTime = time(nullptr);
+        id = nextAvnId();
+        issueTime = simTime();
     }
 
 };
\ No newline at end of file
@@ -4,93 +4,349 @@
 #include <sys/types.h>
 #include <cstring>
 #include <fstream>
+#include <map>
+#include <deque>
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <ctime>
 #include "MsgStructs.hpp"
+#include "ShmRing.hpp"
+#include "BroadcastLog.hpp"
+#include "WireFormat.hpp"
+#include "AlertWorker.hpp"
+#include "ViolationStore.hpp"
+#include "Heartbeat.hpp"
+#include "AvnShard.hpp"
 
 using namespace std;
 
+// Fan-out batching: notices are held back until maxBatch have accumulated or the oldest has
+// waited flushLatencyMs, then each destination gets them in one vectored write and
+// the violation store in one append. flushLatencyMs = 0 still batches whatever a single wakeup
+// drained; maxBatch = 1 sends every notice on its own.
+struct AVNBatchOptions {
+    int maxBatch = 64;
+    int flushLatencyMs = 5;
+};
+
 class AVNGenerator {
     private:
-    int atcs_to_avn[2];
-    int avn_to_atcs[2];
-    int avn_to_airline[2];
-    int avn_to_stripe[2];
-    int stripe_to_avn[2];
-    vector<AVNNotice> avnNotices;
+    std::string name;         // log prefix, with the shard number when sharded
+    IpcChannel atcs_to_avn;
+    IpcChannel avn_to_atcs;   // clearances for paid AVNs
+    BroadcastLog* avnLog;     // every notice, once, for the airline portal and Stripe
+    IpcChannel stripe_to_avn;
+    std::map<AvnId, AVNNotice> avnNotices; // issued and not yet paid, by AVN ID
+    AVNBatchOptions batchOptions;
+    std::vector<AVNNotice> pendingBatch;  // processed, not yet sent
+    std::vector<int64_t> pendingReadNs;   // when each was read, for tracing
+    long long batchDeadlineMs;            // flush time of pendingBatch (CLOCK_MONOTONIC)
+    AvnIdSet issued;          // every AVN processed, so a repeated violation is issued once
+    AvnId firstIssued;        // first AVN this process issued; a restarted shard's predecessor issued the older ones
+    long paidCount;
+    long duplicateViolations;
+    long duplicateConfirmations;
+    std::deque<std::string> unsentClearances; // encoded, waiting for room in avn_to_atcs
+    long droppedClearances;
+    ViolationStore violationStore; // every AVN issued, indexed for avnquery
+    static const size_t kClearanceBatch = 64;
+    static const size_t kMaxUnsentClearances = 4096; // oldest dropped beyond this
+    static const int kClearanceRetryMs = 50;
+    AlertWorker alerts;       // audible "violation detected", off the reactor thread
     
     
     public:
-    AVNGenerator(int* atcs_to_avn, int* avn_to_atcs, int* avn_to_airline, int* avn_to_stripe, int* stripe_to_avn) {
-        // Constructor code here
-        this->atcs_to_avn[0] = atcs_to_avn[0];
-        this->atcs_to_avn[1] = atcs_to_avn[1];
-        this->avn_to_atcs[0] = avn_to_atcs[0];
-        this->avn_to_atcs[1] = avn_to_atcs[1];
-        this->avn_to_airline[0] = avn_to_airline[0];
-        this->avn_to_airline[1] = avn_to_airline[1];
-        this->avn_to_stripe[0] = avn_to_stripe[0];
-        this->avn_to_stripe[1] = avn_to_stripe[1];
-        this->stripe_to_avn[0] = stripe_to_avn[0];
-        this->stripe_to_avn[1] = stripe_to_avn[1];
-
+    AVNGenerator(const IpcChannel& atcs_to_avn, const IpcChannel& avn_to_atcs, BroadcastLog* avnLog,
+                 const IpcChannel& stripe_to_avn,
+                 const AVNBatchOptions& batchOptions = AVNBatchOptions(), bool audioAlerts = true,
+                 int shard = 0, int shards = 1)
+        : name(avnShardName(shard, shards)), atcs_to_avn(atcs_to_avn), avn_to_atcs(avn_to_atcs), avnLog(avnLog),
+          stripe_to_avn(stripe_to_avn), batchOptions(batchOptions),
+          batchDeadlineMs(0), firstIssued(0), paidCount(0), duplicateViolations(0), duplicateConfirmations(0), droppedClearances(0),
+          violationStore(vstore::shardDirectory("violation_store", shard, shards)),
+          alerts(audioAlerts ? static_cast<AlertSink*>(new EspeakSink()) : new NullSink()) {
+        if (this->batchOptions.maxBatch < 1) this->batchOptions.maxBatch = 1;
+        if (this->batchOptions.flushLatencyMs < 0) this->batchOptions.flushLatencyMs = 0;
+        pendingBatch.reserve(this->batchOptions.maxBatch);
+        pendingReadNs.reserve(this->batchOptions.maxBatch);
     }
 
     void run() {
-        // Simulate AVN generation        
-        // Close the write end of the pipe only if we created it
-        // DO NOT close the write end if it was passed to us
-        // close(atcs_to_avn[1]); // Remove this line - it's closed in the wrong place
-        
-        // Open the file for appending, not just writing
-        FILE* file = fopen("violations.txt", "a");
-        if (!file) {
-            std::cerr << "Failed to open violations.txt for writing" << std::endl;
-        }
-        
-        while(1){
-            // Read from ATCS to AVN pipe
-            AVNNotice details;
-            int bytesread = read(atcs_to_avn[0], &details, sizeof(details));
-            
-            if (bytesread > 0){
-                if(fork() == 0)
-                    execl("/usr/bin/bash", "bash", "-c", "espeak 'Violation detected!'", NULL);
-                
-                // Process the violation details
-                std::cout << "AVN Generator: Processing violation for flight " << details.aircraftId << std::endl;
-                avnNotices.push_back(details);
-                // Use proper C-style strings instead of trying to use std::string methods
-                if (file) {
-                    fprintf(file, "AVN ID: %d, Aircraft ID: %s, Airline: %s, Flight: %s, Type: %s, Recorded Speed: %.2f, Allowed Speed: %.2f, Fine: $%.2f, Timestamp: %s",
-                        details.avnId, details.aircraftId, details.AirlineName, details.flightNumber, details.aircraftType,
-                        details.recordedSpeed, details.allowedSpeed, details.totalFine,
-                        ctime(&details.timestamp));
-                    // Flush the file but don't close it each time
-                    fflush(file);
+        traceSetProcess(name);
+        if (violationStore.open()) {
+            std::cout << name << ": recording violations as run " << violationStore.currentRun() << " ("
+                      << violationStore.writerBackend() << " writes)" << std::endl;
+        } else {
+            std::cerr << name << ": failed to open the violation store" << std::endl;
+        }
+        alerts.start();
+
+        // Reactor over both inbound channels: sleep until either has data, then drain
+        // everything that is ready before sleeping again
+        int epollFd = epoll_create1(EPOLL_CLOEXEC);
+        IpcChannel* inputs[2] = {&atcs_to_avn, &stripe_to_avn};
+        bool inputOpen[2] = {false, false};
+        for (int i = 0; i < 2; i++) {
+            struct epoll_event event;
+            event.events = EPOLLIN;
+            event.data.u32 = i;
+            inputOpen[i] = epoll_ctl(epollFd, EPOLL_CTL_ADD, inputs[i]->pollFd(), &event) == 0;
+        }
+        if (epollFd < 0 || !inputOpen[0]) {
+            std::cerr << name << ": failed to set up event loop" << std::endl;
+            return;
+        }
+        // A stop request from the supervisor ends the loop even while both inputs stay open
+        if (processStopFd() >= 0) {
+            struct epoll_event event;
+            event.events = EPOLLIN;
+            event.data.u32 = 2;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, processStopFd(), &event);
+        }
+
+        heartbeatReady();
+        while (inputOpen[0] || inputOpen[1]) {
+            heartbeat();
+            if (inputOpen[0] && !drainViolations()) {
+                closeInput(epollFd, atcs_to_avn, inputOpen[0]);
+            }
+            if (inputOpen[1] && !drainConfirmations()) {
+                closeInput(epollFd, stripe_to_avn, inputOpen[1]);
+            }
+            if (stopRequested()) {
+                break; // what was already queued is drained; flush and close below
+            }
+            int timeoutMs = -1;
+            if (!pendingBatch.empty()) {
+                long long remaining = batchDeadlineMs - monotonicMs();
+                if (remaining <= 0) {
+                    flushBatch();
                 } else {
-                    std::cerr << "Error: file handle is null" << std::endl;
+                    timeoutMs = static_cast<int>(remaining);
+                }
+            }
+            if (!flushClearances() && (timeoutMs < 0 || timeoutMs > kClearanceRetryMs)) {
+                timeoutMs = kClearanceRetryMs; // ATCS is behind or not running; try again shortly
+            }
+
+            // Only sleep if nothing arrived between the drain and arming the wakeups
+            bool idle = true;
+            for (int i = 0; i < 2 && idle; i++) {
+                if (inputOpen[i] && !inputs[i]->armWait()) idle = false;
+            }
+            bool woken[3] = {false, false, false};
+            if (idle) {
+                struct epoll_event events[3];
+                int ready = epoll_wait(epollFd, events, 3, heartbeatTimeout(timeoutMs));
+                for (int i = 0; i < ready; i++) {
+                    woken[events[i].data.u32] = true;
                 }
-                close(avn_to_airline[0]);
-                // Send the violation details to the airline portal
-                write(avn_to_airline[1], &details, sizeof(details));
-                
-                // Also communicate with the Stripe payment system
-                write(avn_to_stripe[1], &details, sizeof(details));
-                
-                // Send acknowledgment back to ATCS
-                bool ack = true;
-                write(avn_to_atcs[1], &ack, sizeof(ack));
             }
-            else{
-                if (fork() == 0)
-                    execl("/usr/bin/bash", "bash", "-c", "espeak 'You failed!'", NULL);
+            for (int i = 0; i < 2; i++) {
+                if (inputOpen[i]) inputs[i]->disarmWait(woken[i]);
             }
-            // Simulate some processing time
-            sleep(1);
         }
-        
-        // Close the file at the end (though this code is unreachable in the current implementation)
-        if (file) {
-            fclose(file);
+
+        flushBatch();
+        if (!flushClearances() || droppedClearances > 0) {
+            std::cerr << name << ": " << unsentClearances.size() + droppedClearances
+                      << " clearances never reached ATCS" << std::endl;
+        }
+        if (avnLog) {
+            avnLog->close();
+            avnLog->printStats(std::cout);
+        }
+        alerts.stop();
+        alerts.printStats(std::cout);
+        std::cout << name << ": " << issued.size() << " AVNs issued (" << issued.runCount() << " ID ranges), "
+                  << paidCount << " paid; ignored " << duplicateViolations << " duplicate violations and "
+                  << duplicateConfirmations << " duplicate confirmations" << std::endl;
+        close(epollFd);
+        violationStore.close();
+    }
+
+private:
+    // Returns false once the channel is closed or broken
+    bool drainViolations() {
+        char frame[IpcChannel::kMaxMessageSize];
+        ssize_t length;
+        while ((length = atcs_to_avn.tryRead(frame, sizeof(frame))) > 0) {
+            AVNNoticeView details;
+            const char* error = nullptr;
+            if (length <= static_cast<ssize_t>(sizeof(frame)) && decode(frame, length, details, &error)) {
+                processViolation(details.toMessage());
+            } else {
+                std::cerr << name << ": dropped invalid notice frame (" << (error ? error : "oversized") << ")" << std::endl;
+                atcs_to_avn.resync(); // a pipe peer restarted mid-frame
+            }
+        }
+        return errno == EAGAIN;
+    }
+
+    bool drainConfirmations() {
+        char frame[IpcChannel::kMaxMessageSize];
+        ssize_t length;
+        while ((length = stripe_to_avn.tryRead(frame, sizeof(frame))) > 0) {
+            PaymentConfirmationView confirmation;
+            const char* error = nullptr;
+            if (length <= static_cast<ssize_t>(sizeof(frame)) && decode(frame, length, confirmation, &error)) {
+                processConfirmation(confirmation);
+            } else {
+                std::cerr << name << ": dropped invalid confirmation frame (" << (error ? error : "oversized") << ")" << std::endl;
+                stripe_to_avn.resync(); // a pipe peer restarted mid-frame
+            }
+        }
+        return errno == EAGAIN;
+    }
+
+    void closeInput(int epollFd, IpcChannel& channel, bool& open) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, channel.pollFd(), nullptr);
+        open = false;
+    }
+
+    void processViolation(const AVNNotice& details) {
+        if (!issued.insert(details.avnId)) {
+            duplicateViolations++;
+            std::cout << name << ": Ignoring repeated violation for AVN ID " << details.avnId << std::endl;
+            return;
+        }
+        // ATCS sends each shard its AVNs in ID order, so an older ID is a repeat; the IDs in
+        // between went to other shards and would otherwise each leave a run behind
+        issued.pruneBelow(details.avnId);
+        if (firstIssued == 0) firstIssued = details.avnId;
+        alerts.raise("Violation detected!");
+
+        // Process the violation details
+        std::cout << name << ": Processing violation for flight " << details.aircraftId << std::endl;
+        avnNotices[details.avnId] = details;
+
+        if (pendingBatch.empty()) {
+            batchDeadlineMs = monotonicMs() + batchOptions.flushLatencyMs;
+        }
+        pendingBatch.push_back(details);
+        pendingReadNs.push_back(details.trace.traceId ? traceClockNs() : 0);
+        traceSpan(TraceStage::AtcsToGenerator, details.trace, details.trace.sentNs, pendingReadNs.back());
+        if (static_cast<int>(pendingBatch.size()) >= batchOptions.maxBatch) {
+            flushBatch();
+        }
+    }
+
+    // Sends the pending notices: one append to the violation store and one append to the
+    // broadcast log (read by the airline portal and Stripe)
+    void flushBatch() {
+        if (pendingBatch.empty()) {
+            return;
+        }
+        int count = static_cast<int>(pendingBatch.size());
+
+        if (!violationStore.append(pendingBatch)) {
+            std::cerr << name << ": failed to record violations in the store" << std::endl;
+        }
+
+        // Encode the frames back to back, then point one iovec at each frame
+        std::string noticeFrames;
+        std::vector<size_t> noticeEnds(count);
+        int64_t appendNs = traceClockNs();
+        for (int i = 0; i < count; i++) {
+            AVNNotice& details = pendingBatch[i];
+            traceSpan(TraceStage::GeneratorBatch, details.trace, pendingReadNs[i], appendNs);
+            details.trace = traceForward(details.trace, appendNs);
+            encode(noticeFrames, details);
+            noticeEnds[i] = noticeFrames.size();
+        }
+        std::vector<struct iovec> notices = frameVectors(noticeFrames, noticeEnds);
+
+        // Each notice is written once; the portal and Stripe read it at their own cursors
+        ssize_t appended = avnLog ? avnLog->append(notices.data(), count) : count;
+        if (appended != count) {
+            std::cerr << name << ": " << count - appended << " notices too large for the broadcast log, skipped" << std::endl;
+        }
+
+        pendingBatch.clear();
+        pendingReadNs.clear();
+    }
+
+    static std::vector<struct iovec> frameVectors(std::string& frames, const std::vector<size_t>& ends) {
+        std::vector<struct iovec> vectors(ends.size());
+        size_t start = 0;
+        for (size_t i = 0; i < ends.size(); i++) {
+            vectors[i] = {&frames[start], ends[i] - start};
+            start = ends[i];
+        }
+        return vectors;
+    }
+
+    static long long monotonicMs() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+    }
+
+    void processConfirmation(const PaymentConfirmationView& confirmation) {
+        int64_t readNs = confirmation.trace.traceId ? traceClockNs() : 0;
+        traceSpan(TraceStage::StripeToGenerator, confirmation.trace, confirmation.trace.sentNs, readNs);
+        auto notice = avnNotices.find(confirmation.avnId);
+        if (notice == avnNotices.end()) {
+            // Older than anything this process issued: the AVN went through the process this
+            // one replaced, and ATCS still waits for its clearance. ATCS matches clearances on
+            // the ID alone and counts one for an AVN it has already cleared as unmatched.
+            bool predecessors = firstIssued == 0 || confirmation.avnId < firstIssued;
+            if (predecessors && confirmation.status == "paid") {
+                std::cout << name << ": AVN ID " << confirmation.avnId << " was issued before a restart and is paid, clearing it" << std::endl;
+                paidCount++;
+                queueClearance(confirmation.avnId, "", traceForward(confirmation.trace, readNs));
+                return;
+            }
+            // A notice leaves avnNotices once paid, so an AVN this process issued that is not
+            // there is paid
+            if (!predecessors && issued.contains(confirmation.avnId)) {
+                duplicateConfirmations++;
+                std::cout << name << ": Ignoring repeated confirmation for paid AVN ID " << confirmation.avnId << std::endl;
+                return;
+            }
+            std::cout << name << ": Payment confirmation for unknown AVN ID " << confirmation.avnId << std::endl;
+            return;
+        }
+        std::cout << name << ": AVN ID " << confirmation.avnId << " for flight " << notice->second.flightNumber
+                  << " is " << confirmation.status << std::endl;
+        if (confirmation.status == "paid") {
+            paidCount++;
+            queueClearance(notice->second.avnId, notice->second.aircraftId, traceForward(confirmation.trace, readNs));
+            avnNotices.erase(notice);
+        }
+    }
+
+    // A paid AVN is cleared in ATCS, which frees the flight for new AVNs
+    void queueClearance(AvnId avnId, const std::string& aircraftId, const TraceContext& trace) {
+        ViolationClearance clearance;
+        clearance.avnId = avnId;
+        clearance.aircraftId = aircraftId;
+        clearance.status = "cleared";
+        clearance.trace = trace;
+        if (unsentClearances.size() >= kMaxUnsentClearances) {
+            unsentClearances.pop_front();
+            droppedClearances++;
+        }
+        unsentClearances.emplace_back();
+        encode(unsentClearances.back(), clearance);
+    }
+
+    // Writes queued clearances without blocking: ATCS reads them on its own thread, but only
+    // while a simulation runs, and this loop must keep serving Stripe regardless. Returns
+    // true once none are left.
+    bool flushClearances() {
+        std::vector<struct iovec> vectors;
+        while (!unsentClearances.empty()) {
+            vectors.clear();
+            for (size_t i = 0; i < unsentClearances.size() && vectors.size() < kClearanceBatch; i++) {
+                vectors.push_back({&unsentClearances[i][0], unsentClearances[i].size()});
+            }
+            ssize_t sent = avn_to_atcs.writeBatch(vectors.data(), static_cast<int>(vectors.size()), false);
+            if (sent > 0) unsentClearances.erase(unsentClearances.begin(), unsentClearances.begin() + sent);
+            if (sent < static_cast<ssize_t>(vectors.size())) return false;
         }
+        return true;
     }
 };
\ No newline at end of file
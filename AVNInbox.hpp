@@ -0,0 +1,129 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <iostream>
+#include <functional>
+#include <cerrno>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "ShmRing.hpp"
+#include "WireFormat.hpp"
+#include "MetricsServer.hpp"
+
+// Reads ViolationClearance messages from the avn_to_atcs channels, one per AVN generator
+// shard, on its own thread. Each wakeup drains every channel and hands the whole batch to
+// the handler, so the ATC locks are taken once per batch rather than per clearance, and no
+// simulation thread ever waits on a read.
+class AVNInbox {
+public:
+    typedef std::function<void(const std::vector<ViolationClearance>&)> Handler;
+
+private:
+    std::vector<IpcChannel> channels; // by shard
+    Handler handler;
+    SimulationMetrics* metrics;
+    int stopFd;                       // eventfd stop() signals to wake the reader
+    bool started;
+    pthread_t readerThread;
+
+    static void* readerThreadFunc(void* arg) {
+        static_cast<AVNInbox*>(arg)->readLoop();
+        return nullptr;
+    }
+
+    void readLoop() {
+        std::vector<bool> inputOpen(channels.size());
+        size_t openCount = 0;
+        for (size_t shard = 0; shard < channels.size(); shard++) {
+            inputOpen[shard] = channels[shard].pollFd() >= 0;
+            if (inputOpen[shard]) openCount++;
+        }
+        std::vector<ViolationClearance> batch;
+        std::vector<struct pollfd> fds;
+        std::vector<int> fdShard;
+        bool stopping = false;
+        while (true) {
+            batch.clear();
+            for (size_t shard = 0; shard < channels.size(); shard++) {
+                if (inputOpen[shard] && !drain(channels[shard], batch)) {
+                    inputOpen[shard] = false;
+                    openCount--;
+                }
+            }
+            if (!batch.empty()) {
+                metrics->clearancesReceived += batch.size();
+                handler(batch);
+            }
+            if (stopping || openCount == 0) {
+                break;
+            }
+
+            // Sleep until a shard has data or stop() is called; only sleep if nothing
+            // arrived between the drain and arming the wakeups
+            fds.clear();
+            fdShard.clear();
+            fds.push_back({stopFd, POLLIN, 0});
+            fdShard.push_back(-1);
+            bool idle = true;
+            for (size_t shard = 0; shard < channels.size(); shard++) {
+                if (!inputOpen[shard]) continue;
+                fds.push_back({channels[shard].pollFd(), POLLIN, 0});
+                fdShard.push_back(static_cast<int>(shard));
+                if (!channels[shard].armWait()) idle = false;
+            }
+            if (poll(fds.data(), fds.size(), idle ? -1 : 0) < 0) {
+                for (struct pollfd& fd : fds) fd.revents = 0;
+            }
+            for (size_t i = 1; i < fds.size(); i++) {
+                channels[fdShard[i]].disarmWait(fds[i].revents & POLLIN);
+            }
+            if (fds[0].revents & POLLIN) {
+                stopping = true; // one last drain first
+            }
+        }
+    }
+
+    // Returns false once the channel is closed or broken
+    bool drain(IpcChannel& channel, std::vector<ViolationClearance>& batch) {
+        char frame[IpcChannel::kMaxMessageSize];
+        ssize_t length;
+        while ((length = channel.tryRead(frame, sizeof(frame))) > 0) {
+            ViolationClearanceView clearance;
+            const char* error = nullptr;
+            if (length > static_cast<ssize_t>(sizeof(frame)) || !decode(frame, length, clearance, &error)) {
+                std::cerr << "ATCS inbox: dropped invalid clearance frame (" << (error ? error : "oversized") << ")" << std::endl;
+                channel.resync(); // a pipe peer restarted mid-frame
+                continue;
+            }
+            batch.push_back(clearance.toMessage());
+        }
+        return errno == EAGAIN;
+    }
+
+public:
+    AVNInbox(const std::vector<IpcChannel>& channels, SimulationMetrics* metrics, const Handler& handler)
+        : channels(channels), handler(handler), metrics(metrics),
+          stopFd(eventfd(0, EFD_CLOEXEC)), started(false) {
+    }
+
+    ~AVNInbox() {
+        stop();
+        if (stopFd >= 0) close(stopFd);
+    }
+
+    void start() {
+        if (started || stopFd < 0) return;
+        started = pthread_create(&readerThread, NULL, readerThreadFunc, this) == 0;
+    }
+
+    // Applies whatever has already arrived, then joins the reader. Clearances sent after
+    // this stay in the channels.
+    void stop() {
+        if (!started) return;
+        ShmRing::signal(stopFd);
+        pthread_join(readerThread, NULL);
+        started = false;
+    }
+};
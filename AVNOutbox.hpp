@@ -0,0 +1,373 @@
+#pragma once
+#include <deque>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+#include <sys/uio.h>
+#include "ShmRing.hpp"
+#include "MetricsServer.hpp"
+#include "AvnId.hpp"
+
+// What enqueue() does when the outbox is full:
+//   Block    - wait for the sender to make room (the caller's locks stay held meanwhile)
+//   Coalesce - replace the queued notice with the same key if there is one, otherwise drop
+//              the oldest queued notice; never waits. The replacement goes to the back of
+//              the queue: every policy delivers a shard's notices in AVN ID order.
+//   Spill    - append to a spill file on disk, replayed in order once the channel catches up
+// A notice that is replaced or dropped (here, or because its channel is broken or still full
+// when the outbox stops) will never reach the AVN generator; its AVN ID is handed back
+// through takeWithdrawn() so ATCS can retire the AVN instead of waiting for a clearance.
+enum class OutboxPolicy { Block, Coalesce, Spill };
+
+inline const char* outboxPolicyName(OutboxPolicy policy) {
+    switch (policy) {
+        case OutboxPolicy::Block: return "block";
+        case OutboxPolicy::Coalesce: return "coalesce";
+        case OutboxPolicy::Spill: return "spill";
+    }
+    return "unknown";
+}
+
+inline bool parseOutboxPolicy(const char* name, OutboxPolicy& policy) {
+    if (strcmp(name, "block") == 0) policy = OutboxPolicy::Block;
+    else if (strcmp(name, "coalesce") == 0) policy = OutboxPolicy::Coalesce;
+    else if (strcmp(name, "spill") == 0) policy = OutboxPolicy::Spill;
+    else return false;
+    return true;
+}
+
+struct OutboxOptions {
+    size_t capacity = 256;
+    OutboxPolicy policy = OutboxPolicy::Coalesce;
+    std::string spillPath = "avn_outbox.spill";
+};
+
+// Bounded queue of encoded frames between the radar and the atcs_to_avn channels, one per
+// AVN generator shard. The radar only ever touches memory (or, when spilling, a buffered
+// file); a dedicated sender thread does the channel writes, so a slow AVN generator no
+// longer stalls the ATC threads. Frames for one shard are written in the order queued. The
+// sender never blocks on a channel: a full shard is retried every kRetryMs, so stop() can
+// always finish, giving up on what is still unsent after kStopTimeoutMs.
+class AVNOutbox {
+private:
+    struct Entry {
+        std::string key;   // coalescing key (flight number)
+        AvnId avnId;
+        int shard;         // destination generator shard
+        std::string frame;
+    };
+
+    static const size_t kSendBatch = 64;
+    static const int kRetryMs = 5;
+    static const int kStopTimeoutMs = 2000;
+
+    OutboxOptions options;
+    std::vector<IpcChannel> channels; // by shard
+    SimulationMetrics* metrics;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+    std::deque<Entry> queue;
+    std::vector<AvnId> withdrawn;     // never to be delivered, not yet taken by ATCS
+    bool stopping;
+    bool started;
+    pthread_t senderThread;
+
+    // Spill file: shard, length and AVN ID, then the frame; appended at the end and replayed
+    // from spillReadOffset
+    FILE* spillFile;
+    long spillReadOffset;
+    long spillPending; // frames in the file not yet replayed
+
+    static void* senderThreadFunc(void* arg) {
+        static_cast<AVNOutbox*>(arg)->senderLoop();
+        return nullptr;
+    }
+
+    // Caller holds mutex
+    void publishDepth() {
+        long depth = static_cast<long>(queue.size());
+        metrics->outboxDepth = depth;
+        metrics->outboxSpillDepth = spillPending;
+        if (depth > metrics->outboxHighWater.load()) {
+            metrics->outboxHighWater = depth;
+        }
+    }
+
+    static long long monotonicMs() {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+    }
+
+    // Caller holds mutex
+    void withdraw(const Entry& entry) {
+        withdrawn.push_back(entry.avnId);
+        metrics->outboxDropped++;
+    }
+
+    // Caller holds mutex
+    bool spill(const Entry& entry) {
+        if (!spillFile) {
+            spillFile = fopen(options.spillPath.c_str(), "w+b");
+            if (!spillFile) {
+                std::cerr << "AVN outbox: cannot open spill file " << options.spillPath << std::endl;
+                return false;
+            }
+            spillReadOffset = 0;
+        }
+        uint32_t header[2] = {static_cast<uint32_t>(entry.shard), static_cast<uint32_t>(entry.frame.size())};
+        uint64_t avnId = entry.avnId;
+        fseek(spillFile, 0, SEEK_END);
+        if (fwrite(header, sizeof(header), 1, spillFile) != 1 || fwrite(&avnId, sizeof(avnId), 1, spillFile) != 1 ||
+            fwrite(entry.frame.data(), 1, entry.frame.size(), spillFile) != entry.frame.size()) {
+            return false;
+        }
+        spillPending++;
+        metrics->outboxSpilled++;
+        return true;
+    }
+
+    // Caller holds mutex. Moves spilled frames back into the (empty) queue, oldest first.
+    void replaySpill() {
+        fflush(spillFile);
+        fseek(spillFile, spillReadOffset, SEEK_SET);
+        while (spillPending > 0 && queue.size() < options.capacity) {
+            uint32_t header[2];
+            uint64_t avnId;
+            if (fread(header, sizeof(header), 1, spillFile) != 1 || fread(&avnId, sizeof(avnId), 1, spillFile) != 1) break;
+            uint32_t length = header[1];
+            Entry entry;
+            entry.avnId = avnId;
+            entry.shard = static_cast<int>(header[0]);
+            entry.frame.resize(length);
+            if (length > 0 && fread(&entry.frame[0], 1, length, spillFile) != length) break;
+            queue.push_back(entry);
+            spillPending--;
+        }
+        spillReadOffset = ftell(spillFile);
+        if (spillPending == 0) {
+            // Everything replayed: start the file over instead of letting it grow forever
+            fflush(spillFile);
+            if (ftruncate(fileno(spillFile), 0) != 0) {
+                std::cerr << "AVN outbox: cannot truncate spill file" << std::endl;
+            }
+            spillReadOffset = 0;
+        }
+    }
+
+    // Caller holds mutex. Withdraws every frame still in the spill file, unreplayed.
+    void withdrawSpill() {
+        if (spillPending == 0) return;
+        fflush(spillFile);
+        fseek(spillFile, spillReadOffset, SEEK_SET);
+        while (spillPending > 0) {
+            uint32_t header[2];
+            Entry entry;
+            if (fread(header, sizeof(header), 1, spillFile) != 1 || fread(&entry.avnId, sizeof(entry.avnId), 1, spillFile) != 1 ||
+                fseek(spillFile, header[1], SEEK_CUR) != 0) {
+                break;
+            }
+            withdraw(entry);
+            spillPending--;
+        }
+        if (spillPending > 0) {
+            std::cerr << "AVN outbox: " << spillPending << " spilled notices unreadable, their AVNs stay active" << std::endl;
+            metrics->outboxDropped += spillPending;
+            spillPending = 0;
+        }
+        spillReadOffset = ftell(spillFile);
+    }
+
+    void senderLoop() {
+        std::vector<std::deque<Entry>> unsent(channels.size()); // taken from the queue, by shard
+        std::vector<struct iovec> vectors;
+        long long giveUpMs = 0;
+        bool progressed = true; // the previous pass moved, sent or withdrew something
+        while (true) {
+            size_t backlog = 0;
+            for (const std::deque<Entry>& shard : unsent) backlog += shard.size();
+
+            pthread_mutex_lock(&mutex);
+            bool idle = queue.empty() && spillPending == 0;
+            if (idle && backlog == 0) {
+                if (!stopping) pthread_cond_wait(&notEmpty, &mutex);
+            } else if (backlog > 0 && (idle || !progressed)) {
+                // A shard is full and nothing else can move; try it again shortly rather
+                // than spin on the mutex the radar enqueues under
+                timespec deadline;
+                clock_gettime(CLOCK_REALTIME, &deadline);
+                deadline.tv_nsec += kRetryMs * 1000000L;
+                deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+                deadline.tv_nsec %= 1000000000L;
+                pthread_cond_timedwait(&notEmpty, &mutex, &deadline);
+            }
+            if (queue.empty() && spillPending > 0) {
+                replaySpill();
+            }
+            if (stopping && giveUpMs == 0) {
+                giveUpMs = monotonicMs() + kStopTimeoutMs;
+            }
+            if (stopping && ((queue.empty() && spillPending == 0 && backlog == 0) || monotonicMs() >= giveUpMs)) {
+                // Whatever is left would wait on a generator that is not reading
+                for (std::deque<Entry>& shard : unsent) {
+                    for (const Entry& entry : shard) withdraw(entry);
+                }
+                for (const Entry& entry : queue) withdraw(entry);
+                queue.clear();
+                withdrawSpill();
+                publishDepth();
+                pthread_mutex_unlock(&mutex);
+                return;
+            }
+            // Per shard, hold at most one batch back; a full shard stops the queue behind it
+            progressed = false;
+            while (!queue.empty() && unsent[queue.front().shard].size() < kSendBatch) {
+                unsent[queue.front().shard].push_back(std::move(queue.front()));
+                queue.pop_front();
+                progressed = true;
+            }
+            publishDepth();
+            if (progressed) pthread_cond_broadcast(&notFull);
+            pthread_mutex_unlock(&mutex);
+
+            // The only place that writes to the AVN generators; no ATC lock is held here and
+            // nothing waits. One write per shard with frames to send.
+            for (size_t shard = 0; shard < channels.size(); shard++) {
+                std::deque<Entry>& pending = unsent[shard];
+                if (pending.empty()) continue;
+                vectors.clear();
+                for (Entry& entry : pending) vectors.push_back({&entry.frame[0], entry.frame.size()});
+                ssize_t sent = channels[shard].writeBatch(vectors.data(), static_cast<int>(vectors.size()), false);
+                if (sent < 0 && errno != EAGAIN) {
+                    // Broken channel: none of these will ever be read
+                    pthread_mutex_lock(&mutex);
+                    for (const Entry& entry : pending) withdraw(entry);
+                    pthread_mutex_unlock(&mutex);
+                    pending.clear();
+                    progressed = true;
+                    continue;
+                }
+                if (sent > 0) {
+                    progressed = true;
+                    metrics->outboxSent += sent;
+                    pending.erase(pending.begin(), pending.begin() + sent);
+                }
+            }
+        }
+    }
+
+public:
+    AVNOutbox(const std::vector<IpcChannel>& channels, SimulationMetrics* metrics, const OutboxOptions& options)
+        : options(options), channels(channels), metrics(metrics), stopping(false), started(false),
+          spillFile(nullptr), spillReadOffset(0), spillPending(0) {
+        if (this->options.capacity == 0) this->options.capacity = 1;
+        pthread_mutex_init(&mutex, NULL);
+        pthread_cond_init(&notEmpty, NULL);
+        pthread_cond_init(&notFull, NULL);
+    }
+
+    ~AVNOutbox() {
+        stop();
+        if (spillFile) {
+            fclose(spillFile);
+            remove(options.spillPath.c_str());
+        }
+        pthread_cond_destroy(&notFull);
+        pthread_cond_destroy(&notEmpty);
+        pthread_mutex_destroy(&mutex);
+    }
+
+    void start() {
+        if (started) return;
+        stopping = false;
+        started = pthread_create(&senderThread, NULL, senderThreadFunc, this) == 0;
+    }
+
+    // Sends everything still queued or spilled, then joins the sender; whatever a generator
+    // has not taken within kStopTimeoutMs is withdrawn
+    void stop() {
+        if (!started) return;
+        pthread_mutex_lock(&mutex);
+        stopping = true;
+        pthread_cond_broadcast(&notEmpty);
+        pthread_mutex_unlock(&mutex);
+        pthread_join(senderThread, NULL);
+        started = false;
+    }
+
+    // Safe to call with the ATC mutexes held: only the Block policy can wait, and only
+    // while the outbox is full
+    void enqueue(const std::string& key, AvnId avnId, int shard, const std::string& frame) {
+        if (shard < 0 || shard >= static_cast<int>(channels.size())) shard = 0;
+        Entry entry = {key, avnId, shard, frame};
+        pthread_mutex_lock(&mutex);
+        metrics->outboxEnqueued++;
+
+        bool queued = false;
+        if (spillPending > 0 && options.policy == OutboxPolicy::Spill) {
+            // Keep FIFO order: once frames are on disk, new ones go behind them
+            queued = spill(entry);
+        } else if (queue.size() >= options.capacity) {
+            switch (options.policy) {
+                case OutboxPolicy::Block: {
+                    timespec waitStart, waitEnd;
+                    clock_gettime(CLOCK_MONOTONIC, &waitStart);
+                    while (queue.size() >= options.capacity && !stopping) {
+                        pthread_cond_wait(&notFull, &mutex);
+                    }
+                    clock_gettime(CLOCK_MONOTONIC, &waitEnd);
+                    metrics->outboxBlockedNs += (waitEnd.tv_sec - waitStart.tv_sec) * 1000000000LL
+                                                + (waitEnd.tv_nsec - waitStart.tv_nsec);
+                    break;
+                }
+                case OutboxPolicy::Coalesce: {
+                    // Make room, then queue at the back like any other notice
+                    bool replaced = false;
+                    for (auto it = queue.rbegin(); it != queue.rend(); ++it) {
+                        if (it->key == key) {
+                            withdrawn.push_back(it->avnId);
+                            queue.erase(std::next(it).base());
+                            metrics->outboxCoalesced++;
+                            replaced = true;
+                            break;
+                        }
+                    }
+                    if (!replaced) {
+                        withdraw(queue.front());
+                        queue.pop_front();
+                    }
+                    break;
+                }
+                case OutboxPolicy::Spill:
+                    queued = spill(entry);
+                    if (!queued) {
+                        withdraw(queue.front());
+                        queue.pop_front();
+                    }
+                    break;
+            }
+        }
+        if (!queued) {
+            queue.push_back(std::move(entry));
+        }
+        publishDepth();
+        pthread_cond_signal(&notEmpty);
+        pthread_mutex_unlock(&mutex);
+    }
+
+    // The AVN IDs replaced or dropped since the last call
+    std::vector<AvnId> takeWithdrawn() {
+        std::vector<AvnId> ids;
+        pthread_mutex_lock(&mutex);
+        ids.swap(withdrawn);
+        pthread_mutex_unlock(&mutex);
+        return ids;
+    }
+};
@@ -2,29 +2,311 @@
 
 #include <iostream>
 #include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
 #include <SFML/Graphics.hpp>
 #include "MsgStructs.hpp"
+#include "ShmRing.hpp"
+#include "BroadcastLog.hpp"
+#include "WireFormat.hpp"
+#include "SpscQueue.hpp"
+#include "Heartbeat.hpp"
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <algorithm>
 #include <string>
 #include <cstring>
+#include <cmath>
 
-// Structure to represent a pay button
-struct PayButton {
-    int avnId;
-    sf::RectangleShape shape;
-    sf::Text text;
+enum class NoticeStatus { Unpaid, Paid, PaymentFailed };
+
+// A notice as the portal shows it: the AVN plus what Stripe last reported for it
+struct PortalNotice {
+    AVNNotice notice;
+    NoticeStatus status = NoticeStatus::Unpaid;
+    uint32_t revision = 0; // bumped whenever notice is replaced, so cached rows are rebuilt
+};
+
+// Every notice the portal has received. A hash index by AVN ID owns them; each airline has
+// a view of pointers into it sorted by AVN ID (issue order), kept up to date on every add.
+// Notices mostly arrive in ID order, so updating a view is usually a push_back.
+class NoticeIndex {
+private:
+    std::unordered_map<AvnId, PortalNotice> byId; // nodes never move, so views can point into it
+    std::unordered_map<std::string, std::vector<PortalNotice*>> byAirline;
+
+    static bool idLess(const PortalNotice* notice, AvnId id) { return notice->notice.avnId < id; }
+
+    void removeFromView(PortalNotice* entry) {
+        std::vector<PortalNotice*>& view = byAirline[entry->notice.AirlineName];
+        auto at = std::lower_bound(view.begin(), view.end(), entry->notice.avnId, idLess);
+        if (at != view.end() && *at == entry) view.erase(at);
+    }
+
+public:
+    // Adds a notice, or replaces the one with the same AVN ID (keeping its status)
+    PortalNotice& add(const AVNNotice& notice) {
+        auto inserted = byId.emplace(notice.avnId, PortalNotice());
+        PortalNotice& entry = inserted.first->second;
+        if (!inserted.second) {
+            entry.revision++;
+            if (entry.notice.AirlineName == notice.AirlineName) {
+                entry.notice = notice;
+                return entry;
+            }
+            removeFromView(&entry);
+        }
+        entry.notice = notice;
+        std::vector<PortalNotice*>& view = byAirline[notice.AirlineName];
+        if (view.empty() || view.back()->notice.avnId < notice.avnId) {
+            view.push_back(&entry);
+        } else {
+            view.insert(std::lower_bound(view.begin(), view.end(), notice.avnId, idLess), &entry);
+        }
+        return entry;
+    }
+
+    PortalNotice* find(AvnId avnId) {
+        auto found = byId.find(avnId);
+        return found != byId.end() ? &found->second : nullptr;
+    }
+
+    // The airline's notices in AVN ID order
+    const std::vector<PortalNotice*>& airline(const std::string& name) const {
+        static const std::vector<PortalNotice*> none;
+        auto found = byAirline.find(name);
+        return found != byAirline.end() ? found->second : none;
+    }
+
+    size_t size() const { return byId.size(); }
 };
 
+// One airline's notices as a virtualised table. Only the rows in view are drawn, and each of
+// them (plus kMarginRows either side, so a scroll step rarely builds anything) lives in a
+// reusable row slot whose glyph quads are rebuilt only when the notice or its status changes.
+// Drawing takes two calls whatever the number of notices: every button quad in one
+// untextured vertex array, every glyph quad in one array textured with the font's glyph page.
+class NoticeTable {
+public:
+    static constexpr float kLeft = 60;
+    static constexpr float kTop = 120;          // y of row 0 at scroll offset 0
+    static constexpr float kRowHeight = 30;
+    static constexpr float kColumnWidth = 180;
+    static constexpr float kViewTop = 100;      // rows are shown while kViewTop <= y <= kViewBottom
+    static constexpr float kViewBottom = 700;
+    static const unsigned kCharacterSize = 16;
+    static const int kMarginRows = 2;
+
+private:
+    struct RowSlot {
+        long row = -1;                       // index into rows, -1 = empty
+        AvnId avnId = 0;
+        uint32_t revision = 0;
+        NoticeStatus status = NoticeStatus::Unpaid;
+        std::vector<sf::Vertex> glyphs;      // y relative to the top of the row
+        std::vector<sf::Vertex> quads;
+    };
+
+    const sf::Font& font;
+    const std::vector<PortalNotice*>* rows;
+    float scrollOffset;
+    std::vector<RowSlot> slots;              // row r lives in slots[r % slots.size()]
+    sf::VertexArray glyphArray;
+    sf::VertexArray quadArray;
+    bool stale;                              // the arrays no longer match rows/scrollOffset
+    long slotBuilds;
+    long compositions;
+
+    long firstVisibleRow() const { return static_cast<long>(std::ceil((kViewTop - kTop + scrollOffset) / kRowHeight)); }
+    long lastVisibleRow() const { return static_cast<long>(std::floor((kViewBottom - kTop + scrollOffset) / kRowHeight)); }
+
+    void appendText(std::vector<sf::Vertex>& out, const std::string& text, float x, const sf::Color& color) {
+        float baseline = static_cast<float>(kCharacterSize);
+        sf::Uint32 previous = 0;
+        for (unsigned char c : text) {
+            x += font.getKerning(previous, c, kCharacterSize);
+            previous = c;
+            const sf::Glyph& glyph = font.getGlyph(c, kCharacterSize, false);
+            float left = x + glyph.bounds.left, top = baseline + glyph.bounds.top;
+            float right = left + glyph.bounds.width, bottom = top + glyph.bounds.height;
+            float u0 = static_cast<float>(glyph.textureRect.left), v0 = static_cast<float>(glyph.textureRect.top);
+            float u1 = u0 + glyph.textureRect.width, v1 = v0 + glyph.textureRect.height;
+            out.push_back(sf::Vertex(sf::Vector2f(left, top), color, sf::Vector2f(u0, v0)));
+            out.push_back(sf::Vertex(sf::Vector2f(right, top), color, sf::Vector2f(u1, v0)));
+            out.push_back(sf::Vertex(sf::Vector2f(right, bottom), color, sf::Vector2f(u1, v1)));
+            out.push_back(sf::Vertex(sf::Vector2f(left, bottom), color, sf::Vector2f(u0, v1)));
+            x += glyph.advance;
+        }
+    }
+
+    static void appendQuad(std::vector<sf::Vertex>& out, float left, float top, float width, float height, const sf::Color& color) {
+        out.push_back(sf::Vertex(sf::Vector2f(left, top), color, sf::Vector2f()));
+        out.push_back(sf::Vertex(sf::Vector2f(left + width, top), color, sf::Vector2f()));
+        out.push_back(sf::Vertex(sf::Vector2f(left + width, top + height), color, sf::Vector2f()));
+        out.push_back(sf::Vertex(sf::Vector2f(left, top + height), color, sf::Vector2f()));
+    }
+
+    // The slot holding row, rebuilt if it holds another row or an outdated one
+    RowSlot& materialise(long row) {
+        const PortalNotice& entry = *(*rows)[row];
+        RowSlot& slot = slots[row % slots.size()];
+        if (slot.row == row && slot.avnId == entry.notice.avnId && slot.revision == entry.revision &&
+            slot.status == entry.status) {
+            return slot;
+        }
+        slot.row = row;
+        slot.avnId = entry.notice.avnId;
+        slot.revision = entry.revision;
+        slot.status = entry.status;
+        slot.glyphs.clear();
+        slot.quads.clear();
+        slotBuilds++;
+
+        const AVNNotice& notice = entry.notice;
+        char timeText[50];
+        time_t safeTime = notice.timestamp > 0 ? notice.timestamp : time(0);
+        strftime(timeText, sizeof(timeText), "%a, %b %d, %Y %H:%M:%S", localtime(&safeTime));
+        const std::string cells[] = {
+            "AVN-" + formatAvnId(notice.avnId),
+            !notice.aircraftId.empty() ? notice.aircraftId : "Unknown",
+            !notice.flightNumber.empty() ? notice.flightNumber : "Unknown",
+            std::to_string(static_cast<int>(notice.recordedSpeed)) + " km/h",
+            std::to_string(static_cast<int>(notice.allowedSpeed)) + " km/h",
+            !notice.aircraftType.empty() ? notice.aircraftType : "Unknown",
+            "$" + std::to_string(static_cast<int>(notice.totalFine)),
+            timeText,
+        };
+        float cellX = kLeft;
+        for (const std::string& cell : cells) {
+            appendText(slot.glyphs, cell, cellX, sf::Color::White);
+            cellX += kColumnWidth;
+        }
+
+        // Paid AVNs get a label, the others a Pay button (white 1px outline, green fill)
+        if (entry.status == NoticeStatus::Paid) {
+            appendText(slot.glyphs, "Paid", cellX, sf::Color(100, 220, 100));
+        } else {
+            appendQuad(slot.quads, cellX - 1, -3, 82, 26, sf::Color::White);
+            appendQuad(slot.quads, cellX, -2, 80, 24, sf::Color(50, 150, 50));
+            appendText(slot.glyphs, "Pay", cellX + 25, sf::Color::White);
+        }
+        return slot;
+    }
+
+    static void appendShifted(sf::VertexArray& array, const std::vector<sf::Vertex>& vertices, float dy) {
+        for (sf::Vertex vertex : vertices) {
+            vertex.position.y += dy;
+            array.append(vertex);
+        }
+    }
+
+    void compose() {
+        glyphArray.clear();
+        quadArray.clear();
+        long count = rows ? static_cast<long>(rows->size()) : 0;
+        long first = std::max(0L, firstVisibleRow());
+        long last = std::min(count - 1, lastVisibleRow());
+        for (long row = std::max(0L, first - kMarginRows); row <= std::min(count - 1, last + kMarginRows); row++) {
+            RowSlot& slot = materialise(row);
+            if (row < first || row > last) continue; // margin: built ahead of a scroll, not drawn
+            float rowY = kTop + row * kRowHeight - scrollOffset;
+            appendShifted(quadArray, slot.quads, rowY);
+            appendShifted(glyphArray, slot.glyphs, rowY);
+        }
+        compositions++;
+        stale = false;
+    }
+
+public:
+    explicit NoticeTable(const sf::Font& font)
+        : font(font), rows(nullptr), scrollOffset(0), glyphArray(sf::Quads), quadArray(sf::Quads), stale(true),
+          slotBuilds(0), compositions(0) {
+        size_t visible = static_cast<size_t>((kViewBottom - kViewTop) / kRowHeight) + 1;
+        slots.resize(visible + 2 * kMarginRows + 1);
+    }
+
+    // The notices to show, in display order. Call again whenever they change; only the slots
+    // whose notice or status changed are rebuilt.
+    void setRows(const std::vector<PortalNotice*>* notices) {
+        rows = notices;
+        stale = true;
+    }
+
+    float scroll() const { return scrollOffset; }
+
+    void setScroll(float offset) {
+        float limit = maxScroll();
+        offset = std::max(0.0f, std::min(offset, limit));
+        if (offset != scrollOffset) {
+            scrollOffset = offset;
+            stale = true;
+        }
+    }
+
+    // Scrolled to the end, the last row sits at the bottom of the view
+    float maxScroll() const {
+        long count = rows ? static_cast<long>(rows->size()) : 0;
+        return std::max(0.0f, kTop + (count - 1) * kRowHeight - kViewBottom);
+    }
+
+    bool empty() const { return !rows || rows->empty(); }
+
+    // The AVN whose Pay button is at (x, y), or nullptr
+    const PortalNotice* payButtonAt(float x, float y) const {
+        if (!rows || y < kViewTop || y > kViewBottom + kRowHeight) return nullptr;
+        float buttonX = kLeft + 8 * kColumnWidth;
+        if (x < buttonX || x >= buttonX + 80) return nullptr;
+        long row = static_cast<long>(std::floor((y + 2 - kTop + scrollOffset) / kRowHeight));
+        if (row < 0 || row >= static_cast<long>(rows->size()) || row < firstVisibleRow() || row > lastVisibleRow()) {
+            return nullptr;
+        }
+        float rowY = kTop + row * kRowHeight - scrollOffset;
+        if (y < rowY - 2 || y >= rowY + 22) return nullptr;
+        const PortalNotice* entry = (*rows)[row];
+        return entry->status == NoticeStatus::Paid ? nullptr : entry;
+    }
+
+    // Recomposes the arrays only if something changed since the last frame
+    void draw(sf::RenderWindow& window) {
+        if (stale) compose();
+        window.draw(quadArray);
+        sf::RenderStates states(&font.getTexture(kCharacterSize));
+        window.draw(glyphArray, states);
+    }
+
+    long builds() const { return slotBuilds; }
+    long rebuilds() const { return compositions; }
+};
+
+// Everything the reader thread received between two hand-offs to the UI thread
+struct PortalBatch {
+    std::vector<AVNNotice> notices;
+    std::vector<PaymentConfirmation> confirmations;
+
+    bool empty() const { return notices.empty() && confirmations.empty(); }
+};
+
+// The reader thread polls both inputs (the AVN broadcast logs, one per generator shard, and
+// stripe_to_airline) and hands what it read to the UI thread in batches through a lock-free
+// queue. Only the UI thread touches the notices and the table; it applies the queued batches
+// once per frame and rebuilds the table at most once per frame, however many notices arrived.
 class AirlinePortal {
 private:
-    int avn_to_airline[2];
-    int stripe_to_airline[2];
-    std::vector<AVNNotice> avnNotices;
-    
-    // Map to store notices by airline
-    std::map<std::string, std::vector<AVNNotice>> noticesByAirline;
+    BroadcastMerge notices;  // AVN notices from the generator shards' broadcast logs
+    IpcChannel stripe_to_airline;
+    NoticeIndex noticeIndex;   // every notice received, by AVN ID and by airline
+
+    // Reader thread -> UI thread
+    static const size_t kUpdateQueueSize = 64;
+    static const int kHandOffRetryMs = 16; // about one frame
+    SpscQueue<PortalBatch*> updates;
+    int stopFd;              // eventfd the UI thread signals to stop the reader thread
+    bool tableDirty;         // rebuild the table before drawing the next frame
+    long noticesReceived;
+    long confirmationsReceived;
+    long frames;
     
     // SFML window
     sf::RenderWindow window;
@@ -46,23 +328,18 @@ private:
     sf::Text backButton;
     sf::RectangleShape noticeTable;
     std::vector<sf::Text> tableHeaders;
-    std::vector<std::vector<sf::Text>> noticeRows;
-    std::vector<PayButton> payButtons;
-    float scrollOffset;
-    int maxVisibleRows;
+    NoticeTable table;       // the current airline's notices
 
     // Payment processing
     bool paymentProcessed;
-    int lastProcessedAvnId;
+    AvnId lastProcessedAvnId;
     int paymentMessageTimer;
 
 public:
-    AirlinePortal(int* avn_to_airline, int* stripe_to_airline) {
-        // Initialize pipe file descriptors
-        this->avn_to_airline[0] = avn_to_airline[0];
-        this->avn_to_airline[1] = avn_to_airline[1];
-        this->stripe_to_airline[0] = stripe_to_airline[0];
-        this->stripe_to_airline[1] = stripe_to_airline[1];
+    AirlinePortal(const BroadcastMerge& notices, const IpcChannel& stripe_to_airline)
+        : notices(notices), stripe_to_airline(stripe_to_airline), updates(kUpdateQueueSize),
+          stopFd(eventfd(0, EFD_CLOEXEC)), tableDirty(false), noticesReceived(0), confirmationsReceived(0),
+          frames(0), table(font) {
         
         // Initialize SFML elements with a wider window
         window.create(sf::VideoMode(1800, 900), "Airline Portal");
@@ -130,28 +407,35 @@ public:
             headerX += columnWidth;
         }
         
-        // Initialize scroll values
-        scrollOffset = 0;
-        maxVisibleRows = 25;
-
         // Initialize payment processing variables
         paymentProcessed = false;
-        lastProcessedAvnId = -1;
+        lastProcessedAvnId = 0;
         paymentMessageTimer = 0;
     }
 
+    ~AirlinePortal() {
+        if (stopFd >= 0) close(stopFd);
+    }
+
     void run() {
-        // Start a background thread to read from pipes
+        traceSetProcess("airline portal");
+        // Start a background thread to read from both inputs
         pthread_t readThread;
-        pthread_create(&readThread, NULL, &AirlinePortal::readThreadFunc, this);
+        bool reading = pthread_create(&readThread, NULL, &AirlinePortal::readThreadFunc, this) == 0;
         
         // Add some mock data for testing if no notices exist yet
-        if (avnNotices.empty()) {
+        if (noticeIndex.size() == 0) {
             //addMockDataForTesting();
         }
         
-        // Main window loop
+        // Main window loop; each frame doubles as the supervisor heartbeat
+        heartbeatReady();
         while (window.isOpen()) {
+            heartbeat();
+            if (stopRequested()) {
+                window.close(); // the supervisor is shutting us down
+                break;
+            }
             sf::Event event;
             while (window.pollEvent(event)) {
                 if (event.type == sf::Event::Closed) {
@@ -171,7 +455,8 @@ public:
                                 currentState = DASHBOARD;
                                 dashboardTitle.setString(currentAirline + " Aviation - AVN Notices");
                                 inputString.clear();
-                                updateNoticeTable();
+                                table.setRows(&noticeIndex.airline(currentAirline));
+                                table.setScroll(0);
                                 std::cout << "Switched to dashboard view for airline: " << currentAirline << std::endl;
                             }
                         }
@@ -193,28 +478,30 @@ public:
                             std::cout << "Returned to login screen" << std::endl;
                         }
                         
-                        // Check if any Pay button was clicked
-                        for (auto& payButton : payButtons) {
-                            if (payButton.shape.getGlobalBounds().contains(event.mouseButton.x, event.mouseButton.y)) {
-                                std::cout << "Pay button clicked for AVN ID: " << payButton.avnId << std::endl;
-                                processPayment(payButton.avnId);
-                            }
+                        // Check if a Pay button was clicked; found from the row under the mouse
+                        if (const PortalNotice* clicked = table.payButtonAt(event.mouseButton.x, event.mouseButton.y)) {
+                            AvnId avnId = clicked->notice.avnId;
+                            std::cout << "Pay button clicked for AVN ID: " << avnId << std::endl;
+                            processPayment(avnId);
                         }
                     }
                 }
                 
                 // Handle scrolling in dashboard
                 if (event.type == sf::Event::MouseWheelScrolled && currentState == DASHBOARD) {
-                    scrollOffset += event.mouseWheelScroll.delta * -20;
-                    if (scrollOffset < 0) scrollOffset = 0;
-                    
-                    // Calculate max scroll based on number of notices
-                    float maxScroll = std::max(0.0f, (float)((noticeRows.size() - maxVisibleRows) * 30));
-                    if (scrollOffset > maxScroll) scrollOffset = maxScroll;
-                    
-                    updateNoticeTable();
+                    // Clamped to the rows there are
+                    table.setScroll(table.scroll() + event.mouseWheelScroll.delta * -20);
                 }
             }
+
+            // Take in what the reader thread received; the table is recomposed at most once,
+            // when it is drawn
+            applyUpdates();
+            if (tableDirty) {
+                table.setRows(&noticeIndex.airline(currentAirline));
+                tableDirty = false;
+            }
+            frames++;
             
             // Clear the window
             window.clear(sf::Color(20, 20, 50));
@@ -234,23 +521,13 @@ public:
                     window.draw(header);
                 }
                 
-                // Draw notice rows
-                for (auto& row : noticeRows) {
-                    for (auto& cell : row) {
-                        window.draw(cell);
-                    }
-                }
-                
-                // Draw Pay buttons
-                for (auto& payButton : payButtons) {
-                    window.draw(payButton.shape);
-                    window.draw(payButton.text);
-                }
+                // Draw the visible notice rows and their Pay buttons
+                table.draw(window);
                 
                 window.draw(backButton);
                 
                 // If no notices, show a message
-                if (noticeRows.empty()) {
+                if (table.empty()) {
                     sf::Text noNoticesText;
                     noNoticesText.setFont(font);
                     noNoticesText.setCharacterSize(24);
@@ -267,7 +544,7 @@ public:
                     paymentMessage.setCharacterSize(24);
                     paymentMessage.setFillColor(sf::Color::Green);
                     paymentMessage.setPosition(500, 800);
-                    paymentMessage.setString("Payment processed for AVN ID: " + std::to_string(lastProcessedAvnId));
+                    paymentMessage.setString("AVN-" + formatAvnId(lastProcessedAvnId) + " is settled automatically by Stripe");
                     window.draw(paymentMessage);
                     paymentMessageTimer--;
                 }
@@ -277,22 +554,26 @@ public:
             window.display();
         }
         
-        // Cancel the background thread
-        pthread_cancel(readThread);
+        // Stop the reader thread and drop whatever it handed over since the last frame
+        if (reading) {
+            ShmRing::signal(stopFd);
+            pthread_join(readThread, NULL);
+        }
+        PortalBatch* batch;
+        while (updates.pop(batch)) delete batch;
+        std::cout << "Airline Portal: " << noticesReceived << " notices (" << notices.lost() << " skipped while behind), "
+                  << confirmationsReceived << " confirmations, " << table.rebuilds() << " table rebuilds (" << table.builds() << " rows built) in "
+                  << frames << " frames" << std::endl;
     }
 
     // Static method to create and run the portal as a child process
-    static void launchPortal(int* avn_to_airline, int* stripe_to_airline) {
+    static void launchPortal(const BroadcastMerge& notices, const IpcChannel& stripe_to_airline) {
         pid_t pid = fork();
         
         if (pid == 0) {
             // Child process
-            // Close pipes we don't need in the child process
-            close(avn_to_airline[1]); // We only read from this pipe
-            close(stripe_to_airline[1]); // We only read from this pipe
-            
             // Create and run the portal
-            AirlinePortal portal(avn_to_airline, stripe_to_airline);
+            AirlinePortal portal(notices, stripe_to_airline);
             portal.run();
             exit(0);  // Exit after window is closed
         }
@@ -311,36 +592,109 @@ private:
     }
     
     void readLoop() {
-        AVNNotice notice;
-        while(1) {
-            // Read from AVN to Airline pipe
-            close(avn_to_airline[1]); // Close the write end in this process
-            int bytesread = read(avn_to_airline[0], &notice, sizeof(notice));
-            
-            if (bytesread > 0) {
-                // Store the notice
-                avnNotices.push_back(notice);
-                std::string airlineName(notice.AirlineName);
-                noticesByAirline[airlineName].push_back(notice);
-                
-                // Update the notice table if we're viewing this airline
-                // Use string comparison instead of direct comparison to avoid C-string comparison issues
-                if (currentState == DASHBOARD && currentAirline == std::string(notice.AirlineName)) {
-                    updateNoticeTable();
+        bool inputOpen[2] = {notices.isOpen(), stripe_to_airline.pollFd() >= 0};
+        PortalBatch* batch = new PortalBatch();
+        std::vector<struct pollfd> fds;
+        while (true) {
+            if (inputOpen[0] && !drainNotices(*batch)) {
+                inputOpen[0] = false; // every generator shard closed its log
+            }
+            if (inputOpen[1] && !drainConfirmations(*batch)) {
+                inputOpen[1] = false;
+            }
+            // If the UI thread is behind, keep adding to this batch and offer it again shortly
+            if (!batch->empty() && updates.push(batch)) {
+                batch = new PortalBatch();
+            }
+
+            // Sleep until an input has data or the UI thread asks us to stop; only sleep if
+            // nothing arrived between the drain and arming the wakeups
+            fds.clear();
+            fds.push_back({stopFd, POLLIN, 0});
+            bool idle = true;
+            int confirmationsAt = -1;
+            if (inputOpen[1]) {
+                confirmationsAt = static_cast<int>(fds.size());
+                fds.push_back({stripe_to_airline.pollFd(), POLLIN, 0});
+                if (!stripe_to_airline.armWait()) idle = false;
+            }
+            if (inputOpen[0] && !notices.armWait(fds)) idle = false;
+            int timeoutMs = !idle ? 0 : batch->empty() ? -1 : kHandOffRetryMs;
+            if (poll(fds.data(), fds.size(), timeoutMs) < 0) {
+                for (struct pollfd& fd : fds) fd.revents = 0;
+            }
+            if (inputOpen[0]) notices.disarmWait(fds);
+            if (inputOpen[1]) stripe_to_airline.disarmWait(fds[confirmationsAt].revents & POLLIN);
+            if (fds[0].revents & POLLIN) {
+                break;
+            }
+        }
+        delete batch;
+    }
+
+    // Returns false once every log is closed and drained
+    bool drainNotices(PortalBatch& batch) {
+        char frame[IpcChannel::kMaxMessageSize];
+        ssize_t length;
+        while ((length = notices.tryRead(frame, sizeof(frame))) > 0) {
+            AVNNoticeView view;
+            const char* error = nullptr;
+            if (length > static_cast<ssize_t>(sizeof(frame)) || !decode(frame, length, view, &error)) {
+                std::cerr << "Airline Portal: dropped invalid notice frame (" << (error ? error : "oversized") << ")" << std::endl;
+                continue;
+            }
+            traceSpan(TraceStage::LogToPortal, view.trace, view.trace.sentNs, view.trace.traceId ? traceClockNs() : 0);
+            batch.notices.push_back(view.toMessage());
+        }
+        return length < 0;
+    }
+
+    // Returns false once the channel is closed or broken
+    bool drainConfirmations(PortalBatch& batch) {
+        char frame[IpcChannel::kMaxMessageSize];
+        ssize_t length;
+        while ((length = stripe_to_airline.tryRead(frame, sizeof(frame))) > 0) {
+            PaymentConfirmationView confirmation;
+            const char* error = nullptr;
+            if (length > static_cast<ssize_t>(sizeof(frame)) || !decode(frame, length, confirmation, &error)) {
+                std::cerr << "Airline Portal: dropped invalid confirmation frame (" << (error ? error : "oversized") << ")" << std::endl;
+                stripe_to_airline.resync(); // a pipe peer restarted mid-frame
+                continue;
+            }
+            traceSpan(TraceStage::StripeToPortal, confirmation.trace, confirmation.trace.sentNs,
+                      confirmation.trace.traceId ? traceClockNs() : 0);
+            batch.confirmations.push_back(confirmation.toMessage());
+        }
+        return errno == EAGAIN;
+    }
+
+    // UI thread: applies every batch the reader thread has queued and marks the table for
+    // a rebuild if the airline on screen changed
+    void applyUpdates() {
+        PortalBatch* batch;
+        while (updates.pop(batch)) {
+            for (const AVNNotice& notice : batch->notices) {
+                if (notice.AirlineName == currentAirline) tableDirty = true;
+                noticeIndex.add(notice);
+            }
+            for (const PaymentConfirmation& confirmation : batch->confirmations) {
+                PortalNotice* entry = noticeIndex.find(confirmation.avnId);
+                if (!entry) {
+                    // The portal skipped this notice while it was behind
+                    std::cout << "Airline Portal: AVN ID " << confirmation.avnId << " " << confirmation.status
+                              << " (notice not shown)" << std::endl;
+                    continue;
+                }
+                std::cout << "Airline Portal: AVN ID " << confirmation.avnId << " " << confirmation.status << std::endl;
+                entry->status = confirmation.status == "paid" ? NoticeStatus::Paid : NoticeStatus::PaymentFailed;
+                if (entry->status == NoticeStatus::Paid && confirmation.trace.traceId) {
+                    traceSpan(TraceStage::DetectToPaid, confirmation.trace, confirmation.trace.originNs, traceClockNs());
                 }
+                if (entry->notice.AirlineName == currentAirline) tableDirty = true;
             }
-            
-            // // Also check for payment confirmations from Stripe
-            // PaymentConfirmation confirmation;
-            // bytesread = read(stripe_to_airline[0], &confirmation, sizeof(confirmation));
-            
-            // if (bytesread > 0) {
-            //     // Update the status for this AVN ID
-            //     // This would update the display to show the fine has been paid
-            //     std::cout << "Payment confirmation received for AVN ID: " << confirmation.avnId << std::endl;
-            // }
-            
-            // usleep(100000); // Sleep to avoid busy waiting
+            noticesReceived += batch->notices.size();
+            confirmationsReceived += batch->confirmations.size();
+            delete batch;
         }
     }
     
@@ -349,118 +703,6 @@ private:
         return (actualSpeed - allowedSpeed) * 10.0;
     }
     
-    void updateNoticeTable() {
-        try {
-            noticeRows.clear();
-            payButtons.clear();
-            
-            // Filter notices for the current airline
-            if (noticesByAirline.find(currentAirline) != noticesByAirline.end()) {
-                std::vector<AVNNotice>& airlineNotices = noticesByAirline[currentAirline];
-                
-                // Create table rows
-                for (size_t i = 0; i < airlineNotices.size(); i++) {
-                    try {
-                        const AVNNotice& notice = airlineNotices[i];
-                        std::vector<sf::Text> row;
-                        
-                        // Calculate row position with scrolling
-                        float rowY = 120 + i * 30 - scrollOffset;
-                        
-                        // Skip rows outside visible area
-                        if (rowY < 100 || rowY > 700) {
-                            continue;
-                        }
-                        
-                        float cellX = 60;
-                        float columnWidth = 180;
-                        
-                        // AVN ID
-                        sf::Text cell;
-                        cell.setFont(font);
-                        cell.setCharacterSize(16);
-                        cell.setFillColor(sf::Color::White);
-                        cell.setPosition(cellX, rowY);
-                        cell.setString("AVN-" + std::to_string(notice.avnId));
-                        row.push_back(cell);
-                        cellX += columnWidth;
-                        
-                        // Aircraft ID
-                        cell.setPosition(cellX, rowY);
-                        cell.setString(notice.aircraftId[0] != '\0' ? notice.aircraftId : "Unknown");
-                        row.push_back(cell);
-                        cellX += columnWidth;
-                        
-                        // Flight Number
-                        cell.setPosition(cellX, rowY);
-                        cell.setString(notice.flightNumber[0] != '\0' ? notice.flightNumber : "Unknown");
-                        row.push_back(cell);
-                        cellX += columnWidth;
-                        
-                        // Recorded Speed
-                        cell.setPosition(cellX, rowY);
-                        cell.setString(std::to_string(static_cast<int>(notice.recordedSpeed)) + " km/h");
-                        row.push_back(cell);
-                        cellX += columnWidth;
-                        
-                        // Allowed Speed
-                        cell.setPosition(cellX, rowY);
-                        cell.setString(std::to_string(static_cast<int>(notice.allowedSpeed)) + " km/h");
-                        row.push_back(cell);
-                        cellX += columnWidth;
-                        
-                        // Aircraft Type
-                        cell.setPosition(cellX, rowY);
-                        cell.setString(notice.aircraftType[0] != '\0' ? notice.aircraftType : "Unknown");
-                        row.push_back(cell);
-                        cellX += columnWidth;
-                        
-                        // Fine Amount
-                        cell.setPosition(cellX, rowY);
-                        cell.setString("$" + std::to_string(static_cast<int>(notice.totalFine)));
-                        row.push_back(cell);
-                        cellX += columnWidth;
-                        
-                        // Timestamp with day and date
-                        cell.setPosition(cellX, rowY);
-                        char timeStr[50];
-                        time_t safeTime = notice.timestamp > 0 ? notice.timestamp : time(0);
-                        strftime(timeStr, sizeof(timeStr), "%a, %b %d, %Y %H:%M:%S", localtime(&safeTime));
-                        cell.setString(timeStr);
-                        row.push_back(cell);
-                        cellX += columnWidth;
-                        
-                        // Create a Pay button for this row
-                        PayButton payButton;
-                        payButton.avnId = notice.avnId;
-                        payButton.shape.setSize(sf::Vector2f(80, 24));
-                        payButton.shape.setPosition(cellX, rowY - 2);
-                        payButton.shape.setFillColor(sf::Color(50, 150, 50));
-                        payButton.shape.setOutlineColor(sf::Color::White);
-                        payButton.shape.setOutlineThickness(1);
-                        
-                        payButton.text.setFont(font);
-                        payButton.text.setCharacterSize(16);
-                        payButton.text.setFillColor(sf::Color::White);
-                        payButton.text.setPosition(cellX + 25, rowY);
-                        payButton.text.setString("Pay");
-                        
-                        payButtons.push_back(payButton);
-                        
-                        noticeRows.push_back(row);
-                    }
-                    catch (std::exception& e) {
-                        std::cerr << "Error processing notice " << i << ": " << e.what() << std::endl;
-                        continue; // Skip this notice and continue with the next
-                    }
-                }
-            }
-        }
-        catch (std::exception& e) {
-            std::cerr << "Error updating notice table: " << e.what() << std::endl;
-        }
-    }
-
     void addMockDataForTesting() {
         // Create sample AVN notices for each airline
         std::vector<std::string> airlines = {"PIA", "AirBlue", "FedEx", "PAF", "BDart", "AK Amb"};
@@ -469,82 +711,48 @@ private:
             for (int j = 1; j <= 3; j++) {
                 AVNNotice notice;
                 notice.avnId = i * 10 + j;
-                snprintf(notice.aircraftId, sizeof(notice.aircraftId), "%s-%d", airlines[i].c_str(), 100 + j);
-                strncpy(notice.AirlineName, airlines[i].c_str(), sizeof(notice.AirlineName));
-                strncpy(notice.flightNumber, notice.aircraftId, sizeof(notice.flightNumber));
+                notice.aircraftId = airlines[i] + "-" + std::to_string(100 + j);
+                notice.AirlineName = airlines[i];
+                notice.flightNumber = notice.aircraftId;
                 notice.recordedSpeed = 300 + (i * 50) + (j * 20);
                 notice.allowedSpeed = 250 + (i * 30);
                 
                 if (i < 2) {
-                    strcpy(notice.aircraftType, "Commercial");
+                    notice.aircraftType = "Commercial";
                 } else if (i < 4) {
-                    strcpy(notice.aircraftType, "Cargo");
+                    notice.aircraftType = "Cargo";
                 } else {
-                    strcpy(notice.aircraftType, "Emergency");
+                    notice.aircraftType = "Emergency";
                 }
                 
                 notice.totalFine = calculateFine(notice.recordedSpeed, notice.allowedSpeed);
                 notice.timestamp = time(0) - (j * 3600); // Spread out the timestamps
                 
-                // Store in both collections
-                avnNotices.push_back(notice);
-                noticesByAirline[airlines[i]].push_back(notice);
+                noticeIndex.add(notice);
             }
         }
         
-        std::cout << "Added mock data for testing: " << avnNotices.size() << " notices" << std::endl;
+        std::cout << "Added mock data for testing: " << noticeIndex.size() << " notices" << std::endl;
     }
 
     // Handle payment for an AVN notice
-    void processPayment(int avnId) {
-        // Create payment request to send to Stripe
-        PaymentRequest paymentRequest;
-        
+    void processPayment(AvnId avnId) {
         // Find the AVN notice with this ID
-        AVNNotice* targetNotice = nullptr;
-        for (auto& notices : noticesByAirline) {
-            for (auto& notice : notices.second) {
-                if (notice.avnId == avnId) {
-                    targetNotice = &notice;
-                    break;
-                }
-            }
-            if (targetNotice) break;
-        }
-        
-        if (!targetNotice) {
+        PortalNotice* entry = noticeIndex.find(avnId);
+        if (!entry) {
             std::cerr << "Error: Could not find AVN notice with ID " << avnId << std::endl;
             return;
         }
-        
-        // Prepare payment request
-        paymentRequest.avnId = avnId;
-        strncpy(paymentRequest.aircraftType, targetNotice->aircraftType, sizeof(paymentRequest.aircraftType) - 1);
-        paymentRequest.aircraftType[sizeof(paymentRequest.aircraftType) - 1] = '\0';
-        paymentRequest.totalFine = targetNotice->totalFine;
-        
-        // Extract aircraft ID as an integer for the payment system
-        int aircraftIdNum = 0;
-        try {
-            // Try to extract a number from the aircraft ID string
-            std::string idStr = targetNotice->aircraftId;
-            size_t dashPos = idStr.find('-');
-            if (dashPos != std::string::npos && dashPos + 1 < idStr.length()) {
-                aircraftIdNum = std::stoi(idStr.substr(dashPos + 1));
-            } else {
-                aircraftIdNum = std::stoi(idStr);
-            }
-        } catch (std::exception& e) {
-            aircraftIdNum = avnId * 100; // Fallback if parsing fails
+        if (entry->status == NoticeStatus::Paid) {
+            std::cout << "AVN ID " << avnId << " is already paid" << std::endl;
+            return;
         }
-        paymentRequest.aircraftId = aircraftIdNum;
-        
-        // Send the payment request to the Stripe system
-        write(stripe_to_airline[1], &paymentRequest, sizeof(paymentRequest));
         
-        std::cout << "Payment request sent for AVN ID: " << avnId << 
-                     " Aircraft: " << targetNotice->aircraftId << 
-                     " Amount: $" << targetNotice->totalFine << std::endl;
+        // Nothing to send: there is no portal -> Stripe channel (stripe_to_airline is this
+        // process's inbound side). Stripe charges every notice the AVN generator forwards to
+        // it, and its confirmation marks the row paid.
+        std::cout << "AVN ID " << avnId << " (aircraft " << entry->notice.aircraftId << ", $"
+                  << entry->notice.totalFine << ") is settled automatically by Stripe" << std::endl;
         
         // Display a confirmation message to the user
         paymentProcessed = true;
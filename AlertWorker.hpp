@@ -0,0 +1,183 @@
+#pragma once
+#include <deque>
+#include <string>
+#include <iostream>
+#include <ctime>
+#include <cerrno>
+#include <cstring>
+#include <pthread.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+// Where alerts end up. play() runs on the alert worker thread only and may block.
+class AlertSink {
+public:
+    virtual ~AlertSink() {}
+    virtual void play(const std::string& text) = 0;
+};
+
+// Speaks the alert with espeak. Spawned directly (no shell) and reaped before the next
+// alert, so there is never more than one child and never a zombie.
+class EspeakSink : public AlertSink {
+private:
+    bool available;
+
+public:
+    EspeakSink() : available(true) {}
+
+    void play(const std::string& text) override {
+        if (!available) return;
+        char* argv[] = {const_cast<char*>("espeak"), const_cast<char*>(text.c_str()), nullptr};
+        pid_t pid;
+        int error = posix_spawnp(&pid, "espeak", nullptr, nullptr, argv, environ);
+        if (error != 0) {
+            std::cerr << "Alerts: cannot run espeak (" << strerror(error) << "), audio alerts disabled" << std::endl;
+            available = false;
+            return;
+        }
+        while (waitpid(pid, nullptr, 0) < 0 && errno == EINTR) {}
+    }
+};
+
+// Headless runs and tests: alerts are counted, nothing is played
+class NullSink : public AlertSink {
+public:
+    long played = 0;
+    void play(const std::string&) override { played++; }
+};
+
+struct AlertOptions {
+    size_t queueCapacity = 8;  // distinct pending alerts; further ones are dropped
+    int minIntervalMs = 1500;  // at most one alert per interval
+};
+
+// One long-lived thread that plays alerts from a bounded queue. Raising an alert never
+// blocks: an alert whose text is already pending is coalesced into it, a full queue drops
+// it, and the worker spaces alerts at least minIntervalMs apart.
+class AlertWorker {
+private:
+    struct Pending {
+        std::string text;
+        int count;
+    };
+
+    AlertSink* sink;
+    AlertOptions options;
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    std::deque<Pending> queue;
+    bool stopping;
+    bool started;
+    pthread_t workerThread;
+
+    long raisedCount;
+    long coalescedCount;
+    long droppedCount;
+    long playedCount;
+
+    static void* workerThreadFunc(void* arg) {
+        static_cast<AlertWorker*>(arg)->workerLoop();
+        return nullptr;
+    }
+
+    static void deadlineAfter(timespec& deadline, int ms) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += ms / 1000;
+        deadline.tv_nsec += (ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    void workerLoop() {
+        pthread_mutex_lock(&mutex);
+        while (true) {
+            while (queue.empty() && !stopping) {
+                pthread_cond_wait(&changed, &mutex);
+            }
+            if (stopping) break;
+            Pending alert = queue.front();
+            queue.pop_front();
+            pthread_mutex_unlock(&mutex);
+
+            sink->play(alert.text);
+
+            pthread_mutex_lock(&mutex);
+            playedCount++;
+            // Rate limit: anything raised meanwhile waits in the queue and keeps coalescing
+            timespec nextAllowed;
+            deadlineAfter(nextAllowed, options.minIntervalMs);
+            while (!stopping && pthread_cond_timedwait(&changed, &mutex, &nextAllowed) != ETIMEDOUT) {}
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+
+public:
+    AlertWorker(AlertSink* sink, const AlertOptions& options = AlertOptions())
+        : sink(sink), options(options), stopping(false), started(false),
+          raisedCount(0), coalescedCount(0), droppedCount(0), playedCount(0) {
+        pthread_mutex_init(&mutex, NULL);
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&changed, &attr);
+        pthread_condattr_destroy(&attr);
+    }
+
+    ~AlertWorker() {
+        stop();
+        pthread_cond_destroy(&changed);
+        pthread_mutex_destroy(&mutex);
+        delete sink;
+    }
+
+    void start() {
+        if (started) return;
+        stopping = false;
+        started = pthread_create(&workerThread, NULL, workerThreadFunc, this) == 0;
+    }
+
+    // Pending alerts are discarded; an alert that is already playing finishes first
+    void stop() {
+        if (!started) return;
+        pthread_mutex_lock(&mutex);
+        stopping = true;
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&mutex);
+        pthread_join(workerThread, NULL);
+        started = false;
+    }
+
+    void raise(const std::string& text) {
+        pthread_mutex_lock(&mutex);
+        raisedCount++;
+        bool merged = false;
+        for (auto& pending : queue) {
+            if (pending.text == text) {
+                pending.count++;
+                coalescedCount++;
+                merged = true;
+                break;
+            }
+        }
+        if (!merged) {
+            if (queue.size() < options.queueCapacity) {
+                queue.push_back({text, 1});
+                pthread_cond_signal(&changed);
+            } else {
+                droppedCount++;
+            }
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+
+    void printStats(std::ostream& out) {
+        pthread_mutex_lock(&mutex);
+        out << "Alerts: " << raisedCount << " raised, " << playedCount << " played, "
+            << coalescedCount << " coalesced, " << droppedCount << " dropped" << std::endl;
+        pthread_mutex_unlock(&mutex);
+    }
+};
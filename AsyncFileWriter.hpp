@@ -0,0 +1,570 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+// Asynchronous file writes for the processes that persist records (the AVN generator's
+// violation store, StripePay's payment journal), so none of them waits on the disk.
+//
+// A caller submits a chain: writes at explicit offsets, optionally followed by an fsync or
+// fdatasync, run in order and stopped at the first failure. Once the whole chain has
+// finished, its completion runs on a writer thread with the result. Two backends:
+//   IoUring - one ring per writer, driven with the raw system calls. Write data is copied
+//             into buffers registered with the ring (IORING_OP_WRITE_FIXED, so the kernel
+//             does not map and pin the pages on every write) and a chain is submitted as
+//             linked SQEs, so a write and its fdatasync cost one io_uring_enter().
+//   Threads - a pool of threads doing pwrite() and fdatasync(). Used where io_uring is
+//             missing (before 5.6, seccomp, kernel.io_uring_disabled) or when asked for.
+// An ordered chain starts only after every chain submitted before it has finished, so a
+// file written by ordered chains never has a hole that a concurrent reader could see.
+//
+// A writer belongs to one process: start it after the fork.
+enum class AsyncWriterBackend { Auto, IoUring, Threads };
+
+inline const char* asyncWriterBackendName(AsyncWriterBackend backend) {
+    switch (backend) {
+        case AsyncWriterBackend::Auto: return "auto";
+        case AsyncWriterBackend::IoUring: return "io_uring";
+        case AsyncWriterBackend::Threads: return "threads";
+    }
+    return "unknown";
+}
+
+inline bool parseAsyncWriterBackend(const char* name, AsyncWriterBackend& backend) {
+    if (strcmp(name, "auto") == 0) backend = AsyncWriterBackend::Auto;
+    else if (strcmp(name, "uring") == 0) backend = AsyncWriterBackend::IoUring;
+    else if (strcmp(name, "threads") == 0) backend = AsyncWriterBackend::Threads;
+    else return false;
+    return true;
+}
+
+struct AsyncWriterOptions {
+    AsyncWriterBackend backend = AsyncWriterBackend::Auto;
+    unsigned maxInFlight = 64;        // chains submitted and not finished; submit() waits beyond
+    unsigned registeredBuffers = 64;  // io_uring only; 2 MiB, counted against RLIMIT_MEMLOCK
+    size_t bufferBytes = 32 * 1024;   // larger writes are copied to the heap instead
+    int threads = 2;                  // Threads backend
+};
+
+// Used by every writer started without options; main() sets it (--file-io) before the forks
+inline AsyncWriterOptions& asyncWriterDefaults() {
+    static AsyncWriterOptions options;
+    return options;
+}
+
+// The operations of one chain, in order. submit() copies the data, so it only has to stay
+// valid until then.
+class AsyncWriteChain {
+public:
+    void write(int fd, off_t offset, const void* data, size_t length) {
+        if (length > 0) ops.push_back({Op::Write, fd, offset, static_cast<const char*>(data), length});
+    }
+
+    // fdatasync(), or fsync() with dataOnly = false
+    void sync(int fd, bool dataOnly = true) {
+        ops.push_back({dataOnly ? Op::DataSync : Op::Sync, fd, 0, nullptr, 0});
+    }
+
+    bool empty() const { return ops.empty(); }
+    void clear() { ops.clear(); }
+
+private:
+    friend class AsyncFileWriter;
+    struct Op {
+        enum Kind { Write, DataSync, Sync } kind;
+        int fd;
+        off_t offset;
+        const char* data;
+        size_t length;
+    };
+    std::vector<Op> ops;
+};
+
+class AsyncFileWriter {
+public:
+    typedef std::function<void(bool ok)> Completion;
+
+private:
+    struct Request;
+    struct Operation {
+        Request* request;
+        AsyncWriteChain::Op::Kind kind;
+        int fd;
+        off_t offset;
+        const char* data;
+        size_t length;
+        int buffer;                // registered buffer index, -1 if in Request::copy
+    };
+    struct Request {
+        std::vector<Operation> ops;
+        std::string copy;          // data of the writes without a registered buffer
+        Completion done;
+        bool ordered;
+        size_t remaining;          // io_uring completions still to come
+        bool ok;
+    };
+
+    static const unsigned kRingEntries = 256;
+
+    AsyncWriterOptions options;
+    AsyncWriterBackend active;     // IoUring or Threads once started; kept after stop()
+    bool started;
+    bool stopping;
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;        // a chain finished or was queued, or stop() was called
+    unsigned inFlight;
+
+    // IoUring
+    int ringFd;
+    void* sqRing;
+    void* cqRing;
+    size_t sqRingBytes;
+    size_t cqRingBytes;
+    struct io_uring_sqe* sqes;
+    size_t sqeBytes;
+    unsigned* sqTail;
+    unsigned* sqArray;
+    unsigned sqMask;
+    unsigned sqEntries;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    struct io_uring_cqe* cqes;
+    unsigned cqMask;
+    unsigned cqEntries;
+    unsigned opsInFlight;          // kept within the CQ ring
+    char* arena;                   // the registered buffers, bufferBytes each
+    std::vector<int> freeBuffers;
+    pthread_t reaperThread;
+
+    // Threads
+    std::deque<Request*> queue;
+    int running;
+    std::vector<pthread_t> workers;
+
+    long chains;
+    long fixedWrites;
+    long copiedWrites;
+    long syncs;
+    long failures;
+
+    static int ringEnter(int fd, unsigned submit, unsigned minComplete, unsigned flags) {
+        return static_cast<int>(syscall(__NR_io_uring_enter, fd, submit, minComplete, flags, NULL, 0));
+    }
+
+    static void* reaperThreadFunc(void* arg) {
+        static_cast<AsyncFileWriter*>(arg)->reapLoop();
+        return nullptr;
+    }
+
+    static void* workerThreadFunc(void* arg) {
+        static_cast<AsyncFileWriter*>(arg)->workLoop();
+        return nullptr;
+    }
+
+    bool startRing() {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ringFd = static_cast<int>(syscall(__NR_io_uring_setup, kRingEntries, &params));
+        if (ringFd < 0) return false;
+        // IORING_OP_WRITE arrived with IORING_FEAT_RW_CUR_POS (5.6)
+        if (!(params.features & IORING_FEAT_NODROP) || !(params.features & IORING_FEAT_RW_CUR_POS)) {
+            closeRing();
+            return false;
+        }
+        sqRingBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingBytes = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sqRingBytes = cqRingBytes = std::max(sqRingBytes, cqRingBytes);
+        sqRing = mmap(nullptr, sqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+        cqRing = single ? sqRing
+                        : mmap(nullptr, cqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        sqeBytes = params.sq_entries * sizeof(struct io_uring_sqe);
+        void* sqeMemory = mmap(nullptr, sqeBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+        sqes = sqeMemory == MAP_FAILED ? nullptr : static_cast<struct io_uring_sqe*>(sqeMemory);
+        if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || !sqes) {
+            if (sqRing == MAP_FAILED) sqRing = nullptr;
+            if (cqRing == MAP_FAILED) cqRing = nullptr;
+            closeRing();
+            return false;
+        }
+        char* sq = static_cast<char*>(sqRing);
+        char* cq = static_cast<char*>(cqRing);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqEntries = params.sq_entries;
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqEntries = params.cq_entries;
+        opsInFlight = 0;
+
+        // Best effort: without registered buffers every write is copied to the heap
+        size_t arenaBytes = static_cast<size_t>(options.registeredBuffers) * options.bufferBytes;
+        void* memory = arenaBytes > 0 ? mmap(nullptr, arenaBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+                                      : MAP_FAILED;
+        if (memory != MAP_FAILED) {
+            arena = static_cast<char*>(memory);
+            std::vector<struct iovec> buffers(options.registeredBuffers);
+            for (unsigned i = 0; i < options.registeredBuffers; i++) {
+                buffers[i] = {arena + i * options.bufferBytes, options.bufferBytes};
+            }
+            if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, buffers.data(), buffers.size()) == 0) {
+                for (int i = static_cast<int>(options.registeredBuffers) - 1; i >= 0; i--) freeBuffers.push_back(i);
+            } else {
+                std::cerr << "Async writer: cannot register buffers (" << strerror(errno) << "), copying writes instead" << std::endl;
+                munmap(arena, arenaBytes);
+                arena = nullptr;
+            }
+        }
+
+        if (pthread_create(&reaperThread, NULL, reaperThreadFunc, this) != 0) {
+            closeRing();
+            return false;
+        }
+        return true;
+    }
+
+    void closeRing() {
+        if (arena) munmap(arena, static_cast<size_t>(options.registeredBuffers) * options.bufferBytes);
+        if (sqes) munmap(sqes, sqeBytes);
+        if (cqRing && cqRing != sqRing) munmap(cqRing, cqRingBytes);
+        if (sqRing) munmap(sqRing, sqRingBytes);
+        if (ringFd >= 0) close(ringFd);
+        arena = nullptr;
+        sqes = nullptr;
+        sqRing = cqRing = nullptr;
+        ringFd = -1;
+        freeBuffers.clear();
+    }
+
+    // Caller holds mutex. Queues the chain's SQEs, linked, and submits them; a request id of
+    // 0 is the NOP that tells the reaper to exit.
+    void submitToRing(Request* request) {
+        unsigned tail = *sqTail; // only submitters (under mutex) move it
+        size_t count = request ? request->ops.size() : 1;
+        for (size_t i = 0; i < count; i++) {
+            unsigned index = tail & sqMask;
+            struct io_uring_sqe* sqe = &sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+            if (!request) {
+                sqe->opcode = IORING_OP_NOP;
+            } else {
+                Operation& op = request->ops[i];
+                sqe->fd = op.fd;
+                if (op.kind == AsyncWriteChain::Op::Write) {
+                    sqe->opcode = op.buffer >= 0 ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+                    sqe->off = op.offset;
+                    sqe->addr = reinterpret_cast<uintptr_t>(op.data);
+                    sqe->len = static_cast<uint32_t>(op.length);
+                    if (op.buffer >= 0) sqe->buf_index = static_cast<uint16_t>(op.buffer);
+                } else {
+                    sqe->opcode = IORING_OP_FSYNC;
+                    sqe->fsync_flags = op.kind == AsyncWriteChain::Op::DataSync ? IORING_FSYNC_DATASYNC : 0;
+                }
+                if (i + 1 < count) sqe->flags |= IOSQE_IO_LINK;
+                if (i == 0 && request->ordered) sqe->flags |= IOSQE_IO_DRAIN;
+                sqe->user_data = reinterpret_cast<uintptr_t>(&op);
+            }
+            sqArray[index] = index;
+            tail++;
+        }
+        __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+        opsInFlight += static_cast<unsigned>(count);
+
+        unsigned left = static_cast<unsigned>(count);
+        while (left > 0) {
+            int submitted = ringEnter(ringFd, left, 0, 0);
+            if (submitted > 0) {
+                left -= static_cast<unsigned>(submitted);
+            } else if (submitted < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                std::cerr << "Async writer: io_uring_enter failed: " << strerror(errno) << std::endl;
+                break; // the SQEs stay queued and go with the next submission
+            } else if (submitted < 0 && errno != EINTR) {
+                usleep(100); // out of kernel resources or completions; let the reaper catch up
+            }
+        }
+    }
+
+    void reapLoop() {
+        std::vector<Request*> finished;
+        bool exiting = false;
+        while (!exiting) {
+            unsigned head = *cqHead; // only this thread moves it
+            unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            if (head == tail) {
+                if (ringEnter(ringFd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+                    std::cerr << "Async writer: waiting for completions failed: " << strerror(errno) << std::endl;
+                    usleep(1000);
+                }
+                continue;
+            }
+            for (; head != tail; head++) {
+                const struct io_uring_cqe& cqe = cqes[head & cqMask];
+                if (cqe.user_data == 0) {
+                    exiting = true;
+                    continue;
+                }
+                Operation* op = reinterpret_cast<Operation*>(static_cast<uintptr_t>(cqe.user_data));
+                Request* request = op->request;
+                bool shortWrite = op->kind == AsyncWriteChain::Op::Write && cqe.res >= 0 &&
+                                  static_cast<size_t>(cqe.res) != op->length;
+                if (cqe.res < 0 || shortWrite) {
+                    // The rest of a broken chain completes with -ECANCELED
+                    if (request->ok) reportFailure(*op, shortWrite ? ENOSPC : -cqe.res);
+                    request->ok = false;
+                }
+                if (--request->remaining == 0) finished.push_back(request);
+            }
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+            for (Request* request : finished) finish(request);
+            finished.clear();
+        }
+    }
+
+    void workLoop() {
+        pthread_mutex_lock(&mutex);
+        while (true) {
+            if (!queue.empty() && (!queue.front()->ordered || running == 0)) {
+                Request* request = queue.front();
+                queue.pop_front();
+                running++;
+                pthread_mutex_unlock(&mutex);
+                perform(*request);
+                finish(request);
+                pthread_mutex_lock(&mutex);
+                running--;
+                pthread_cond_broadcast(&changed);
+                continue;
+            }
+            if (stopping && queue.empty()) break;
+            pthread_cond_wait(&changed, &mutex);
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+
+    // Runs a chain with plain system calls (Threads backend, or a writer that is not started)
+    void perform(Request& request) {
+        for (Operation& op : request.ops) {
+            int error = 0;
+            if (op.kind == AsyncWriteChain::Op::Write) {
+                size_t written = 0;
+                while (written < op.length) {
+                    ssize_t n = pwrite(op.fd, op.data + written, op.length - written, op.offset + written);
+                    if (n < 0 && errno == EINTR) continue;
+                    if (n <= 0) {
+                        error = n < 0 ? errno : ENOSPC;
+                        break;
+                    }
+                    written += n;
+                }
+            } else if ((op.kind == AsyncWriteChain::Op::DataSync ? fdatasync(op.fd) : fsync(op.fd)) != 0) {
+                error = errno;
+            }
+            if (error != 0) {
+                reportFailure(op, error);
+                request.ok = false;
+                return;
+            }
+        }
+    }
+
+    void reportFailure(const Operation& op, int error) {
+        std::cerr << "Async writer: " << (op.kind == AsyncWriteChain::Op::Write ? "write" : "sync") << " of fd " << op.fd
+                  << " failed: " << strerror(error) << std::endl;
+    }
+
+    // Runs the completion, then frees the chain's buffers and its in-flight slot
+    void finish(Request* request) {
+        if (request->done) request->done(request->ok);
+        pthread_mutex_lock(&mutex);
+        for (const Operation& op : request->ops) {
+            if (op.buffer >= 0) freeBuffers.push_back(op.buffer);
+        }
+        if (started && active == AsyncWriterBackend::IoUring) opsInFlight -= static_cast<unsigned>(request->ops.size());
+        inFlight--;
+        chains++;
+        if (!request->ok) failures++;
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&mutex);
+        delete request;
+    }
+
+public:
+    AsyncFileWriter()
+        : active(AsyncWriterBackend::Auto), started(false), stopping(false), inFlight(0), ringFd(-1),
+          sqRing(nullptr), cqRing(nullptr), sqRingBytes(0), cqRingBytes(0), sqes(nullptr), sqeBytes(0),
+          sqTail(nullptr), sqArray(nullptr), sqMask(0), sqEntries(0), cqHead(nullptr), cqTail(nullptr),
+          cqes(nullptr), cqMask(0), cqEntries(0), opsInFlight(0), arena(nullptr), running(0),
+          chains(0), fixedWrites(0), copiedWrites(0), syncs(0), failures(0) {
+        pthread_mutex_init(&mutex, NULL);
+        pthread_cond_init(&changed, NULL);
+    }
+
+    AsyncFileWriter(const AsyncFileWriter&) = delete;
+    AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+    ~AsyncFileWriter() {
+        stop();
+        pthread_cond_destroy(&changed);
+        pthread_mutex_destroy(&mutex);
+    }
+
+    // io_uring unless options (or asyncWriterDefaults()) ask for threads or it is unavailable
+    bool start(const AsyncWriterOptions& options = asyncWriterDefaults()) {
+        if (started) return true;
+        this->options = options;
+        if (this->options.maxInFlight < 1) this->options.maxInFlight = 1;
+        if (this->options.threads < 1) this->options.threads = 1;
+        if (this->options.bufferBytes < 4096) this->options.bufferBytes = 4096;
+        stopping = false;
+        if (options.backend != AsyncWriterBackend::Threads && startRing()) {
+            active = AsyncWriterBackend::IoUring;
+        } else {
+            if (options.backend == AsyncWriterBackend::IoUring) {
+                std::cerr << "Async writer: io_uring unavailable, using a thread pool" << std::endl;
+            }
+            active = AsyncWriterBackend::Threads;
+            for (int i = 0; i < this->options.threads; i++) {
+                pthread_t thread;
+                if (pthread_create(&thread, NULL, workerThreadFunc, this) == 0) workers.push_back(thread);
+            }
+            if (workers.empty()) {
+                active = AsyncWriterBackend::Auto;
+                return false;
+            }
+        }
+        started = true;
+        return true;
+    }
+
+    // Finishes every submitted chain, then stops the writer's threads
+    void stop() {
+        if (!started) return;
+        drain();
+        pthread_mutex_lock(&mutex);
+        stopping = true;
+        if (active == AsyncWriterBackend::IoUring) submitToRing(nullptr);
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&mutex);
+        if (active == AsyncWriterBackend::IoUring) {
+            pthread_join(reaperThread, NULL);
+            closeRing();
+        } else {
+            for (pthread_t thread : workers) pthread_join(thread, NULL);
+            workers.clear();
+        }
+        started = false;
+    }
+
+    // Queues a chain; waits only while maxInFlight chains are outstanding. done (may be
+    // empty) runs on a writer thread and must not call back into the writer. Without a
+    // started writer the chain runs at once on the caller's thread.
+    bool submit(const AsyncWriteChain& chain, const Completion& done = Completion(), bool ordered = false) {
+        if (chain.empty()) {
+            if (done) done(true);
+            return true;
+        }
+        Request* request = new Request();
+        request->done = done;
+        request->ordered = ordered;
+        request->remaining = chain.ops.size();
+        request->ok = true;
+
+        pthread_mutex_lock(&mutex);
+        if (started && active == AsyncWriterBackend::IoUring && chain.ops.size() > sqEntries) {
+            pthread_mutex_unlock(&mutex);
+            std::cerr << "Async writer: a chain of " << chain.ops.size() << " operations does not fit the ring" << std::endl;
+            delete request;
+            return false;
+        }
+        while (started && (inFlight >= options.maxInFlight ||
+                           (active == AsyncWriterBackend::IoUring && opsInFlight + chain.ops.size() > cqEntries))) {
+            pthread_cond_wait(&changed, &mutex);
+        }
+
+        // Registered buffers first; whatever does not get one is copied to the heap
+        size_t copyBytes = 0;
+        request->ops.reserve(chain.ops.size());
+        for (const AsyncWriteChain::Op& op : chain.ops) {
+            Operation operation = {request, op.kind, op.fd, op.offset, op.data, op.length, -1};
+            if (op.kind == AsyncWriteChain::Op::Write) {
+                if (started && arena && op.length <= options.bufferBytes && !freeBuffers.empty()) {
+                    operation.buffer = freeBuffers.back();
+                    freeBuffers.pop_back();
+                    char* buffer = arena + operation.buffer * options.bufferBytes;
+                    memcpy(buffer, op.data, op.length);
+                    operation.data = buffer;
+                    fixedWrites++;
+                } else {
+                    copyBytes += op.length;
+                    copiedWrites++;
+                }
+            } else {
+                syncs++;
+            }
+            request->ops.push_back(operation);
+        }
+        request->copy.reserve(copyBytes); // so the pointers below stay valid
+        for (size_t i = 0; i < request->ops.size(); i++) {
+            Operation& op = request->ops[i];
+            if (op.kind == AsyncWriteChain::Op::Write && op.buffer < 0) {
+                size_t at = request->copy.size();
+                request->copy.append(chain.ops[i].data, op.length);
+                op.data = request->copy.data() + at;
+            }
+        }
+        inFlight++;
+
+        if (!started) {
+            pthread_mutex_unlock(&mutex);
+            perform(*request);
+            finish(request);
+            return true;
+        }
+        if (active == AsyncWriterBackend::IoUring) {
+            submitToRing(request);
+        } else {
+            queue.push_back(request);
+            pthread_cond_broadcast(&changed);
+        }
+        pthread_mutex_unlock(&mutex);
+        return true;
+    }
+
+    // Waits until every chain submitted so far has finished and run its completion
+    void drain() {
+        pthread_mutex_lock(&mutex);
+        while (inFlight > 0) {
+            pthread_cond_wait(&changed, &mutex);
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+
+    // The backend in use, or last used; "synchronous" if never started
+    const char* backendName() const {
+        return active == AsyncWriterBackend::Auto ? "synchronous" : asyncWriterBackendName(active);
+    }
+
+    void printStats(std::ostream& out, const std::string& name) {
+        pthread_mutex_lock(&mutex);
+        out << name << ": " << chains << " write chains on " << backendName() << " (" << fixedWrites
+            << " writes from registered buffers, " << copiedWrites << " copied, " << syncs << " syncs";
+        if (failures > 0) out << ", " << failures << " failed";
+        out << ")" << std::endl;
+        pthread_mutex_unlock(&mutex);
+    }
+};
@@ -0,0 +1,183 @@
+#pragma once
+#include <atomic>
+#include <new>
+#include <map>
+#include <string>
+#include <iostream>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+
+// AVN IDs are 64-bit: the high 32 bits are the epoch of the run that issued the AVN, the
+// low 32 bits count AVNs within that run, starting at 1. IDs therefore never repeat across
+// runs (violations.txt used to have an "AVN ID: 1" per launch) and sort in issue order.
+typedef uint64_t AvnId;
+
+inline uint32_t avnEpoch(AvnId id) { return static_cast<uint32_t>(id >> 32); }
+inline uint32_t avnSequence(AvnId id) { return static_cast<uint32_t>(id); }
+
+// "epoch-sequence", the form shown in tables ("AVN-" + formatAvnId(id))
+inline std::string formatAvnId(AvnId id) {
+    return std::to_string(avnEpoch(id)) + "-" + std::to_string(avnSequence(id));
+}
+
+// Hands out AVN IDs to every process forked from main(). It lives in a MAP_SHARED anonymous
+// mapping created before the forks, so allocation is a single fetch_add on shared memory.
+//
+// The epoch is the number of seconds since 2024-01-01 UTC when the allocator was created,
+// raised if necessary to one more than the epoch recorded in epochFile by the previous run,
+// so two launches within the same second still get different epochs.
+struct AvnIdAllocator {
+    std::atomic<uint64_t> next;
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "AVN ID counter must be lock-free in shared memory");
+
+    static AvnIdAllocator* create(const char* epochFile = "avn_epoch") {
+        void* memory = mmap(nullptr, sizeof(AvnIdAllocator), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            perror("mmap AVN ID allocator");
+            return nullptr;
+        }
+        AvnIdAllocator* allocator = new (memory) AvnIdAllocator();
+        allocator->next.store((static_cast<uint64_t>(claimEpoch(epochFile)) << 32) | 1);
+        return allocator;
+    }
+
+    static void destroy(AvnIdAllocator* allocator) {
+        if (!allocator) return;
+        allocator->~AvnIdAllocator();
+        munmap(allocator, sizeof(AvnIdAllocator));
+    }
+
+    AvnId allocate() { return next.fetch_add(1, std::memory_order_relaxed); }
+
+    uint32_t epoch() const { return avnEpoch(next.load(std::memory_order_relaxed)); }
+
+private:
+    AvnIdAllocator() : next(0) {}
+
+    static uint32_t claimEpoch(const char* epochFile) {
+        const time_t kEpochBase = 1704067200; // 2024-01-01 00:00:00 UTC
+        uint32_t epoch = static_cast<uint32_t>(time(nullptr) - kEpochBase);
+        int fd = open(epochFile, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            std::cerr << "AVN IDs: cannot open " << epochFile << ", using the clock alone" << std::endl;
+            return epoch;
+        }
+        flock(fd, LOCK_EX);
+        char text[16] = {};
+        ssize_t length = pread(fd, text, sizeof(text) - 1, 0);
+        if (length > 0) {
+            unsigned long previous = strtoul(text, nullptr, 10);
+            if (previous >= epoch) epoch = static_cast<uint32_t>(previous + 1);
+        }
+        int written = snprintf(text, sizeof(text), "%u\n", epoch);
+        if (ftruncate(fd, 0) != 0 || pwrite(fd, text, written, 0) != written) {
+            std::cerr << "AVN IDs: cannot record epoch in " << epochFile << std::endl;
+        }
+        flock(fd, LOCK_UN);
+        close(fd);
+        return epoch;
+    }
+};
+
+// The allocator new AVNs take their IDs from. main() installs the shared one before forking;
+// without one (headless runs, benchmarks) IDs come from a per-process counter with epoch 0.
+inline AvnIdAllocator*& avnIdAllocator() {
+    static AvnIdAllocator* allocator = nullptr;
+    return allocator;
+}
+
+inline AvnId nextAvnId() {
+    if (AvnIdAllocator* allocator = avnIdAllocator()) return allocator->allocate();
+    static std::atomic<uint64_t> local(1);
+    return local.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Set of AVN IDs kept as disjoint [first, last] runs; lookups and inserts are O(log runs).
+// IDs are issued consecutively, so a process that sees every ID (Stripe) stays at a handful
+// of runs. A generator shard sees only its airlines' IDs, so nearly every ID it keeps is a
+// run of its own; it prunes with a low-water mark instead: every ID below the mark counts as
+// a member and the runs there are dropped.
+class AvnIdSet {
+private:
+    std::map<AvnId, AvnId> runs; // first -> last, inclusive
+    size_t count;                // inserted, including those pruned since
+    AvnId lowWater;              // every ID below it is a member
+
+public:
+    AvnIdSet() : count(0), lowWater(0) {}
+
+    bool contains(AvnId id) const {
+        if (id < lowWater) return true;
+        auto after = runs.upper_bound(id);
+        if (after == runs.begin()) return false;
+        --after;
+        return id <= after->second;
+    }
+
+    // Returns false if the ID was already in the set
+    bool insert(AvnId id) {
+        if (id < lowWater) return false;
+        auto after = runs.upper_bound(id);
+        auto before = after;
+        if (before != runs.begin()) {
+            --before;
+            if (id <= before->second) return false;
+        } else {
+            before = runs.end();
+        }
+        bool joinsBefore = before != runs.end() && before->second + 1 == id;
+        bool joinsAfter = after != runs.end() && after->first == id + 1;
+        if (joinsBefore && joinsAfter) {
+            before->second = after->second;
+            runs.erase(after);
+        } else if (joinsBefore) {
+            before->second = id;
+        } else if (joinsAfter) {
+            AvnId last = after->second;
+            runs.erase(after);
+            runs.emplace(id, last);
+        } else {
+            runs.emplace(id, id);
+        }
+        count++;
+        return true;
+    }
+
+    // Returns false if the ID was not in the set, or is below the low-water mark
+    bool erase(AvnId id) {
+        if (id < lowWater) return false;
+        auto run = runs.upper_bound(id);
+        if (run == runs.begin()) return false;
+        --run;
+        if (id > run->second) return false;
+        AvnId first = run->first, last = run->second;
+        runs.erase(run);
+        if (first < id) runs.emplace(first, id - 1);
+        if (id < last) runs.emplace(id + 1, last);
+        count--;
+        return true;
+    }
+
+    // Makes every ID below mark a member and forgets the runs there. For a consumer whose
+    // IDs arrive in ascending order, so nothing below the mark can still come in new.
+    void pruneBelow(AvnId mark) {
+        if (mark <= lowWater) return;
+        lowWater = mark;
+        while (!runs.empty() && runs.begin()->second < mark) runs.erase(runs.begin());
+        if (!runs.empty() && runs.begin()->first < mark) {
+            AvnId last = runs.begin()->second;
+            runs.erase(runs.begin());
+            runs.emplace(mark, last);
+        }
+    }
+
+    size_t size() const { return count; }
+    size_t runCount() const { return runs.size(); }
+};
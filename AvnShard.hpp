@@ -0,0 +1,30 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// With --avn-shards N there are N AVN generator processes, each with its own inbound
+// channel, broadcast log and violation store. Violations are routed by airline, so all of
+// one airline's AVNs go through the same shard, in order. The hash (32-bit FNV-1a) must not
+// change between runs or processes: it also decides which store holds an airline's history.
+const int kMaxAvnShards = 8;
+
+inline uint32_t fnv1a(const char* data, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+inline int avnShardFor(const std::string& airline, int shards) {
+    if (shards <= 1) return 0;
+    return static_cast<int>(fnv1a(airline.data(), airline.size()) % static_cast<uint32_t>(shards));
+}
+
+// "AVN Generator", or "AVN Generator 2/4" when sharded; prefixes the shard's log lines
+inline std::string avnShardName(int shard, int shards) {
+    if (shards <= 1) return "AVN Generator";
+    return "AVN Generator " + std::to_string(shard + 1) + "/" + std::to_string(shards);
+}
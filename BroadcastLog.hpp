@@ -0,0 +1,456 @@
+#pragma once
+#include <atomic>
+#include <new>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+#include "ShmRing.hpp"
+#include "Heartbeat.hpp"
+
+// Single-writer, multi-reader append-only log in shared memory. The writer appends each
+// record once; every reader has its own cursor and reads at its own pace. The log keeps the
+// last `retention` records (slotCount); older slots are reused.
+//
+// Readers are registered in main() before the forks, like the IpcChannels. A reader is
+// either
+//   Reliable - the writer never overwrites a record it has not read. If it holds the writer
+//              up for slowConsumerMs it is logged as a slow consumer; the writer keeps waiting.
+//   Lossy    - never holds the writer up. Once it falls `retention` records behind, the
+//              writer overwrites records it has not read, logs it as a slow consumer and
+//              marks it lagging until it catches up; the skipped records count in lost().
+//
+// Each slot carries the sequence number of the record in it, written last, so a lossy
+// reader that is lapped while copying notices it and retries instead of returning a torn
+// record.
+struct BroadcastLog {
+    static const size_t kCacheLine = 64;
+    static const int kMaxReaders = 8;
+
+    enum ReaderState : uint32_t { ReaderFree = 0, ReaderActive = 1, ReaderLagging = 2 };
+
+    struct Reader {
+        alignas(kCacheLine) std::atomic<uint64_t> cursor; // next sequence to read, reader-owned
+        std::atomic<uint32_t> state;
+        std::atomic<uint32_t> waiting;
+        std::atomic<uint64_t> lost;
+        bool reliable;
+        int wakeFd;
+        char name[24];
+    };
+
+    alignas(kCacheLine) std::atomic<uint64_t> tail;   // next sequence to write, writer-owned
+    alignas(kCacheLine) std::atomic<uint32_t> writerWaiting;
+    std::atomic<uint32_t> closed;
+    std::atomic<uint64_t> lapped;   // times a lossy reader was overtaken by the writer
+    std::atomic<uint64_t> oversized; // records skipped for exceeding slotSize
+    uint32_t slotSize;
+    uint32_t slotCount;   // power of two
+    uint32_t slotStride;  // sequence + length + payload, cache-line aligned
+    int slowConsumerMs;
+    int spaceFd;          // eventfd the writer sleeps on while a reader holds it back
+    size_t mappedBytes;
+    Reader readers[kMaxReaders];
+
+    static size_t headerBytes() {
+        return (sizeof(BroadcastLog) + kCacheLine - 1) & ~(kCacheLine - 1);
+    }
+
+    static BroadcastLog* create(uint32_t slotSize, uint32_t retention, int slowConsumerMs) {
+        uint32_t count = 1;
+        while (count < retention) count <<= 1;
+        uint32_t stride = (sizeof(uint64_t) + sizeof(uint32_t) + slotSize + kCacheLine - 1) & ~(kCacheLine - 1);
+        size_t bytes = headerBytes() + static_cast<size_t>(stride) * count;
+
+        void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            return nullptr;
+        }
+        BroadcastLog* log = new (memory) BroadcastLog();
+        log->tail = 0;
+        log->writerWaiting = 0;
+        log->closed = 0;
+        log->lapped = 0;
+        log->oversized = 0;
+        log->slotSize = slotSize;
+        log->slotCount = count;
+        log->slotStride = stride;
+        log->slowConsumerMs = slowConsumerMs;
+        log->mappedBytes = bytes;
+        for (int i = 0; i < kMaxReaders; i++) {
+            log->readers[i].cursor = 0;
+            log->readers[i].state = ReaderFree;
+            log->readers[i].waiting = 0;
+            log->readers[i].lost = 0;
+            log->readers[i].reliable = false;
+            log->readers[i].wakeFd = -1;
+            log->readers[i].name[0] = '\0';
+        }
+        log->spaceFd = eventfd(0, EFD_CLOEXEC);
+        if (log->spaceFd < 0) {
+            destroy(log);
+            return nullptr;
+        }
+        return log;
+    }
+
+    static void destroy(BroadcastLog* log) {
+        if (!log) return;
+        for (int i = 0; i < kMaxReaders; i++) {
+            if (log->readers[i].wakeFd >= 0) ::close(log->readers[i].wakeFd);
+        }
+        if (log->spaceFd >= 0) ::close(log->spaceFd);
+        munmap(log, log->mappedBytes);
+    }
+
+    // Before the forks only. Returns the reader index, or -1 if all reader slots are taken.
+    int addReader(const char* name, bool reliable) {
+        for (int i = 0; i < kMaxReaders; i++) {
+            Reader& r = readers[i];
+            if (r.state.load() != ReaderFree) continue;
+            r.wakeFd = eventfd(0, EFD_CLOEXEC);
+            if (r.wakeFd < 0) return -1;
+            strncpy(r.name, name, sizeof(r.name) - 1);
+            r.name[sizeof(r.name) - 1] = '\0';
+            r.reliable = reliable;
+            r.cursor = tail.load();
+            r.state = ReaderActive;
+            return i;
+        }
+        return -1;
+    }
+
+    // Writer side. Appends one record per iovec and returns how many were appended. A record
+    // longer than slotSize is skipped and counted in oversized; the rest of the batch is
+    // still appended.
+    ssize_t append(const struct iovec* records, int count) {
+        uint64_t t = tail.load(std::memory_order_relaxed);
+        int next = 0;
+        int written = 0;
+        long long stalledUntilMs = 0; // slow-consumer deadline of the current stall, 0 = not stalled
+        while (next < count) {
+            if (records[next].iov_len > slotSize) {
+                oversized.fetch_add(1, std::memory_order_relaxed);
+                next++;
+                continue;
+            }
+            if (!roomFor(t)) {
+                publish(t);
+                waitForRoom(t, stalledUntilMs);
+                continue;
+            }
+            stalledUntilMs = 0;
+            overtakeLossyReaders(t);
+            char* s = slot(t);
+            std::atomic<uint64_t>* sequence = reinterpret_cast<std::atomic<uint64_t>*>(s);
+            sequence->store(0, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            uint32_t length = static_cast<uint32_t>(records[next].iov_len);
+            memcpy(s + sizeof(uint64_t), &length, sizeof(length));
+            memcpy(s + sizeof(uint64_t) + sizeof(length), records[next].iov_base, length);
+            sequence->store(t + 1, std::memory_order_release);
+            t++;
+            next++;
+            written++;
+        }
+        publish(t);
+        return written;
+    }
+
+    // Writer side: no more records. Readers drain what is left, then read() returns 0.
+    void close() {
+        closed.store(1, std::memory_order_seq_cst);
+        for (int i = 0; i < kMaxReaders; i++) {
+            if (readers[i].state.load() != ReaderFree) ShmRing::signal(readers[i].wakeFd);
+        }
+    }
+
+    // Reader side. Copies the next record into buffer (truncated to capacity) and returns
+    // its full length; 0 once the writer has closed and everything is read; -1 with EAGAIN
+    // if nothing is pending and wait is false.
+    ssize_t read(int index, void* buffer, size_t capacity, bool wait) {
+        Reader& r = readers[index];
+        uint64_t c = r.cursor.load(std::memory_order_relaxed);
+        while (true) {
+            uint64_t t = tail.load(std::memory_order_acquire);
+            if (c == t) {
+                if (closed.load(std::memory_order_acquire)) return 0;
+                if (!wait) {
+                    errno = EAGAIN;
+                    return -1;
+                }
+                r.waiting.store(1, std::memory_order_seq_cst);
+                if (tail.load(std::memory_order_seq_cst) == c && !closed.load()) {
+                    ShmRing::sleepOn(r.wakeFd);
+                }
+                r.waiting.store(0, std::memory_order_relaxed);
+                continue;
+            }
+            if (t - c > slotCount) {
+                // Lapped: the oldest records this reader had not seen are gone
+                r.lost.fetch_add(t - slotCount - c, std::memory_order_relaxed);
+                c = t - slotCount;
+            }
+            const char* s = slot(c);
+            const std::atomic<uint64_t>* sequence = reinterpret_cast<const std::atomic<uint64_t>*>(s);
+            uint64_t before = sequence->load(std::memory_order_acquire);
+            uint32_t length = 0;
+            if (before == c + 1) {
+                memcpy(&length, s + sizeof(uint64_t), sizeof(length));
+                if (length > slotSize) length = slotSize;
+                memcpy(buffer, s + sizeof(uint64_t) + sizeof(length), length < capacity ? length : capacity);
+                std::atomic_thread_fence(std::memory_order_acquire);
+            }
+            if (before != c + 1 || sequence->load(std::memory_order_relaxed) != before) {
+                // Overwritten under us
+                r.lost.fetch_add(1, std::memory_order_relaxed);
+                c++;
+                continue;
+            }
+            c++;
+            r.cursor.store(c, std::memory_order_seq_cst);
+            if (c == t && r.state.load(std::memory_order_relaxed) == ReaderLagging) {
+                uint32_t lagging = ReaderLagging;
+                r.state.compare_exchange_strong(lagging, ReaderActive);
+            }
+            if (writerWaiting.load(std::memory_order_seq_cst)) {
+                ShmRing::signal(spaceFd);
+            }
+            return length;
+        }
+    }
+
+    // Reader side, for poll()/epoll over several inputs: bracket the wait on the reader's
+    // wakeFd, which becomes readable once a record is appended or the log closes. armWait()
+    // returns false if a record is already pending, in which case the caller should not sleep.
+    bool armWait(int index) {
+        Reader& r = readers[index];
+        r.waiting.store(1, std::memory_order_seq_cst);
+        if (tail.load(std::memory_order_seq_cst) != r.cursor.load(std::memory_order_relaxed) || closed.load()) {
+            r.waiting.store(0, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    void disarmWait(int index, bool woken) {
+        readers[index].waiting.store(0, std::memory_order_relaxed);
+        if (woken) {
+            ShmRing::sleepOn(readers[index].wakeFd);
+        }
+    }
+
+    // Records written but not yet read by this reader
+    uint64_t backlog(int index) const {
+        return tail.load(std::memory_order_acquire) - readers[index].cursor.load(std::memory_order_acquire);
+    }
+
+    void printStats(std::ostream& out) const {
+        out << "Broadcast log: " << tail.load() << " records, retention " << slotCount
+            << ", lossy readers lapped " << lapped.load() << " times, " << oversized.load()
+            << " oversized records skipped" << std::endl;
+        for (int i = 0; i < kMaxReaders; i++) {
+            const Reader& r = readers[i];
+            if (r.state.load() == ReaderFree) continue;
+            out << "  " << r.name << ": backlog " << backlog(i) << ", lost " << r.lost.load()
+                << (r.state.load() == ReaderLagging ? " (lagging)" : "") << std::endl;
+        }
+    }
+
+private:
+    char* slot(uint64_t sequence) {
+        return reinterpret_cast<char*>(this) + headerBytes() + static_cast<size_t>(sequence & (slotCount - 1)) * slotStride;
+    }
+
+    // Whether writing sequence t would overwrite a record a reliable reader still needs
+    bool roomFor(uint64_t t) {
+        for (int i = 0; i < kMaxReaders; i++) {
+            const Reader& r = readers[i];
+            if (!r.reliable || r.state.load(std::memory_order_acquire) == ReaderFree) continue;
+            if (t - r.cursor.load(std::memory_order_acquire) >= slotCount) return false;
+        }
+        return true;
+    }
+
+    // Writing sequence t is about to destroy record t - slotCount
+    void overtakeLossyReaders(uint64_t t) {
+        if (t < slotCount) return;
+        for (int i = 0; i < kMaxReaders; i++) {
+            Reader& r = readers[i];
+            if (r.reliable || r.state.load(std::memory_order_relaxed) != ReaderActive) continue;
+            uint64_t cursor = r.cursor.load(std::memory_order_acquire);
+            if (t - cursor < slotCount) continue;
+            uint32_t active = ReaderActive;
+            if (r.state.compare_exchange_strong(active, ReaderLagging)) {
+                lapped++;
+                std::cerr << "Broadcast log: slow consumer '" << r.name << "' is " << (t - cursor)
+                          << " records behind, overwriting records it has not read" << std::endl;
+            }
+        }
+    }
+
+    static long long monotonicMs() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+    }
+
+    // A reader that keeps trickling forward still counts as slow: the budget covers the
+    // whole stall, not each wakeup
+    void waitForRoom(uint64_t t, long long& stalledUntilMs) {
+        heartbeat(); // waiting on a reader, not stuck
+        long long now = monotonicMs();
+        if (stalledUntilMs == 0) {
+            stalledUntilMs = now + slowConsumerMs;
+        }
+        if (now >= stalledUntilMs) {
+            warnSlowConsumers(t);
+            stalledUntilMs = now + slowConsumerMs;
+            return;
+        }
+        writerWaiting.store(1, std::memory_order_seq_cst);
+        if (!roomFor(t)) {
+            struct pollfd waitFd = {spaceFd, POLLIN, 0};
+            if (poll(&waitFd, 1, static_cast<int>(stalledUntilMs - now)) > 0) {
+                ShmRing::sleepOn(spaceFd);
+            }
+        }
+        writerWaiting.store(0, std::memory_order_relaxed);
+    }
+
+    void warnSlowConsumers(uint64_t t) {
+        for (int i = 0; i < kMaxReaders; i++) {
+            Reader& r = readers[i];
+            if (!r.reliable || r.state.load() == ReaderFree || t - r.cursor.load() < slotCount) continue;
+            std::cerr << "Broadcast log: slow consumer '" << r.name << "' has held the writer for "
+                      << slowConsumerMs << " ms, still waiting" << std::endl;
+        }
+    }
+
+    void publish(uint64_t t) {
+        if (t == tail.load(std::memory_order_relaxed)) return;
+        tail.store(t, std::memory_order_seq_cst);
+        for (int i = 0; i < kMaxReaders; i++) {
+            Reader& r = readers[i];
+            if (r.state.load(std::memory_order_relaxed) != ReaderFree && r.waiting.load(std::memory_order_seq_cst)) {
+                ShmRing::signal(r.wakeFd);
+            }
+        }
+    }
+};
+
+// One consumer's view of a BroadcastLog: the log plus the reader registered for it.
+// Copied into the consumer process by value, like an IpcChannel.
+class BroadcastCursor {
+private:
+    BroadcastLog* log;
+    int reader;
+
+public:
+    BroadcastCursor() : log(nullptr), reader(-1) {}
+    BroadcastCursor(BroadcastLog* log, int reader) : log(log), reader(reader) {}
+
+    bool isOpen() const { return log != nullptr && reader >= 0; }
+
+    // Blocking read of the next record; 0 once the log is closed and drained
+    ssize_t read(void* buffer, size_t capacity) {
+        if (!isOpen()) return 0;
+        return log->read(reader, buffer, capacity, true);
+    }
+
+    ssize_t tryRead(void* buffer, size_t capacity) {
+        if (!isOpen()) return 0;
+        return log->read(reader, buffer, capacity, false);
+    }
+
+    // Same contract as IpcChannel::pollFd()/armWait()/disarmWait()
+    int pollFd() const { return isOpen() ? log->readers[reader].wakeFd : -1; }
+    bool armWait() { return !isOpen() || log->armWait(reader); }
+    void disarmWait(bool woken) {
+        if (isOpen()) log->disarmWait(reader, woken);
+    }
+
+    uint64_t lost() const { return isOpen() ? log->readers[reader].lost.load() : 0; }
+    uint64_t backlog() const { return isOpen() ? log->backlog(reader) : 0; }
+};
+
+// Reads several broadcast logs as one stream, for consumers of the sharded AVN generator
+// (one log per shard, AvnShard.hpp). Records of one log keep their order; logs are taken
+// in turn, one record at a time, so a busy shard cannot starve the others.
+class BroadcastMerge {
+private:
+    std::vector<BroadcastCursor> cursors;
+    std::vector<bool> open;
+    std::vector<size_t> armed; // cursors given a pollfd by the last armWait()
+    size_t next;
+
+public:
+    BroadcastMerge() : next(0) {}
+    explicit BroadcastMerge(const std::vector<BroadcastCursor>& cursors) : cursors(cursors), next(0) {
+        for (const BroadcastCursor& cursor : cursors) open.push_back(cursor.isOpen());
+    }
+
+    // False once every log is closed and drained
+    bool isOpen() const {
+        for (bool o : open) {
+            if (o) return true;
+        }
+        return false;
+    }
+
+    // Copies the next record from any log, as BroadcastLog::read(); source is set to the
+    // index of the log it came from. 0 once every log is closed and drained.
+    ssize_t tryRead(void* buffer, size_t capacity, int* source = nullptr) {
+        for (size_t tried = 0; tried < cursors.size(); tried++) {
+            size_t i = next;
+            next = (next + 1) % cursors.size();
+            if (!open[i]) continue;
+            ssize_t length = cursors[i].tryRead(buffer, capacity);
+            if (length > 0) {
+                if (source) *source = static_cast<int>(i);
+                return length;
+            }
+            if (length == 0) open[i] = false;
+        }
+        if (!isOpen()) return 0;
+        errno = EAGAIN;
+        return -1;
+    }
+
+    // Same contract as BroadcastCursor::armWait(), for all logs at once: appends one pollfd
+    // per open log to fds and returns false if one of them already has a record pending.
+    // Call disarmWait() with the same fds after polling, whatever armWait() returned.
+    bool armWait(std::vector<struct pollfd>& fds) {
+        armed.clear();
+        bool idle = true;
+        for (size_t i = 0; i < cursors.size(); i++) {
+            if (!open[i]) continue;
+            armed.push_back(fds.size());
+            fds.push_back({cursors[i].pollFd(), POLLIN, 0});
+            if (idle && !cursors[i].armWait()) idle = false;
+        }
+        return idle;
+    }
+
+    void disarmWait(const std::vector<struct pollfd>& fds) {
+        size_t k = 0;
+        for (size_t i = 0; i < cursors.size() && k < armed.size(); i++) {
+            if (!open[i]) continue;
+            cursors[i].disarmWait(fds[armed[k++]].revents & POLLIN);
+        }
+    }
+
+    uint64_t lost() const {
+        uint64_t total = 0;
+        for (const BroadcastCursor& cursor : cursors) total += cursor.lost();
+        return total;
+    }
+};
@@ -3,10 +3,12 @@
 #include "enums.hpp"
 #include "Airline.hpp"
 #include <cstdlib> 
+#include <atomic>
 #include <SFML/Graphics.hpp>
+#include "SimContext.hpp"
 
 class Flight{
-    static int nextId;
+    static std::atomic<int> nextId;
 public:
     int id;
     std::string flightNumber;
@@ -30,7 +32,7 @@ public:
         type = airline->type;
         priority = calculatePriority();
         hasActiveAVN = false;
-        scheduleTime = time(nullptr);
+        scheduleTime = simTime();
         
         
         if (direction == Direction::north || direction == Direction::south) {
@@ -43,7 +45,7 @@ public:
 
             state = AirCraftState::holding;
 
-            speed = 400 + (rand() % 201); // Random speed between 400 and 600
+            speed = 400 + (simRand() % 201); // Random speed between 400 and 600
         } 
         else if (direction == Direction::east || direction == Direction::west) {
             if (type == AirCraftType::cargo || type == AirCraftType::emergency) {
@@ -210,16 +212,16 @@ public:
 
     void updateState() {
         // Add a small chance (5%) of speed violation for demonstration purposes
-        bool createViolation = (rand() % 100 < 5);
+        bool createViolation = (simRand() % 100 < 5);
 
         switch (state) {
             case AirCraftState::holding:
                 state = AirCraftState::approach;
                 if (createViolation) {
                     // Deliberately create a speed violation by exceeding 290 km/h for approach
-                    speed = 300 + (std::rand() % 50); // 300-350 km/h (over limit)
+                    speed = 300 + (simRand() % 50); // 300-350 km/h (over limit)
                 } else {
-                    speed = 240 + (std::rand() % 51); // 240-290 km/h (normal)
+                    speed = 240 + (simRand() % 51); // 240-290 km/h (normal)
                 }
                 break;
                 
@@ -227,7 +229,7 @@ public:
                 state = AirCraftState::landing;
                 if (createViolation) {
                     // Create a landing speed violation (over 240 km/h)
-                    speed = 250 + (std::rand() % 30); // 250-280 km/h (over limit)
+                    speed = 250 + (simRand() % 30); // 250-280 km/h (over limit)
                 } else {
                     speed = 240; // Normal landing speed
                 }
@@ -251,7 +253,7 @@ public:
             case AirCraftState::at_gate:
                 if (direction == Direction::east || direction == Direction::west) {
                     state = AirCraftState::taxi;
-                    speed = createViolation ? 35 : (15 + (std::rand() % 16)); // Possibly violate taxi speed
+                    speed = createViolation ? 35 : (15 + (simRand() % 16)); // Possibly violate taxi speed
                 }
                 break;
                 
@@ -259,9 +261,9 @@ public:
                 state = AirCraftState::climb;
                 if (createViolation) {
                     // Create a climb speed violation (over 463 km/h)
-                    speed = 470 + (std::rand() % 50); // 470-520 km/h (over limit)
+                    speed = 470 + (simRand() % 50); // 470-520 km/h (over limit)
                 } else {
-                    speed = 250 + (std::rand() % 214); // 250-463 km/h (normal)
+                    speed = 250 + (simRand() % 214); // 250-463 km/h (normal)
                 }
                 break;
                 
@@ -269,13 +271,13 @@ public:
                 state = AirCraftState::departure;
                 if (createViolation) {
                     // Create a departure speed violation (outside 800-900 km/h)
-                    if (rand() % 2 == 0) {
-                        speed = 750 + (std::rand() % 50); // 750-799 km/h (under limit)
+                    if (simRand() % 2 == 0) {
+                        speed = 750 + (simRand() % 50); // 750-799 km/h (under limit)
                     } else {
-                        speed = 901 + (std::rand() % 50); // 901-950 km/h (over limit)
+                        speed = 901 + (simRand() % 50); // 901-950 km/h (over limit)
                     }
                 } else {
-                    speed = 800 + (std::rand() % 101); // 800-900 km/h (normal)
+                    speed = 800 + (simRand() % 101); // 800-900 km/h (normal)
                 }
                 break;
                 
@@ -288,8 +290,10 @@ public:
         altitude = getAltitude();
         
         // Log state changes (without emojis)
-        std::cout << "State change for " << flightNumber << ": " << getStateString() 
-                  << ", Speed: " << speed << ", Altitude: " << altitude << " ft\n";
+        if (simLogging()) {
+            std::cout << "State change for " << flightNumber << ": " << getStateString() 
+                      << ", Speed: " << speed << ", Altitude: " << altitude << " ft\n";
+        }
     }
 
     bool isArrival() {
@@ -306,41 +310,11 @@ public:
     }
 
     std::string getStateString() const {
-        switch (state) {
-            case AirCraftState::holding:
-                return "Holding";
-            case AirCraftState::approach:
-                return "Approach";
-            case AirCraftState::landing:
-                return "Landing";
-            case AirCraftState::taxi:
-                return "Taxi";
-            case AirCraftState::at_gate:
-                return "At Gate";
-            case AirCraftState::takeoff_roll:
-                return "Takeoff Roll";
-            case AirCraftState::climb:
-                return "Climb";
-            case AirCraftState::departure:
-                return "Departure";
-            default:
-                return "Unknown State";
-        }
+        return stateName(state);
     }
 
     std::string getDirectionString() const {
-        switch (direction) {
-            case Direction::north:
-                return "North";
-            case Direction::south:
-                return "South";
-            case Direction::east:
-                return "East";
-            case Direction::west:
-                return "West";
-            default:
-                return "Unknown Direction";
-        }
+        return directionName(direction);
     }
 
     std::string getRunwayString() const {
@@ -357,16 +331,7 @@ public:
     }
 
     std::string getTypeString() const {
-        switch (type) {
-            case AirCraftType::commercial:
-                return "Commercial";
-            case AirCraftType::cargo:
-                return "Cargo";
-            case AirCraftType::emergency:
-                return "Emergency";
-            default:
-                return "Unknown Type";
-        }
+        return typeName(type);
     }
 
     std::string getFlightTypeString() const {
@@ -408,6 +373,58 @@ public:
         }
     }
 
+    // Name lookups shared with code that only keeps the enums (e.g. the flight history log)
+    static const char* stateName(AirCraftState state) {
+        switch (state) {
+            case AirCraftState::holding:
+                return "Holding";
+            case AirCraftState::approach:
+                return "Approach";
+            case AirCraftState::landing:
+                return "Landing";
+            case AirCraftState::taxi:
+                return "Taxi";
+            case AirCraftState::at_gate:
+                return "At Gate";
+            case AirCraftState::takeoff_roll:
+                return "Takeoff Roll";
+            case AirCraftState::climb:
+                return "Climb";
+            case AirCraftState::departure:
+                return "Departure";
+            default:
+                return "Unknown State";
+        }
+    }
+
+    static const char* directionName(Direction direction) {
+        switch (direction) {
+            case Direction::north:
+                return "North";
+            case Direction::south:
+                return "South";
+            case Direction::east:
+                return "East";
+            case Direction::west:
+                return "West";
+            default:
+                return "Unknown Direction";
+        }
+    }
+
+    static const char* typeName(AirCraftType type) {
+        switch (type) {
+            case AirCraftType::commercial:
+                return "Commercial";
+            case AirCraftType::cargo:
+                return "Cargo";
+            case AirCraftType::emergency:
+                return "Emergency";
+            default:
+                return "Unknown Type";
+        }
+    }
+
 };
 
-int Flight::nextId = 1;
\ No newline at end of file
+std::atomic<int> Flight::nextId(1);
\ No newline at end of file
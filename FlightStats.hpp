@@ -0,0 +1,226 @@
+#pragma once
+#include <map>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <ctime>
+#include "Flight.hpp"
+
+// Wait-time histogram with 1 second buckets. Waits of kBuckets-1 seconds or more share the last bucket.
+struct WaitHistogram {
+    static const int kBuckets = 900;
+
+    uint64_t count = 0;
+    double sum = 0;
+    int minWait = 0;
+    int maxWait = 0;
+    std::vector<uint32_t> buckets;
+
+    WaitHistogram() : buckets(kBuckets, 0) {}
+
+    void add(int waitSeconds) {
+        if (waitSeconds < 0) waitSeconds = 0;
+        if (count == 0 || waitSeconds < minWait) minWait = waitSeconds;
+        if (count == 0 || waitSeconds > maxWait) maxWait = waitSeconds;
+        count++;
+        sum += waitSeconds;
+        buckets[waitSeconds < kBuckets ? waitSeconds : kBuckets - 1]++;
+    }
+
+    void merge(const WaitHistogram& other) {
+        if (other.count == 0) return;
+        if (count == 0 || other.minWait < minWait) minWait = other.minWait;
+        if (count == 0 || other.maxWait > maxWait) maxWait = other.maxWait;
+        count += other.count;
+        sum += other.sum;
+        for (int i = 0; i < kBuckets; i++) {
+            buckets[i] += other.buckets[i];
+        }
+    }
+
+    double mean() const {
+        return count > 0 ? sum / count : 0.0;
+    }
+
+    // Smallest wait w such that at least p (0..1) of the samples waited <= w
+    int percentile(double p) const {
+        if (count == 0) return 0;
+        uint64_t target = static_cast<uint64_t>(p * count + 0.999999);
+        if (target == 0) target = 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < kBuckets; i++) {
+            seen += buckets[i];
+            if (seen >= target) return i;
+        }
+        return kBuckets - 1;
+    }
+
+    // Fraction of samples that waited strictly longer than the given number of seconds
+    double fractionAbove(int waitSeconds) const {
+        if (count == 0) return 0.0;
+        if (waitSeconds < 0) return 1.0;
+        if (waitSeconds >= kBuckets - 1) return 0.0;
+        uint64_t above = 0;
+        for (int i = waitSeconds + 1; i < kBuckets; i++) {
+            above += buckets[i];
+        }
+        return static_cast<double>(above) / count;
+    }
+};
+
+// Online aggregation of completed flights, updated once per flight at completion time
+struct FlightStats {
+    uint64_t completedFlights = 0;
+    uint64_t emergencyFlights = 0;
+    uint64_t flightsWithAVN = 0;
+    WaitHistogram overall;
+    WaitHistogram emergencies;               // flights that were declared emergencies
+    std::map<int, WaitHistogram> byPriority; // only a handful of priority levels exist
+    WaitHistogram byType[3];                 // indexed by AirCraftType
+    WaitHistogram byDirection[4];            // indexed by Direction
+    std::vector<WaitHistogram> byAirline;    // indexed like ATCSystem::airlines
+
+    explicit FlightStats(size_t airlineCount = 0) : byAirline(airlineCount) {}
+
+    void record(const Flight& flight, int airlineIndex, time_t completionTime) {
+        int waitTime = static_cast<int>(completionTime - flight.scheduleTime);
+
+        completedFlights++;
+        if (flight.isEmergency) emergencyFlights++;
+        if (flight.hasActiveAVN) flightsWithAVN++;
+
+        overall.add(waitTime);
+        if (flight.isEmergency) emergencies.add(waitTime);
+        byPriority[flight.priority].add(waitTime);
+        byType[static_cast<int>(flight.type)].add(waitTime);
+        byDirection[static_cast<int>(flight.direction)].add(waitTime);
+        if (airlineIndex >= 0 && airlineIndex < static_cast<int>(byAirline.size())) {
+            byAirline[airlineIndex].add(waitTime);
+        }
+    }
+
+    void merge(const FlightStats& other) {
+        completedFlights += other.completedFlights;
+        emergencyFlights += other.emergencyFlights;
+        flightsWithAVN += other.flightsWithAVN;
+        overall.merge(other.overall);
+        emergencies.merge(other.emergencies);
+        for (const auto& entry : other.byPriority) {
+            byPriority[entry.first].merge(entry.second);
+        }
+        for (int i = 0; i < 3; i++) byType[i].merge(other.byType[i]);
+        for (int i = 0; i < 4; i++) byDirection[i].merge(other.byDirection[i]);
+        if (byAirline.size() < other.byAirline.size()) byAirline.resize(other.byAirline.size());
+        for (size_t i = 0; i < other.byAirline.size(); i++) {
+            byAirline[i].merge(other.byAirline[i]);
+        }
+    }
+};
+
+// Bounded, column-oriented record of the most recent completed flights.
+// Once full the oldest rows are overwritten; a capacity of 0 disables history retention.
+class FlightHistoryLog {
+public:
+    static const int kFlightNumberLength = 24;
+
+    struct Row {
+        int id;
+        const char* flightNumber;
+        int airlineIndex;
+        AirCraftType type;
+        Direction direction;
+        AirCraftState state;
+        int priority;
+        time_t scheduleTime;
+        time_t completionTime;
+        bool isEmergency;
+        bool hadAVN;
+    };
+
+private:
+    size_t capacity;
+    size_t next;     // slot the next row is written to
+    size_t count;    // rows currently retained
+    uint64_t dropped; // rows overwritten after the log filled up
+
+    std::vector<int> ids;
+    std::vector<char> flightNumbers; // kFlightNumberLength bytes per row
+    std::vector<int16_t> airlineIndexes;
+    std::vector<uint8_t> types;
+    std::vector<uint8_t> directions;
+    std::vector<uint8_t> states;
+    std::vector<int16_t> priorities;
+    std::vector<time_t> scheduleTimes;
+    std::vector<time_t> completionTimes;
+    std::vector<uint8_t> flags; // bit 0: emergency, bit 1: had an AVN
+
+public:
+    explicit FlightHistoryLog(size_t capacity = 0) : capacity(0), next(0), count(0), dropped(0) {
+        setCapacity(capacity);
+    }
+
+    // Resizing clears the retained rows
+    void setCapacity(size_t newCapacity) {
+        capacity = newCapacity;
+        next = count = 0;
+        dropped = 0;
+        ids.assign(capacity, 0);
+        flightNumbers.assign(capacity * kFlightNumberLength, '\0');
+        airlineIndexes.assign(capacity, 0);
+        types.assign(capacity, 0);
+        directions.assign(capacity, 0);
+        states.assign(capacity, 0);
+        priorities.assign(capacity, 0);
+        scheduleTimes.assign(capacity, 0);
+        completionTimes.assign(capacity, 0);
+        flags.assign(capacity, 0);
+    }
+
+    bool enabled() const { return capacity > 0; }
+    size_t size() const { return count; }
+    uint64_t droppedRows() const { return dropped; }
+
+    void append(const Flight& flight, int airlineIndex, time_t completionTime) {
+        if (capacity == 0) return;
+
+        size_t slot = next;
+        ids[slot] = flight.id;
+        char* number = &flightNumbers[slot * kFlightNumberLength];
+        strncpy(number, flight.flightNumber.c_str(), kFlightNumberLength - 1);
+        number[kFlightNumberLength - 1] = '\0';
+        airlineIndexes[slot] = static_cast<int16_t>(airlineIndex);
+        types[slot] = static_cast<uint8_t>(flight.type);
+        directions[slot] = static_cast<uint8_t>(flight.direction);
+        states[slot] = static_cast<uint8_t>(flight.state);
+        priorities[slot] = static_cast<int16_t>(flight.priority);
+        scheduleTimes[slot] = flight.scheduleTime;
+        completionTimes[slot] = completionTime;
+        flags[slot] = (flight.isEmergency ? 1 : 0) | (flight.hasActiveAVN ? 2 : 0);
+
+        next = (next + 1) % capacity;
+        if (count < capacity) {
+            count++;
+        } else {
+            dropped++;
+        }
+    }
+
+    // i = 0 is the oldest retained row
+    Row row(size_t i) const {
+        size_t slot = (next + capacity - count + i) % capacity;
+        Row r;
+        r.id = ids[slot];
+        r.flightNumber = &flightNumbers[slot * kFlightNumberLength];
+        r.airlineIndex = airlineIndexes[slot];
+        r.type = static_cast<AirCraftType>(types[slot]);
+        r.direction = static_cast<Direction>(directions[slot]);
+        r.state = static_cast<AirCraftState>(states[slot]);
+        r.priority = priorities[slot];
+        r.scheduleTime = scheduleTimes[slot];
+        r.completionTime = completionTimes[slot];
+        r.isEmergency = flags[slot] & 1;
+        r.hadAVN = flags[slot] & 2;
+        return r;
+    }
+};
@@ -0,0 +1,101 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+// Liveness of a process run by the Supervisor (Supervisor.hpp). Each supervised child owns
+// one slot of a MAP_SHARED block the supervisor mapped before forking: the child stores the
+// time of its latest heartbeat there, and once the time it finished starting up. The
+// supervisor reads the slots to tell a child that is alive but stuck from one that is working.
+struct HeartbeatSlot {
+    alignas(64) std::atomic<int64_t> lastBeatNs; // CLOCK_MONOTONIC
+    std::atomic<int64_t> readyNs;                // 0 until the child reports ready
+};
+
+inline int64_t heartbeatClockNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// The slot this process beats on. Installed in each supervised child right after the fork;
+// in every other process it stays unset and the calls below do nothing.
+struct ProcessHeartbeat {
+    HeartbeatSlot* slot;
+    int intervalMs;
+};
+
+inline ProcessHeartbeat& processHeartbeat() {
+    static ProcessHeartbeat heartbeat = {nullptr, -1};
+    return heartbeat;
+}
+
+// Call from every loop that runs or sleeps for a while, including waits on another process.
+// Cheap enough to call once per message.
+inline void heartbeat() {
+    HeartbeatSlot* slot = processHeartbeat().slot;
+    if (slot) slot->lastBeatNs.store(heartbeatClockNs(), std::memory_order_relaxed);
+}
+
+// Call once, when the process is set up and serving
+inline void heartbeatReady() {
+    HeartbeatSlot* slot = processHeartbeat().slot;
+    if (!slot) return;
+    int64_t now = heartbeatClockNs();
+    slot->lastBeatNs.store(now, std::memory_order_relaxed);
+    slot->readyNs.store(now, std::memory_order_release);
+}
+
+// Caps a poll()/epoll_wait() timeout (-1 = forever) so a supervised process wakes up often
+// enough to beat
+inline int heartbeatTimeout(int timeoutMs) {
+    int intervalMs = processHeartbeat().intervalMs;
+    if (intervalMs < 0) return timeoutMs;
+    return timeoutMs < 0 || timeoutMs > intervalMs ? intervalMs : timeoutMs;
+}
+
+// Shutdown requests. Supervisor::stop() SIGTERMs its children; each child installs
+// onStopSignal() right after the fork, which turns the signal into a flag plus a readable
+// eventfd. Event loops poll processStopFd() next to their inputs, so a child blocked on a ring
+// or a pipe whose write end another process still holds wakes, flushes and closes its outputs
+// and returns before the grace period runs out. Elsewhere the fd is -1 and no stop is requested.
+struct ProcessStop {
+    int fd;
+    volatile sig_atomic_t requested;
+};
+
+inline ProcessStop& processStop() {
+    static ProcessStop stop = {-1, 0};
+    return stop;
+}
+
+inline void onStopSignal(int) {
+    int saved = errno;
+    processStop().requested = 1;
+    uint64_t one = 1;
+    if (write(processStop().fd, &one, sizeof(one)) < 0) {
+        // counter saturated: the wakeup is already pending
+    }
+    errno = saved;
+}
+
+inline bool installStopHandler() {
+    processStop().fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (processStop().fd < 0) return false;
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = onStopSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    return sigaction(SIGTERM, &action, nullptr) == 0;
+}
+
+// Readable once a stop was requested; -1 outside supervised children
+inline int processStopFd() { return processStop().fd; }
+
+inline bool stopRequested() { return processStop().requested != 0; }
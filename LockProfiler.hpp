@@ -0,0 +1,180 @@
+#pragma once
+#include <pthread.h>
+#include <iostream>
+
+// Opt-in contention profiling for the simulation mutexes.
+// Build with -DLOCK_PROFILING (PROFILE_LOCKS=1 ./compile.sh) to record, per call site,
+// how long threads waited to get each lock and how long they held it.
+// Without the flag PROFILED_LOCK/PROFILED_UNLOCK are plain pthread calls.
+
+#ifdef LOCK_PROFILING
+
+#include <atomic>
+#include <ctime>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+
+struct LockSite {
+    const char* lockName;
+    const char* file;
+    int line;
+    std::atomic<uint64_t> acquisitions{0};
+    std::atomic<uint64_t> contended{0};   // had to block in pthread_mutex_lock
+    std::atomic<uint64_t> waitNs{0};
+    std::atomic<uint64_t> maxWaitNs{0};
+    std::atomic<uint64_t> holdNs{0};
+    std::atomic<uint64_t> maxHoldNs{0};
+
+    LockSite(const char* lockName, const char* file, int line);
+};
+
+class LockProfiler {
+public:
+    static uint64_t nowNs() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+    }
+
+    static void registerSite(LockSite* site) {
+        pthread_mutex_lock(&registryMutex());
+        sites().push_back(site);
+        pthread_mutex_unlock(&registryMutex());
+    }
+
+    static void lock(pthread_mutex_t* mutex, LockSite* site) {
+        uint64_t waited = 0;
+        if (pthread_mutex_trylock(mutex) != 0) {
+            uint64_t start = nowNs();
+            pthread_mutex_lock(mutex);
+            waited = nowNs() - start;
+            site->contended.fetch_add(1, std::memory_order_relaxed);
+        }
+        site->acquisitions.fetch_add(1, std::memory_order_relaxed);
+        site->waitNs.fetch_add(waited, std::memory_order_relaxed);
+        updateMax(site->maxWaitNs, waited);
+
+        // Only the owning thread can release the mutex, so the hold start lives in thread-local storage
+        heldLocks().push_back({mutex, site, nowNs()});
+    }
+
+    static void unlock(pthread_mutex_t* mutex) {
+        std::vector<HeldLock>& held = heldLocks();
+        for (size_t i = held.size(); i-- > 0;) {
+            if (held[i].mutex == mutex) {
+                uint64_t hold = nowNs() - held[i].acquiredNs;
+                held[i].site->holdNs.fetch_add(hold, std::memory_order_relaxed);
+                updateMax(held[i].site->maxHoldNs, hold);
+                held.erase(held.begin() + i);
+                break;
+            }
+        }
+        pthread_mutex_unlock(mutex);
+    }
+
+    static void report(std::ostream& out) {
+        pthread_mutex_lock(&registryMutex());
+        std::map<std::string, std::vector<LockSite*>> byLock;
+        for (auto site : sites()) {
+            if (site->acquisitions.load() > 0) {
+                byLock[site->lockName].push_back(site);
+            }
+        }
+        pthread_mutex_unlock(&registryMutex());
+
+        out << "\n==== Lock Contention Profile ====\n";
+        if (byLock.empty()) {
+            out << "No profiled lock acquisitions recorded.\n";
+            return;
+        }
+
+        char line[256];
+        for (auto& entry : byLock) {
+            std::vector<LockSite*>& lockSites = entry.second;
+            uint64_t acquisitions = 0, contended = 0, waitNs = 0, holdNs = 0;
+            for (auto site : lockSites) {
+                acquisitions += site->acquisitions.load();
+                contended += site->contended.load();
+                waitNs += site->waitNs.load();
+                holdNs += site->holdNs.load();
+            }
+
+            // Worst offenders (by total wait) first
+            std::sort(lockSites.begin(), lockSites.end(), [](LockSite* a, LockSite* b) {
+                return a->waitNs.load() > b->waitNs.load();
+            });
+
+            out << "\n" << entry.first << ": " << acquisitions << " acquisitions, "
+                << contended << " contended (" << (acquisitions ? 100.0 * contended / acquisitions : 0.0) << "%)"
+                << ", total wait " << waitNs / 1e6 << " ms, total hold " << holdNs / 1e6 << " ms\n";
+            snprintf(line, sizeof(line), "  %-28s %10s %10s %12s %12s %12s %12s\n",
+                     "Call Site", "Acquired", "Contended", "Wait ms", "Max Wait ms", "Hold ms", "Max Hold ms");
+            out << line;
+            for (auto site : lockSites) {
+                std::string where = std::string(site->file) + ":" + std::to_string(site->line);
+                snprintf(line, sizeof(line), "  %-28s %10llu %10llu %12.3f %12.3f %12.3f %12.3f\n",
+                         where.c_str(),
+                         (unsigned long long)site->acquisitions.load(),
+                         (unsigned long long)site->contended.load(),
+                         site->waitNs.load() / 1e6, site->maxWaitNs.load() / 1e6,
+                         site->holdNs.load() / 1e6, site->maxHoldNs.load() / 1e6);
+                out << line;
+            }
+        }
+    }
+
+private:
+    struct HeldLock {
+        pthread_mutex_t* mutex;
+        LockSite* site;
+        uint64_t acquiredNs;
+    };
+
+    static void updateMax(std::atomic<uint64_t>& current, uint64_t value) {
+        uint64_t seen = current.load(std::memory_order_relaxed);
+        while (value > seen && !current.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    static std::vector<HeldLock>& heldLocks() {
+        thread_local std::vector<HeldLock> held;
+        return held;
+    }
+
+    static std::vector<LockSite*>& sites() {
+        static std::vector<LockSite*> registered;
+        return registered;
+    }
+
+    static pthread_mutex_t& registryMutex() {
+        static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+        return mutex;
+    }
+};
+
+inline LockSite::LockSite(const char* lockName, const char* file, int line)
+    : lockName(lockName), file(file), line(line) {
+    LockProfiler::registerSite(this);
+}
+
+// Each expansion owns a function-static LockSite, so call sites are told apart without any lookup
+#define PROFILED_LOCK(m) \
+    do { static LockSite lockSite_(#m, __FILE__, __LINE__); LockProfiler::lock(&(m), &lockSite_); } while (0)
+#define PROFILED_UNLOCK(m) LockProfiler::unlock(&(m))
+
+inline void dumpLockProfile() {
+    LockProfiler::report(std::cout);
+}
+
+#else
+
+#define PROFILED_LOCK(m) pthread_mutex_lock(&(m))
+#define PROFILED_UNLOCK(m) pthread_mutex_unlock(&(m))
+
+inline void dumpLockProfile() {}
+
+#endif
@@ -0,0 +1,339 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <sstream>
+#include <ctime>
+#include <cstring>
+#include <cerrno>
+#include <pthread.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "MsgStructs.hpp"
+#include "ShmRing.hpp"
+#include "Supervisor.hpp"
+
+const int kMaxMetricAirlines = 16;
+const int kAircraftStateCount = 8;
+const int kRunwayCount = 3;
+
+// Lock-free snapshot of the simulation, written by the ATC threads at points where they
+// already hold the relevant mutex and read by the metrics thread without taking any lock.
+struct SimulationMetrics {
+    std::atomic<long> activeFlights{0};
+    std::atomic<long> completedFlights{0};
+    std::atomic<long> activeAVNs{0};
+    std::atomic<long> totalAVNs{0};
+    std::atomic<long> clearedAVNs{0};
+    std::atomic<long> withdrawnAVNs{0};  // the outbox never delivered them
+    std::atomic<long> flightsByState[kAircraftStateCount];
+    std::atomic<bool> runwayOccupied[kRunwayCount];
+    std::atomic<long> violationsByAirline[kMaxMetricAirlines];
+    std::atomic<time_t> startTime{0};
+    std::atomic<bool> running{false};
+
+    // AVN outbox between the radar and the atcs_to_avn channel (AVNOutbox.hpp)
+    std::atomic<long> outboxDepth{0};
+    std::atomic<long> outboxHighWater{0};
+    std::atomic<long> outboxSpillDepth{0};
+    std::atomic<long> outboxEnqueued{0};
+    std::atomic<long> outboxSent{0};
+    std::atomic<long> outboxCoalesced{0};
+    std::atomic<long> outboxSpilled{0};
+    std::atomic<long> outboxDropped{0};
+    std::atomic<long long> outboxBlockedNs{0};
+
+    // Clearances read back from the avn_to_atcs channels (AVNInbox.hpp)
+    std::atomic<long> clearancesReceived{0};
+    std::atomic<long> clearancesUnmatched{0}; // AVN no longer tracked (its flight had left)
+
+    // Set once before the metrics thread starts, read-only afterwards
+    std::vector<std::string> airlineNames;
+    const std::vector<IpcChannel>* ipcBacklogChannels = nullptr; // ATCS -> AVN, summed over shards
+    const Supervisor* supervisor = nullptr;        // child process health, if main() supervises them
+
+    SimulationMetrics() {
+        for (auto& count : flightsByState) count = 0;
+        for (auto& occupied : runwayOccupied) occupied = false;
+        for (auto& count : violationsByAirline) count = 0;
+    }
+};
+
+// Serves SimulationMetrics over a Unix domain socket from its own thread.
+//   curl --unix-socket /tmp/aircontrolx-<pid>.sock http://localhost/metrics       (Prometheus text)
+//   curl --unix-socket /tmp/aircontrolx-<pid>.sock http://localhost/metrics.json  (JSON)
+//   echo json | nc -U /tmp/aircontrolx-<pid>.sock                                  (raw, no HTTP)
+class MetricsServer {
+private:
+    const SimulationMetrics* metrics;
+    std::string socketPath;
+    int listenFd;
+    pthread_t serverThread;
+    std::atomic<bool> serving;
+
+    static const char* stateName(int state) {
+        static const char* names[kAircraftStateCount] = {
+            "holding", "approach", "landing", "taxi", "at_gate", "takeoff_roll", "climb", "departure"
+        };
+        return names[state];
+    }
+
+    static const char* runwayName(int runway) {
+        static const char* names[kRunwayCount] = {"RWY-A", "RWY-B", "RWY-C"};
+        return names[runway];
+    }
+
+    long ipcBacklogMessages() const {
+        long backlog = 0;
+        if (metrics->ipcBacklogChannels) {
+            for (const IpcChannel& channel : *metrics->ipcBacklogChannels) backlog += channel.backlog();
+        }
+        return backlog;
+    }
+
+    double violationsPerMinute() const {
+        time_t start = metrics->startTime.load();
+        double minutes = start > 0 ? difftime(time(nullptr), start) / 60.0 : 0.0;
+        return minutes > 0 ? metrics->totalAVNs.load() / minutes : 0.0;
+    }
+
+    std::string renderPrometheus() const {
+        std::ostringstream out;
+        out << "# TYPE aircontrolx_simulation_running gauge\n"
+            << "aircontrolx_simulation_running " << (metrics->running.load() ? 1 : 0) << "\n"
+            << "# TYPE aircontrolx_active_flights gauge\n"
+            << "aircontrolx_active_flights " << metrics->activeFlights.load() << "\n"
+            << "# TYPE aircontrolx_completed_flights_total counter\n"
+            << "aircontrolx_completed_flights_total " << metrics->completedFlights.load() << "\n"
+            << "# TYPE aircontrolx_flights_by_state gauge\n";
+        for (int i = 0; i < kAircraftStateCount; i++) {
+            out << "aircontrolx_flights_by_state{state=\"" << stateName(i) << "\"} "
+                << metrics->flightsByState[i].load() << "\n";
+        }
+        out << "# TYPE aircontrolx_runway_occupied gauge\n";
+        for (int i = 0; i < kRunwayCount; i++) {
+            out << "aircontrolx_runway_occupied{runway=\"" << runwayName(i) << "\"} "
+                << (metrics->runwayOccupied[i].load() ? 1 : 0) << "\n";
+        }
+        out << "# TYPE aircontrolx_active_avns gauge\n"
+            << "aircontrolx_active_avns " << metrics->activeAVNs.load() << "\n"
+            << "# TYPE aircontrolx_avns_issued_total counter\n"
+            << "aircontrolx_avns_issued_total " << metrics->totalAVNs.load() << "\n"
+            << "# TYPE aircontrolx_avns_cleared_total counter\n"
+            << "aircontrolx_avns_cleared_total " << metrics->clearedAVNs.load() << "\n"
+            << "# TYPE aircontrolx_avns_withdrawn_total counter\n"
+            << "aircontrolx_avns_withdrawn_total " << metrics->withdrawnAVNs.load() << "\n"
+            << "# TYPE aircontrolx_clearances_total counter\n"
+            << "aircontrolx_clearances_total{outcome=\"received\"} " << metrics->clearancesReceived.load() << "\n"
+            << "aircontrolx_clearances_total{outcome=\"unmatched\"} " << metrics->clearancesUnmatched.load() << "\n"
+            << "# TYPE aircontrolx_avns_by_airline_total counter\n";
+        for (size_t i = 0; i < metrics->airlineNames.size() && i < kMaxMetricAirlines; i++) {
+            out << "aircontrolx_avns_by_airline_total{airline=\"" << metrics->airlineNames[i] << "\"} "
+                << metrics->violationsByAirline[i].load() << "\n";
+        }
+        out << "# TYPE aircontrolx_violations_per_minute gauge\n"
+            << "aircontrolx_violations_per_minute " << violationsPerMinute() << "\n"
+            << "# TYPE aircontrolx_ipc_backlog_messages gauge\n"
+            << "aircontrolx_ipc_backlog_messages{channel=\"atcs_to_avn\"} " << ipcBacklogMessages() << "\n"
+            << "# TYPE aircontrolx_outbox_depth gauge\n"
+            << "aircontrolx_outbox_depth " << metrics->outboxDepth.load() << "\n"
+            << "# TYPE aircontrolx_outbox_high_water gauge\n"
+            << "aircontrolx_outbox_high_water " << metrics->outboxHighWater.load() << "\n"
+            << "# TYPE aircontrolx_outbox_spill_depth gauge\n"
+            << "aircontrolx_outbox_spill_depth " << metrics->outboxSpillDepth.load() << "\n"
+            << "# TYPE aircontrolx_outbox_notices_total counter\n"
+            << "aircontrolx_outbox_notices_total{outcome=\"enqueued\"} " << metrics->outboxEnqueued.load() << "\n"
+            << "aircontrolx_outbox_notices_total{outcome=\"sent\"} " << metrics->outboxSent.load() << "\n"
+            << "aircontrolx_outbox_notices_total{outcome=\"coalesced\"} " << metrics->outboxCoalesced.load() << "\n"
+            << "aircontrolx_outbox_notices_total{outcome=\"spilled\"} " << metrics->outboxSpilled.load() << "\n"
+            << "aircontrolx_outbox_notices_total{outcome=\"dropped\"} " << metrics->outboxDropped.load() << "\n"
+            << "# TYPE aircontrolx_outbox_blocked_seconds_total counter\n"
+            << "aircontrolx_outbox_blocked_seconds_total " << metrics->outboxBlockedNs.load() / 1e9 << "\n";
+        if (const Supervisor* supervisor = metrics->supervisor) {
+            auto family = [&](const char* name, const char* type, auto value) {
+                out << "# TYPE aircontrolx_process_" << name << " " << type << "\n";
+                for (size_t i = 0; i < supervisor->processCount(); i++) {
+                    const SupervisedProcessStats& process = supervisor->processStats(i);
+                    out << "aircontrolx_process_" << name << "{process=\"" << process.name << "\"} " << value(process) << "\n";
+                }
+            };
+            family("up", "gauge", [](const SupervisedProcessStats& p) { return p.up.load() ? 1 : 0; });
+            family("restarts_total", "counter", [](const SupervisedProcessStats& p) { return p.restarts.load(); });
+            family("heartbeat_kills_total", "counter", [](const SupervisedProcessStats& p) { return p.heartbeatKills.load(); });
+            family("startup_seconds", "gauge", [](const SupervisedProcessStats& p) { return p.startupUs.load() / 1e6; });
+            family("restart_seconds", "gauge", [](const SupervisedProcessStats& p) { return p.restartUs.load() / 1e6; });
+            family("restart_seconds_max", "gauge", [](const SupervisedProcessStats& p) { return p.maxRestartUs.load() / 1e6; });
+        }
+        return out.str();
+    }
+
+    std::string renderJson() const {
+        std::ostringstream out;
+        out << "{\"running\":" << (metrics->running.load() ? "true" : "false")
+            << ",\"activeFlights\":" << metrics->activeFlights.load()
+            << ",\"completedFlights\":" << metrics->completedFlights.load()
+            << ",\"flightsByState\":{";
+        for (int i = 0; i < kAircraftStateCount; i++) {
+            out << (i ? "," : "") << "\"" << stateName(i) << "\":" << metrics->flightsByState[i].load();
+        }
+        out << "},\"runways\":{";
+        for (int i = 0; i < kRunwayCount; i++) {
+            out << (i ? "," : "") << "\"" << runwayName(i) << "\":"
+                << (metrics->runwayOccupied[i].load() ? "\"occupied\"" : "\"available\"");
+        }
+        out << "},\"activeAVNs\":" << metrics->activeAVNs.load()
+            << ",\"totalAVNs\":" << metrics->totalAVNs.load()
+            << ",\"clearedAVNs\":" << metrics->clearedAVNs.load()
+            << ",\"withdrawnAVNs\":" << metrics->withdrawnAVNs.load()
+            << ",\"clearances\":{\"received\":" << metrics->clearancesReceived.load()
+            << ",\"unmatched\":" << metrics->clearancesUnmatched.load() << "}"
+            << ",\"avnsByAirline\":{";
+        for (size_t i = 0; i < metrics->airlineNames.size() && i < kMaxMetricAirlines; i++) {
+            out << (i ? "," : "") << "\"" << metrics->airlineNames[i] << "\":" << metrics->violationsByAirline[i].load();
+        }
+        out << "},\"violationsPerMinute\":" << violationsPerMinute()
+            << ",\"ipcBacklog\":{\"atcs_to_avn\":" << ipcBacklogMessages() << "}"
+            << ",\"outbox\":{\"depth\":" << metrics->outboxDepth.load()
+            << ",\"highWater\":" << metrics->outboxHighWater.load()
+            << ",\"spillDepth\":" << metrics->outboxSpillDepth.load()
+            << ",\"enqueued\":" << metrics->outboxEnqueued.load()
+            << ",\"sent\":" << metrics->outboxSent.load()
+            << ",\"coalesced\":" << metrics->outboxCoalesced.load()
+            << ",\"spilled\":" << metrics->outboxSpilled.load()
+            << ",\"dropped\":" << metrics->outboxDropped.load()
+            << ",\"blockedSeconds\":" << metrics->outboxBlockedNs.load() / 1e9 << "}";
+        if (const Supervisor* supervisor = metrics->supervisor) {
+            out << ",\"processes\":{";
+            for (size_t i = 0; i < supervisor->processCount(); i++) {
+                const SupervisedProcessStats& process = supervisor->processStats(i);
+                out << (i ? "," : "") << "\"" << process.name << "\":{\"pid\":" << process.pid.load()
+                    << ",\"up\":" << (process.up.load() ? "true" : "false")
+                    << ",\"restarts\":" << process.restarts.load()
+                    << ",\"heartbeatKills\":" << process.heartbeatKills.load()
+                    << ",\"startupSeconds\":" << process.startupUs.load() / 1e6
+                    << ",\"restartSeconds\":" << process.restartUs.load() / 1e6
+                    << ",\"maxRestartSeconds\":" << process.maxRestartUs.load() / 1e6 << "}";
+            }
+            out << "}";
+        }
+        out << "}\n";
+        return out.str();
+    }
+
+    // MSG_NOSIGNAL: a scraper that hangs up early must not SIGPIPE the simulation; EPIPE or
+    // ECONNRESET just ends the reply
+    void writeAll(int fd, const std::string& data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) continue;
+                return;
+            }
+            sent += n;
+        }
+    }
+
+    void handleClient(int clientFd) {
+        // The request is optional: a bare connect gets Prometheus text, "GET ..." gets an HTTP reply
+        char request[512] = {0};
+        pollfd pfd = {clientFd, POLLIN, 0};
+        if (poll(&pfd, 1, 100) > 0) {
+            ssize_t n = read(clientFd, request, sizeof(request) - 1);
+            if (n > 0) request[n] = '\0';
+        }
+
+        bool http = strncmp(request, "GET ", 4) == 0;
+        bool json = strstr(request, "json") != nullptr;
+        std::string body = json ? renderJson() : renderPrometheus();
+
+        if (http) {
+            std::ostringstream header;
+            header << "HTTP/1.0 200 OK\r\n"
+                   << "Content-Type: " << (json ? "application/json" : "text/plain; version=0.0.4") << "\r\n"
+                   << "Content-Length: " << body.size() << "\r\n"
+                   << "Connection: close\r\n\r\n";
+            writeAll(clientFd, header.str());
+        }
+        writeAll(clientFd, body);
+    }
+
+    void serveLoop() {
+        while (serving) {
+            pollfd pfd = {listenFd, POLLIN, 0};
+            if (poll(&pfd, 1, 200) <= 0) {
+                continue; // timeout or EINTR, re-check serving
+            }
+            int clientFd = accept(listenFd, nullptr, nullptr);
+            if (clientFd < 0) {
+                continue;
+            }
+            handleClient(clientFd);
+            close(clientFd);
+        }
+    }
+
+    static void* serverThreadFunc(void* arg) {
+        static_cast<MetricsServer*>(arg)->serveLoop();
+        return nullptr;
+    }
+
+public:
+    MetricsServer() : metrics(nullptr), listenFd(-1), serving(false) {}
+
+    ~MetricsServer() {
+        stop();
+    }
+
+    static std::string defaultSocketPath() {
+        return "/tmp/aircontrolx-" + std::to_string(getpid()) + ".sock";
+    }
+
+    bool start(const SimulationMetrics* snapshot, const std::string& path) {
+        if (serving) return true;
+        metrics = snapshot;
+        socketPath = path;
+
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listenFd < 0) {
+            std::cerr << "Metrics: socket() failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+        unlink(socketPath.c_str()); // stale socket from a previous run
+
+        if (bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listenFd, 8) < 0) {
+            std::cerr << "Metrics: cannot listen on " << socketPath << ": " << strerror(errno) << std::endl;
+            close(listenFd);
+            listenFd = -1;
+            return false;
+        }
+
+        serving = true;
+        if (pthread_create(&serverThread, NULL, serverThreadFunc, this) != 0) {
+            serving = false;
+            close(listenFd);
+            listenFd = -1;
+            unlink(socketPath.c_str());
+            return false;
+        }
+        std::cout << "Metrics endpoint listening on " << socketPath << std::endl;
+        return true;
+    }
+
+    void stop() {
+        if (!serving) return;
+        serving = false;
+        pthread_join(serverThread, NULL);
+        close(listenFd);
+        listenFd = -1;
+        unlink(socketPath.c_str());
+    }
+};
@@ -0,0 +1,237 @@
+#pragma once
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <pthread.h>
+#include <unistd.h>
+#include "ATCSystem.hpp"
+#include "FlightStats.hpp"
+
+// Capacity-planning mode: runs seeded headless ATCSystem replications in parallel and
+// merges their wait-time histograms.
+//   ./sfml_menu --montecarlo [--replications N] [--min-replications N] [--duration S]
+//               [--threshold X] [--precision P] [--probability-precision P]
+//               [--seed S] [--threads T]
+struct MonteCarloOptions {
+    int maxReplications = 500;
+    int minReplications = 20;
+    int durationSeconds = 300;          // simulated time per replication
+    int emergencyWaitThreshold = 60;    // X in P(emergency wait > X seconds)
+    double relativePrecision = 0.05;    // target CI half-width relative to the mean (wait times)
+    double probabilityPrecision = 0.02; // target absolute CI half-width for the probability
+    unsigned baseSeed = 12345;          // replication i uses baseSeed + i
+    int threads = 0;                    // 0 = one worker per online CPU
+};
+
+// Welford running mean/variance of one per-replication statistic
+struct RunningEstimate {
+    long n = 0;
+    double mean = 0;
+    double m2 = 0;
+
+    void add(double x) {
+        n++;
+        double delta = x - mean;
+        mean += delta / n;
+        m2 += delta * (x - mean);
+    }
+
+    double stddev() const {
+        return n > 1 ? std::sqrt(m2 / (n - 1)) : 0.0;
+    }
+
+    // 95% confidence half-width (normal approximation)
+    double halfWidth() const {
+        return n > 1 ? 1.96 * stddev() / std::sqrt(static_cast<double>(n)) : INFINITY;
+    }
+};
+
+class MonteCarloEstimator {
+private:
+    MonteCarloOptions options;
+    pthread_mutex_t mutex;
+    int nextReplication;
+    int completedReplications;
+    bool converged;
+
+    FlightStats pooled;
+    RunningEstimate meanWait;
+    RunningEstimate p95ByType[3];
+    RunningEstimate emergencyExceedance;
+
+    static void* workerThreadFunc(void* arg) {
+        static_cast<MonteCarloEstimator*>(arg)->workerLoop();
+        return nullptr;
+    }
+
+    bool estimateConverged(const RunningEstimate& estimate, bool relative, double target) const {
+        if (estimate.n < 2) return true; // never observed often enough to constrain the run
+        double limit = relative ? target * std::fabs(estimate.mean) : target;
+        return estimate.halfWidth() <= limit;
+    }
+
+    // Caller holds mutex
+    bool precisionReached() const {
+        if (completedReplications < options.minReplications) return false;
+        if (!estimateConverged(meanWait, true, options.relativePrecision)) return false;
+        for (int i = 0; i < 3; i++) {
+            if (!estimateConverged(p95ByType[i], true, options.relativePrecision)) return false;
+        }
+        return estimateConverged(emergencyExceedance, false, options.probabilityPrecision);
+    }
+
+    void workerLoop() {
+        while (true) {
+            pthread_mutex_lock(&mutex);
+            if (converged || nextReplication >= options.maxReplications) {
+                pthread_mutex_unlock(&mutex);
+                return;
+            }
+            int replication = nextReplication++;
+            pthread_mutex_unlock(&mutex);
+
+            ATCSystem sim(true);
+            sim.runHeadless(options.baseSeed + replication, options.durationSeconds);
+            const FlightStats& stats = sim.flightStats;
+
+            pthread_mutex_lock(&mutex);
+            pooled.merge(stats);
+            if (stats.overall.count > 0) {
+                meanWait.add(stats.overall.mean());
+            }
+            for (int i = 0; i < 3; i++) {
+                if (stats.byType[i].count > 0) {
+                    p95ByType[i].add(stats.byType[i].percentile(0.95));
+                }
+            }
+            if (stats.emergencies.count > 0) {
+                emergencyExceedance.add(stats.emergencies.fractionAbove(options.emergencyWaitThreshold));
+            }
+            completedReplications++;
+            if (!converged && precisionReached()) {
+                converged = true;
+            }
+            pthread_mutex_unlock(&mutex);
+        }
+    }
+
+public:
+    explicit MonteCarloEstimator(const MonteCarloOptions& options)
+        : options(options), nextReplication(0), completedReplications(0), converged(false) {
+        pthread_mutex_init(&mutex, NULL);
+        if (this->options.threads <= 0) {
+            long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+            this->options.threads = cpus > 0 ? static_cast<int>(cpus) : 1;
+        }
+    }
+
+    ~MonteCarloEstimator() {
+        pthread_mutex_destroy(&mutex);
+    }
+
+    void run() {
+        std::vector<pthread_t> workers(options.threads);
+        for (auto& worker : workers) {
+            pthread_create(&worker, NULL, workerThreadFunc, this);
+        }
+        for (auto& worker : workers) {
+            pthread_join(worker, NULL);
+        }
+    }
+
+    void report(std::ostream& out) const {
+        char line[256];
+        out << "\n==== AirControlX Monte Carlo Wait-Time Estimate ====\n";
+        out << "Replications: " << completedReplications
+            << (converged ? " (target precision reached)" : " (replication limit reached)") << "\n";
+        out << "Simulated time per replication: " << options.durationSeconds << " s, worker threads: "
+            << options.threads << ", seeds " << options.baseSeed << ".."
+            << options.baseSeed + completedReplications - 1 << "\n";
+        out << "Completed flights: " << pooled.completedFlights
+            << " (" << pooled.emergencyFlights << " emergencies)\n";
+
+        out << "\nWait time by aircraft type (pooled histogram; p95 CI across replications)\n";
+        snprintf(line, sizeof(line), "%-12s %8s %8s %8s %8s %8s   %s\n",
+                 "Type", "Flights", "Mean", "p50", "p95", "p99", "p95 mean +/- 95% CI");
+        out << line;
+        for (int i = 0; i < 3; i++) {
+            const WaitHistogram& h = pooled.byType[i];
+            const RunningEstimate& e = p95ByType[i];
+            char ci[64] = "n/a";
+            if (e.n > 1) {
+                snprintf(ci, sizeof(ci), "%.1f +/- %.1f s (n=%ld)", e.mean, e.halfWidth(), e.n);
+            }
+            snprintf(line, sizeof(line), "%-12s %8llu %8.1f %8d %8d %8d   %s\n",
+                     Flight::typeName(static_cast<AirCraftType>(i)), (unsigned long long)h.count,
+                     h.mean(), h.percentile(0.50), h.percentile(0.95), h.percentile(0.99), ci);
+            out << line;
+        }
+
+        out << "\nMean wait (all flights): ";
+        if (meanWait.n > 1) {
+            snprintf(line, sizeof(line), "%.1f +/- %.1f s\n", meanWait.mean, meanWait.halfWidth());
+            out << line;
+        } else {
+            out << pooled.overall.mean() << " s\n";
+        }
+
+        out << "P(emergency wait > " << options.emergencyWaitThreshold << " s): ";
+        if (pooled.emergencies.count == 0) {
+            out << "n/a (no emergencies completed)\n";
+        } else {
+            snprintf(line, sizeof(line), "%.3f pooled", pooled.emergencies.fractionAbove(options.emergencyWaitThreshold));
+            out << line;
+            if (emergencyExceedance.n > 1) {
+                snprintf(line, sizeof(line), ", %.3f +/- %.3f across %ld replications",
+                         emergencyExceedance.mean, emergencyExceedance.halfWidth(), emergencyExceedance.n);
+                out << line;
+            }
+            out << "\n";
+        }
+    }
+};
+
+// Returns false (after printing usage) on a malformed command line
+inline bool parseMonteCarloArgs(int argc, char** argv, MonteCarloOptions& options) {
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return false;
+        }
+        const char* value = argv[++i];
+        if (arg == "--replications") options.maxReplications = atoi(value);
+        else if (arg == "--min-replications") options.minReplications = atoi(value);
+        else if (arg == "--duration") options.durationSeconds = atoi(value);
+        else if (arg == "--threshold") options.emergencyWaitThreshold = atoi(value);
+        else if (arg == "--precision") options.relativePrecision = atof(value);
+        else if (arg == "--probability-precision") options.probabilityPrecision = atof(value);
+        else if (arg == "--seed") options.baseSeed = static_cast<unsigned>(strtoul(value, nullptr, 10));
+        else if (arg == "--threads") options.threads = atoi(value);
+        else {
+            std::cerr << "Unknown option " << arg << "\n"
+                      << "Usage: " << argv[0] << " --montecarlo [--replications N] [--min-replications N]"
+                      << " [--duration S] [--threshold X] [--precision P] [--probability-precision P]"
+                      << " [--seed S] [--threads T]" << std::endl;
+            return false;
+        }
+    }
+    if (options.minReplications > options.maxReplications) {
+        options.minReplications = options.maxReplications;
+    }
+    return options.maxReplications > 0 && options.durationSeconds > 0;
+}
+
+inline int runMonteCarlo(int argc, char** argv) {
+    MonteCarloOptions options;
+    if (!parseMonteCarloArgs(argc, argv, options)) {
+        return 1;
+    }
+    MonteCarloEstimator estimator(options);
+    estimator.run();
+    estimator.report(std::cout);
+    return 0;
+}
@@ -3,43 +3,39 @@
 #include <iostream>
 #include <string>
 #include <ctime>
+#include "AvnId.hpp"
+#include "Trace.hpp"
 
-// Message structures for IPC
-struct ViolationDetails {
-    int avnId;
-    char aircraftId[20];
-    char AirlineName[20];
-    double speed;
-    double allowedSpeed;
-    time_t timestamp;
-};
-
+// Message structures for IPC. The structs below travel between processes in the WireFormat.hpp encoding, never raw
 struct AVNNotice {
-    int avnId;
-    char aircraftId[20];
-    char AirlineName[30];
-    double recordedSpeed;
-    double allowedSpeed;
-    char aircraftType[20];
-    char flightNumber[20];
-    double totalFine;
-    time_t timestamp;
+    AvnId avnId = 0;
+    std::string aircraftId;
+    std::string AirlineName;
+    double recordedSpeed = 0;
+    double allowedSpeed = 0;
+    std::string aircraftType;
+    std::string flightNumber;
+    double totalFine = 0;
+    time_t timestamp = 0;
+    TraceContext trace;
 };
 
 struct PaymentRequest {
-    int avnId;
-    int aircraftId;
-    char aircraftType[20];
-    double totalFine;
+    AvnId avnId = 0;
+    std::string aircraftId;
+    std::string aircraftType;
+    double totalFine = 0;
 };
 
 struct PaymentConfirmation {
-    int avnId;
-    char status[10]; // "paid"
+    AvnId avnId = 0;
+    std::string status; // "paid"
+    TraceContext trace;
 };
 
 struct ViolationClearance {
-    int avnId;
-    int aircraftId;
-    char status[20]; // "cleared"
+    AvnId avnId = 0;
+    std::string aircraftId;
+    std::string status; // "cleared"
+    TraceContext trace;
 };
\ No newline at end of file
@@ -0,0 +1,59 @@
+#pragma once
+#include <string>
+#include <random>
+#include <thread>
+#include <functional>
+#include <ctime>
+#include <cerrno>
+#include "MsgStructs.hpp"
+
+struct PaymentResult {
+    bool approved;
+    std::string reason; // why it was declined; empty when approved
+};
+
+// What StripePayment settles fines through. charge() is called from several worker threads
+// at once, blocks for as long as the payment takes, and must be thread-safe.
+class PaymentGateway {
+public:
+    virtual ~PaymentGateway() {}
+    virtual PaymentResult charge(const PaymentRequest& request) = 0;
+};
+
+struct LocalGatewayOptions {
+    int latencyMs = 200;       // typical time per charge
+    int jitterMs = 100;        // +/- uniform spread around latencyMs
+    double failureRate = 0.05; // probability a charge is declined
+};
+
+// Stand-in for a real payment provider: sleeps for a randomized latency and declines a
+// configurable fraction of charges.
+class LocalGateway : public PaymentGateway {
+private:
+    LocalGatewayOptions options;
+
+    static std::mt19937& rng() {
+        thread_local std::mt19937 generator(
+            static_cast<unsigned>(std::hash<std::thread::id>()(std::this_thread::get_id())) ^
+            static_cast<unsigned>(time(0)));
+        return generator;
+    }
+
+public:
+    explicit LocalGateway(const LocalGatewayOptions& options = LocalGatewayOptions()) : options(options) {}
+
+    PaymentResult charge(const PaymentRequest&) override {
+        int delayMs = options.latencyMs;
+        if (options.jitterMs > 0) {
+            delayMs += std::uniform_int_distribution<int>(-options.jitterMs, options.jitterMs)(rng());
+        }
+        if (delayMs > 0) {
+            timespec delay = {delayMs / 1000, (delayMs % 1000) * 1000000L};
+            while (nanosleep(&delay, &delay) < 0 && errno == EINTR) {}
+        }
+        if (std::uniform_real_distribution<double>(0.0, 1.0)(rng()) < options.failureRate) {
+            return {false, "declined by issuer"};
+        }
+        return {true, ""};
+    }
+};
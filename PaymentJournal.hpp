@@ -0,0 +1,572 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "WireFormat.hpp"
+#include "AsyncFileWriter.hpp"
+
+// Append-only binary journal of settled payments, written with group commit.
+//
+//   directory/segment-NNNNNN.pjl, numbered from 1; each segment is
+//     header = magic "AXPJ" version:u32 segmentNumber:u64
+//     record = length:u32 crc32:u32 payload[length]      (payload encoded with WireWriter)
+//
+// Segments are preallocated to segmentBytes with fallocate(), so committing a batch does
+// not also have to commit a file size change, and are rotated when the next record would
+// not fit. The unused tail of a segment is zeros; a reader stops at the first record whose
+// length is 0, whose CRC does not match or whose sequence number is not the next one, so a
+// batch torn by a crash is simply where the journal ends.
+//
+// Records handed to append() are queued in memory. A commit thread hands everything queued
+// to an AsyncFileWriter as one write per segment, linked to an fdatasync unless the
+// durability mode is None, and goes on gathering the next batch while it is on its way to
+// disk. A record counts as committed once its batch and every batch before it have finished:
+//   None  - no sync. A record is in the page cache once committed and survives a process
+//           crash but not a power loss or kernel crash.
+//   Group - one fdatasync() per commit window. append() returns at once; a record is
+//           durable within about commitWindowMs, but the caller is never told when.
+//   Sync  - as Group, and waitDurable() blocks until the record's batch has been synced.
+//           Callers that must not acknowledge a payment before it is on disk use this.
+// In every mode a burst of appends shares one write and (unless None) one fdatasync. Only
+// segment rotation, every segmentBytes, waits on the disk, and then on the commit thread.
+enum class JournalDurability { None, Group, Sync };
+
+inline const char* journalDurabilityName(JournalDurability durability) {
+    switch (durability) {
+        case JournalDurability::None: return "none";
+        case JournalDurability::Group: return "group";
+        case JournalDurability::Sync: return "sync";
+    }
+    return "unknown";
+}
+
+inline bool parseJournalDurability(const char* name, JournalDurability& durability) {
+    if (strcmp(name, "none") == 0) durability = JournalDurability::None;
+    else if (strcmp(name, "group") == 0) durability = JournalDurability::Group;
+    else if (strcmp(name, "sync") == 0) durability = JournalDurability::Sync;
+    else return false;
+    return true;
+}
+
+struct JournalOptions {
+    std::string directory = "payment_journal";
+    JournalDurability durability = JournalDurability::Sync;
+    int commitWindowMs = 2;                 // how long a commit waits for more records
+    size_t segmentBytes = 4 * 1024 * 1024;  // preallocated size of each segment
+};
+
+struct PaymentRecord {
+    uint64_t sequence;   // assigned by the journal, 1-based and contiguous across segments
+    AvnId avnId;
+    bool approved;
+    int attempts;
+    double amount;
+    std::string aircraftId;
+    std::string aircraftType;
+    std::string reason;  // empty when approved
+    int64_t timeNs;      // CLOCK_REALTIME when the payment settled
+};
+
+namespace journal {
+
+const char kMagic[4] = {'A', 'X', 'P', 'J'};
+const uint32_t kVersion = 1;
+const size_t kHeaderBytes = 16;
+const size_t kRecordOverhead = 8; // length + crc
+
+struct Crc32Table {
+    uint32_t entries[256];
+    Crc32Table() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            entries[i] = c;
+        }
+    }
+};
+
+inline uint32_t crc32(const char* data, size_t length) {
+    static const Crc32Table table;
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; i++) {
+        crc = table.entries[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+inline void encodeRecord(std::string& out, const PaymentRecord& record) {
+    std::string payload;
+    WireWriter w(payload);
+    w.putVarint(record.sequence);
+    w.putVarint(record.avnId);
+    w.putVarint(record.approved ? 1 : 0);
+    w.putVarint(static_cast<uint32_t>(record.attempts));
+    w.putFixed2(record.amount);
+    w.putString(record.aircraftId);
+    w.putString(record.aircraftType);
+    w.putString(record.reason);
+    w.putSigned(record.timeNs);
+
+    uint32_t length = static_cast<uint32_t>(payload.size());
+    uint32_t crc = crc32(payload.data(), payload.size());
+    out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+    out.append(reinterpret_cast<const char*>(&crc), sizeof(crc));
+    out.append(payload);
+}
+
+inline bool decodeRecord(const char* payload, size_t length, PaymentRecord& record) {
+    WireReader r(payload, length);
+    record.sequence = r.getVarint();
+    record.avnId = r.getVarint();
+    record.approved = r.getVarint() != 0;
+    record.attempts = static_cast<int>(r.getVarint());
+    record.amount = r.getFixed2();
+    record.aircraftId = std::string(r.getString());
+    record.aircraftType = std::string(r.getString());
+    record.reason = std::string(r.getString());
+    record.timeNs = r.getSigned();
+    return r.good() && r.atEnd();
+}
+
+inline std::string segmentPath(const std::string& directory, uint64_t number) {
+    char name[32];
+    snprintf(name, sizeof(name), "segment-%06llu.pjl", static_cast<unsigned long long>(number));
+    return directory + "/" + name;
+}
+
+// Segment numbers present in directory, ascending
+inline std::vector<uint64_t> listSegments(const std::string& directory) {
+    std::vector<uint64_t> numbers;
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) return numbers;
+    while (struct dirent* entry = readdir(dir)) {
+        unsigned long long number;
+        char suffix[8];
+        if (sscanf(entry->d_name, "segment-%llu.%7s", &number, suffix) == 2 && strcmp(suffix, "pjl") == 0) {
+            numbers.push_back(number);
+        }
+    }
+    closedir(dir);
+    std::sort(numbers.begin(), numbers.end());
+    return numbers;
+}
+
+// Reads the valid records of one segment. expectedSequence is the sequence the first record
+// must have (0 = accept whatever the segment starts with) and is advanced past the last
+// valid record; endOffset is where the next record would go.
+template <typename Visitor>
+inline bool scanSegment(int fd, uint64_t& expectedSequence, size_t& endOffset, Visitor visit) {
+    struct stat info;
+    if (fstat(fd, &info) != 0) return false;
+    std::string data(static_cast<size_t>(info.st_size), '\0');
+    size_t got = 0;
+    while (got < data.size()) {
+        ssize_t n = pread(fd, &data[got], data.size() - got, got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += n;
+    }
+    data.resize(got);
+    if (data.size() < kHeaderBytes || memcmp(data.data(), kMagic, sizeof(kMagic)) != 0) {
+        return false;
+    }
+
+    size_t offset = kHeaderBytes;
+    while (offset + kRecordOverhead <= data.size()) {
+        uint32_t length, crc;
+        memcpy(&length, &data[offset], sizeof(length));
+        memcpy(&crc, &data[offset + 4], sizeof(crc));
+        if (length == 0 || offset + kRecordOverhead + length > data.size()) break;
+        const char* payload = &data[offset + kRecordOverhead];
+        PaymentRecord record;
+        if (crc32(payload, length) != crc || !decodeRecord(payload, length, record)) break;
+        if (expectedSequence != 0 && record.sequence != expectedSequence) break;
+        visit(record);
+        expectedSequence = record.sequence + 1;
+        offset += kRecordOverhead + length;
+    }
+    endOffset = offset;
+    return true;
+}
+
+// Visits every valid record of the journal in directory, oldest first, and returns how many
+// there were. A segment without a valid header (its creation was torn) holds no records and
+// is skipped; a sequence gap after it still ends the replay, like recovery does.
+template <typename Visitor>
+inline long replay(const std::string& directory, Visitor visit) {
+    long count = 0;
+    uint64_t expected = 0;
+    for (uint64_t number : listSegments(directory)) {
+        int fd = ::open(segmentPath(directory, number).c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) break;
+        size_t end = 0;
+        scanSegment(fd, expected, end, [&](const PaymentRecord& record) {
+            visit(record);
+            count++;
+        });
+        ::close(fd);
+    }
+    return count;
+}
+
+} // namespace journal
+
+class PaymentJournal {
+private:
+    JournalOptions options;
+
+    int segmentFd;
+    uint64_t segmentNumber;
+    size_t segmentOffset;   // end of the records submitted to the current segment
+
+    pthread_mutex_t mutex;
+    pthread_cond_t workReady;
+    pthread_cond_t committed;
+    std::string pending;                 // encoded records not yet written
+    std::vector<size_t> pendingEnds;     // end offset of each record in pending
+    uint64_t nextSequence;
+    uint64_t durableSequence;            // highest sequence committed (and synced, unless None)
+    bool failed;                         // a commit failed; nothing after it is durable
+    struct Commit {
+        uint64_t lastSequence;
+        size_t records;
+        long long submitNs;
+        long long finishNs;
+        bool finished;
+        bool ok;
+    };
+    std::deque<Commit> commitsInFlight;  // submitted to the writer, in sequence order
+    AsyncFileWriter writer;
+    int waiters;                         // threads in waitDurable()
+    bool stopping;
+    bool started;
+    pthread_t commitThread;
+
+    long commits;
+    long recordsCommitted;
+    long long commitNs;                  // submit to finish, summed
+
+    static void* commitThreadFunc(void* arg) {
+        static_cast<PaymentJournal*>(arg)->commitLoop();
+        return nullptr;
+    }
+
+    static long long monotonicNs() {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return now.tv_sec * 1000000000LL + now.tv_nsec;
+    }
+
+    // The sequence after the last record of the newest of segments[0, count) holding any;
+    // 1 if none do
+    uint64_t sequenceAfter(const std::vector<uint64_t>& segments, size_t count) const {
+        uint64_t next = 0;
+        for (size_t i = count; i-- > 0 && next == 0;) {
+            int fd = ::open(journal::segmentPath(options.directory, segments[i]).c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) continue;
+            size_t ignored;
+            journal::scanSegment(fd, next, ignored, [](const PaymentRecord&) {});
+            ::close(fd);
+        }
+        return next != 0 ? next : 1;
+    }
+
+    bool openSegment(uint64_t number, bool create) {
+        std::string path = journal::segmentPath(options.directory, number);
+        int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_EXCL : 0), 0644);
+        if (fd < 0) {
+            std::cerr << "Payment journal: cannot open " << path << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        if (create) {
+            char header[journal::kHeaderBytes];
+            memcpy(header, journal::kMagic, sizeof(journal::kMagic));
+            memcpy(header + 4, &journal::kVersion, sizeof(journal::kVersion));
+            memcpy(header + 8, &number, sizeof(number));
+            if (pwrite(fd, header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) {
+                std::cerr << "Payment journal: cannot write segment header" << std::endl;
+                ::close(fd);
+                return false;
+            }
+            segmentOffset = journal::kHeaderBytes;
+        }
+        // Best effort: without preallocation every commit also syncs the new file size
+        if (fallocate(fd, 0, 0, options.segmentBytes) != 0 && errno != EOPNOTSUPP) {
+            std::cerr << "Payment journal: cannot preallocate " << path << ": " << strerror(errno) << std::endl;
+        }
+        if (create) {
+            // Make the new segment itself durable before records depend on it
+            fsync(fd);
+            int dirFd = ::open(options.directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (dirFd >= 0) {
+                fsync(dirFd);
+                ::close(dirFd);
+            }
+        }
+        segmentFd = fd;
+        segmentNumber = number;
+        return true;
+    }
+
+    // Trims the preallocated tail so closed segments are only as long as their records
+    void closeSegment() {
+        if (segmentFd < 0) return;
+        if (ftruncate(segmentFd, segmentOffset) != 0) {
+            std::cerr << "Payment journal: cannot trim segment " << segmentNumber << std::endl;
+        }
+        if (options.durability != JournalDurability::None) fdatasync(segmentFd);
+        ::close(segmentFd);
+        segmentFd = -1;
+    }
+
+    // Commit thread only. Submits the batch as one chain per segment it lands in, the
+    // records' write linked to an fdatasync unless durability is None; a record never
+    // straddles two segments. Rotating first waits for the old segment's chains.
+    bool submitBatch(const std::string& batch, const std::vector<size_t>& ends, uint64_t firstSequence) {
+        size_t start = 0;
+        size_t index = 0;
+        while (index < ends.size()) {
+            if (segmentOffset + (ends[index] - start) > options.segmentBytes && segmentOffset > journal::kHeaderBytes) {
+                writer.drain();
+                closeSegment();
+                if (!openSegment(segmentNumber + 1, true)) return false;
+                continue;
+            }
+            size_t stop = index + 1;
+            while (stop < ends.size() && segmentOffset + (ends[stop] - start) <= options.segmentBytes) {
+                stop++;
+            }
+            size_t length = ends[stop - 1] - start;
+            AsyncWriteChain chain;
+            chain.write(segmentFd, segmentOffset, batch.data() + start, length);
+            if (options.durability != JournalDurability::None) chain.sync(segmentFd);
+
+            uint64_t lastSequence = firstSequence + stop - 1;
+            pthread_mutex_lock(&mutex);
+            commitsInFlight.push_back({lastSequence, stop - index, monotonicNs(), 0, false, false});
+            pthread_mutex_unlock(&mutex);
+            if (!writer.submit(chain, [this, lastSequence](bool ok) { commitFinished(lastSequence, ok); })) {
+                commitFinished(lastSequence, false);
+            }
+            segmentOffset += length;
+            start = ends[stop - 1];
+            index = stop;
+        }
+        return true;
+    }
+
+    // Writer thread. Batches can finish out of order; the durable sequence only moves past
+    // a batch once every batch before it has finished too.
+    void commitFinished(uint64_t lastSequence, bool ok) {
+        long long now = monotonicNs();
+        pthread_mutex_lock(&mutex);
+        for (Commit& commit : commitsInFlight) {
+            if (commit.lastSequence == lastSequence) {
+                commit.finished = true;
+                commit.ok = ok;
+                commit.finishNs = now;
+                break;
+            }
+        }
+        while (!commitsInFlight.empty() && commitsInFlight.front().finished) {
+            const Commit& commit = commitsInFlight.front();
+            commits++;
+            recordsCommitted += commit.records;
+            commitNs += commit.finishNs - commit.submitNs;
+            if (commit.ok && !failed) {
+                durableSequence = commit.lastSequence;
+            } else if (!commit.ok && !failed) {
+                failed = true;
+                std::cerr << "Payment journal: records from " << durableSequence + 1 << " on are not durable" << std::endl;
+            }
+            commitsInFlight.pop_front();
+        }
+        pthread_cond_broadcast(&committed);
+        pthread_mutex_unlock(&mutex);
+    }
+
+    void commitLoop() {
+        std::string batch;
+        std::vector<size_t> ends;
+        pthread_mutex_lock(&mutex);
+        while (true) {
+            while (pending.empty() && !stopping) {
+                pthread_cond_wait(&workReady, &mutex);
+            }
+            if (pending.empty() && stopping) break;
+
+            // Group commit: give a burst the window to finish arriving, unless someone is
+            // already waiting for it (their batch is complete)
+            if (options.commitWindowMs > 0 && !stopping && waiters == 0) {
+                timespec deadline;
+                clock_gettime(CLOCK_MONOTONIC, &deadline);
+                deadline.tv_nsec += options.commitWindowMs * 1000000L;
+                deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+                deadline.tv_nsec %= 1000000000L;
+                while (!stopping && waiters == 0 && pthread_cond_timedwait(&workReady, &mutex, &deadline) != ETIMEDOUT) {}
+            }
+            batch.swap(pending);
+            ends.swap(pendingEnds);
+            pending.clear();
+            pendingEnds.clear();
+            uint64_t firstSequence = nextSequence - ends.size();
+            bool skip = failed;
+            pthread_mutex_unlock(&mutex);
+
+            // After a failure nothing more is written: replay must end where durability did
+            bool ok = skip || submitBatch(batch, ends, firstSequence);
+
+            pthread_mutex_lock(&mutex);
+            if (!ok && !failed) {
+                failed = true;
+                std::cerr << "Payment journal: records from " << durableSequence + 1 << " on are not durable" << std::endl;
+            }
+            pthread_cond_broadcast(&committed);
+            batch.clear();
+            ends.clear();
+        }
+        pthread_mutex_unlock(&mutex);
+        writer.drain();
+    }
+
+public:
+    explicit PaymentJournal(const JournalOptions& options = JournalOptions())
+        : options(options), segmentFd(-1), segmentNumber(0), segmentOffset(0), nextSequence(1),
+          durableSequence(0), failed(false), waiters(0), stopping(false), started(false), commits(0), recordsCommitted(0), commitNs(0) {
+        pthread_mutex_init(&mutex, NULL);
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&workReady, &attr);
+        pthread_condattr_destroy(&attr);
+        pthread_cond_init(&committed, NULL);
+    }
+
+    ~PaymentJournal() {
+        close();
+        pthread_cond_destroy(&committed);
+        pthread_cond_destroy(&workReady);
+        pthread_mutex_destroy(&mutex);
+    }
+
+    // Recovers the end of the existing journal (if any) and starts the commit thread
+    bool open() {
+        if (started) return true;
+        if (mkdir(options.directory.c_str(), 0755) != 0 && errno != EEXIST) {
+            std::cerr << "Payment journal: cannot create " << options.directory << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        std::vector<uint64_t> segments = journal::listSegments(options.directory);
+        if (segments.empty()) {
+            if (!openSegment(1, true)) return false;
+        } else {
+            if (!openSegment(segments.back(), false)) return false;
+            uint64_t expected = 0;
+            size_t end = journal::kHeaderBytes;
+            if (!journal::scanSegment(segmentFd, expected, end, [](const PaymentRecord&) {})) {
+                // A torn header: the segment never held a record. Move it out of the journal so
+                // replay and journal_export read on past it, and continue the numbering of the
+                // segments before it.
+                std::string path = journal::segmentPath(options.directory, segmentNumber);
+                std::cerr << "Payment journal: segment " << segmentNumber << " is damaged, moving it to "
+                          << path << ".damaged and starting a new one" << std::endl;
+                ::close(segmentFd);
+                segmentFd = -1;
+                if (rename(path.c_str(), (path + ".damaged").c_str()) != 0) {
+                    std::cerr << "Payment journal: cannot move " << path << ": " << strerror(errno) << std::endl;
+                }
+                expected = sequenceAfter(segments, segments.size() - 1);
+                if (!openSegment(segments.back() + 1, true)) return false;
+            } else {
+                segmentOffset = end;
+                if (expected == 0) {
+                    // Empty last segment: continue numbering from the ones before it
+                    expected = sequenceAfter(segments, segments.size() - 1);
+                }
+            }
+            nextSequence = expected;
+            durableSequence = expected - 1;
+        }
+        if (!writer.start()) {
+            std::cerr << "Payment journal: cannot start the async writer" << std::endl;
+            return false;
+        }
+        stopping = false;
+        started = pthread_create(&commitThread, NULL, commitThreadFunc, this) == 0;
+        return started;
+    }
+
+    // Commits everything still queued, then stops the commit thread
+    void close() {
+        if (!started) return;
+        pthread_mutex_lock(&mutex);
+        stopping = true;
+        pthread_cond_signal(&workReady);
+        pthread_mutex_unlock(&mutex);
+        pthread_join(commitThread, NULL);
+        started = false;
+        writer.stop();
+        closeSegment();
+    }
+
+    // Queues a record and returns its sequence number; never blocks on the disk
+    uint64_t append(PaymentRecord record) {
+        pthread_mutex_lock(&mutex);
+        record.sequence = nextSequence++;
+        journal::encodeRecord(pending, record);
+        pendingEnds.push_back(pending.size());
+        pthread_cond_signal(&workReady);
+        pthread_mutex_unlock(&mutex);
+        return record.sequence;
+    }
+
+    // Blocks until sequence has been committed under the journal's durability mode. Returns
+    // at once unless the mode is Sync; false if the commit failed.
+    bool waitDurable(uint64_t sequence) {
+        if (options.durability != JournalDurability::Sync) return true;
+        pthread_mutex_lock(&mutex);
+        waiters++;
+        pthread_cond_signal(&workReady);
+        while (durableSequence < sequence && !failed && started) {
+            pthread_cond_wait(&committed, &mutex);
+        }
+        waiters--;
+        bool durable = durableSequence >= sequence;
+        pthread_mutex_unlock(&mutex);
+        return durable;
+    }
+
+    // True once a commit has failed: no record appended since then will reach the disk
+    bool hasFailed() {
+        pthread_mutex_lock(&mutex);
+        bool result = failed;
+        pthread_mutex_unlock(&mutex);
+        return result;
+    }
+
+    JournalDurability durability() const { return options.durability; }
+
+    void printStats(std::ostream& out) {
+        pthread_mutex_lock(&mutex);
+        out << "Payment journal: " << recordsCommitted << " records in " << commits << " commits ("
+            << journalDurabilityName(options.durability) << ", " << writer.backendName() << ")";
+        if (commits > 0) {
+            out << ", " << static_cast<double>(recordsCommitted) / commits << " records/commit, "
+                << commitNs / commits / 1000 << " us/commit";
+        }
+        out << std::endl;
+        pthread_mutex_unlock(&mutex);
+    }
+};
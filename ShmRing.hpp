@@ -0,0 +1,512 @@
+#pragma once
+#include <atomic>
+#include <new>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+// Single-producer/single-consumer ring of fixed-size slots in shared memory.
+// The mapping is MAP_SHARED|MAP_ANONYMOUS, so it must be created before fork() and is then
+// visible to both processes at the same address. Each slot holds one message of up to
+// slotSize bytes. head and tail are free-running counters on separate cache lines; a side
+// only sleeps (on an eventfd) after flagging that it is waiting, and the other side only
+// pays for the eventfd write when it sees that flag.
+struct ShmRing {
+    static const size_t kCacheLine = 64;
+
+    alignas(kCacheLine) std::atomic<uint64_t> head;     // next slot to write, producer-owned
+    alignas(kCacheLine) std::atomic<uint64_t> tail;     // next slot to read, consumer-owned
+    alignas(kCacheLine) std::atomic<uint32_t> consumerWaiting;
+    std::atomic<uint32_t> producerWaiting;
+    uint32_t slotSize;   // max payload bytes per slot
+    uint32_t slotCount;  // power of two
+    uint32_t slotStride; // bytes per slot including its length word, cache-line aligned
+    int dataFd;          // eventfd the consumer sleeps on
+    int spaceFd;         // eventfd the producer sleeps on when the ring is full
+    size_t mappedBytes;
+
+    static size_t headerBytes() {
+        return (sizeof(ShmRing) + kCacheLine - 1) & ~(kCacheLine - 1);
+    }
+
+    static ShmRing* create(uint32_t slotSize, uint32_t slotCount) {
+        uint32_t count = 1;
+        while (count < slotCount) count <<= 1;
+        uint32_t stride = (sizeof(uint32_t) + slotSize + kCacheLine - 1) & ~(kCacheLine - 1);
+        size_t bytes = headerBytes() + static_cast<size_t>(stride) * count;
+
+        void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            return nullptr;
+        }
+        ShmRing* ring = new (memory) ShmRing();
+        ring->head = 0;
+        ring->tail = 0;
+        ring->consumerWaiting = 0;
+        ring->producerWaiting = 0;
+        ring->slotSize = slotSize;
+        ring->slotCount = count;
+        ring->slotStride = stride;
+        ring->mappedBytes = bytes;
+        ring->dataFd = eventfd(0, EFD_CLOEXEC);
+        ring->spaceFd = eventfd(0, EFD_CLOEXEC);
+        if (ring->dataFd < 0 || ring->spaceFd < 0) {
+            destroy(ring);
+            return nullptr;
+        }
+        return ring;
+    }
+
+    static void destroy(ShmRing* ring) {
+        if (!ring) return;
+        if (ring->dataFd >= 0) ::close(ring->dataFd);
+        if (ring->spaceFd >= 0) ::close(ring->spaceFd);
+        munmap(ring, ring->mappedBytes);
+    }
+
+    char* slot(uint64_t index) {
+        return reinterpret_cast<char*>(this) + headerBytes() + static_cast<size_t>(index & (slotCount - 1)) * slotStride;
+    }
+
+    size_t size() const {
+        return static_cast<size_t>(head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire));
+    }
+
+    static void signal(int fd) {
+        uint64_t one = 1;
+        while (::write(fd, &one, sizeof(one)) < 0 && errno == EINTR) {}
+    }
+
+    static void sleepOn(int fd) {
+        uint64_t value;
+        while (::read(fd, &value, sizeof(value)) < 0 && errno == EINTR) {}
+    }
+
+    // Producer side. Copies the iovecs into consecutive slots, one message per iovec.
+    // Blocks while the ring is full unless wait is false, in which case it returns the
+    // number of messages that fit. Returns -1 (EMSGSIZE) if a message exceeds slotSize.
+    ssize_t push(const struct iovec* messages, int count, bool wait) {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        int written = 0;
+        while (written < count) {
+            if (messages[written].iov_len > slotSize) {
+                errno = EMSGSIZE;
+                return written > 0 ? written : -1;
+            }
+            if (h - tail.load(std::memory_order_acquire) == slotCount) {
+                // Publish what we have before we (possibly) sleep
+                publish(h);
+                if (!wait) break;
+                producerWaiting.store(1, std::memory_order_seq_cst);
+                if (h - tail.load(std::memory_order_seq_cst) == slotCount) {
+                    sleepOn(spaceFd);
+                }
+                producerWaiting.store(0, std::memory_order_relaxed);
+                continue;
+            }
+            char* s = slot(h);
+            uint32_t length = static_cast<uint32_t>(messages[written].iov_len);
+            memcpy(s, &length, sizeof(length));
+            memcpy(s + sizeof(length), messages[written].iov_base, length);
+            h++;
+            written++;
+        }
+        publish(h);
+        return written;
+    }
+
+    // Consumer side. Copies the oldest message into buffer (truncated to capacity) and
+    // returns its full length, or -1 with EAGAIN if the ring is empty and wait is false.
+    ssize_t pop(void* buffer, size_t capacity, bool wait) {
+        uint64_t t = tail.load(std::memory_order_relaxed);
+        while (head.load(std::memory_order_acquire) == t) {
+            if (!wait) {
+                errno = EAGAIN;
+                return -1;
+            }
+            consumerWaiting.store(1, std::memory_order_seq_cst);
+            if (head.load(std::memory_order_seq_cst) == t) {
+                sleepOn(dataFd);
+            }
+            consumerWaiting.store(0, std::memory_order_relaxed);
+        }
+        const char* s = slot(t);
+        uint32_t length;
+        memcpy(&length, s, sizeof(length));
+        memcpy(buffer, s + sizeof(length), length < capacity ? length : capacity);
+        tail.store(t + 1, std::memory_order_seq_cst);
+        if (producerWaiting.load(std::memory_order_seq_cst)) {
+            signal(spaceFd);
+        }
+        return length;
+    }
+
+    // For consumers that sleep in poll/epoll on dataFd instead of in pop(): flag the consumer
+    // as waiting before sleeping. Returns false (and stays unflagged) if messages are queued.
+    bool armConsumerWait() {
+        consumerWaiting.store(1, std::memory_order_seq_cst);
+        if (head.load(std::memory_order_seq_cst) != tail.load(std::memory_order_relaxed)) {
+            consumerWaiting.store(0, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    // Called after the poll returns; woken = dataFd was reported readable, so the pending
+    // eventfd count is consumed and the descriptor stops polling readable
+    void disarmConsumerWait(bool woken) {
+        consumerWaiting.store(0, std::memory_order_relaxed);
+        if (woken) {
+            sleepOn(dataFd);
+        }
+    }
+
+private:
+    void publish(uint64_t h) {
+        if (h == head.load(std::memory_order_relaxed)) return;
+        head.store(h, std::memory_order_seq_cst);
+        if (consumerWaiting.load(std::memory_order_seq_cst)) {
+            signal(dataFd);
+        }
+    }
+};
+
+enum class IpcTransport {
+    None,       // closed channel (headless instances)
+    Pipe,       // anonymous pipe, one length-prefixed frame per message
+    UnixSocket, // SOCK_SEQPACKET socket pair, one packet per message
+    SharedRing  // ShmRing in shared memory
+};
+
+// One direction of process-to-process messaging. Created in main() before the forks and
+// copied into the processes by value; every message is delivered whole, in order, on
+// every transport. Pipe messages travel as length-prefixed frames of at most
+// kMaxMessageSize bytes; each channel has a single writer, so frames never interleave.
+// Socket messages are packets, so the kernel keeps the boundaries and no framing is needed.
+class IpcChannel {
+public:
+    static const uint32_t kMaxMessageSize = 1024;
+    static const uint32_t kDefaultSlots = 1024;
+    static const int kPipeBatchFrames = 64; // frames per writev() on pipes (2 iovecs each)
+    static const int kSocketBatch = 64;     // packets per sendmmsg() on sockets
+
+private:
+    IpcTransport transport;
+    int fds[2];
+    ShmRing* ring;
+    uint32_t messageSizeHint; // typical message size, only used to estimate pipe backlog
+
+    // Consumer-side pipe reassembly for tryRead(): bytes of frames not yet returned
+    std::vector<char> pending;
+    size_t pendingOffset;
+    bool readNonBlocking;
+    long resyncs;
+
+    static bool readFully(int fd, void* buffer, size_t length) {
+        char* out = static_cast<char*>(buffer);
+        while (length > 0) {
+            ssize_t n = ::read(fd, out, length);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            out += n;
+            length -= n;
+        }
+        return true;
+    }
+
+    // sendmmsg() in chunks of kSocketBatch; returns the number sent, -1 if none on an error
+    ssize_t sendPackets(const struct iovec* messages, int count, bool wait) {
+        struct mmsghdr packets[kSocketBatch];
+        int sent = 0;
+        while (sent < count) {
+            int n = count - sent < kSocketBatch ? count - sent : kSocketBatch;
+            memset(packets, 0, sizeof(packets[0]) * n);
+            for (int i = 0; i < n; i++) {
+                packets[i].msg_hdr.msg_iov = const_cast<struct iovec*>(&messages[sent + i]);
+                packets[i].msg_hdr.msg_iovlen = 1;
+            }
+            int result = sendmmsg(fds[1], packets, n, MSG_NOSIGNAL | (wait ? 0 : MSG_DONTWAIT));
+            if (result < 0 && errno == EINTR) continue;
+            if (result < 0) {
+                if (!wait && errno == EAGAIN) return sent;
+                return sent > 0 ? sent : -1;
+            }
+            sent += result;
+        }
+        return sent;
+    }
+
+    // recv() of one packet; returns its full length even if it was cut to capacity
+    ssize_t receivePacket(void* buffer, size_t capacity, bool wait) {
+        while (true) {
+            ssize_t n = recv(fds[0], buffer, capacity, MSG_TRUNC | (wait ? 0 : MSG_DONTWAIT));
+            if (n < 0 && errno == EINTR) continue;
+            if (n == 0) errno = EPIPE; // every writer has gone
+            return n > 0 ? n : -1;
+        }
+    }
+
+    // writev() until every byte is out; the iovecs are modified. False on error/EAGAIN.
+    bool writeAll(struct iovec* iov, int count) {
+        while (count > 0) {
+            ssize_t n = writev(fds[1], iov, count);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) return false;
+            while (count > 0 && static_cast<size_t>(n) >= iov->iov_len) {
+                n -= iov->iov_len;
+                iov++;
+                count--;
+            }
+            if (count > 0) {
+                iov->iov_base = static_cast<char*>(iov->iov_base) + n;
+                iov->iov_len -= n;
+            }
+        }
+        return true;
+    }
+
+public:
+    IpcChannel() : transport(IpcTransport::None), ring(nullptr), messageSizeHint(1), pendingOffset(0),
+                   readNonBlocking(false), resyncs(0) {
+        fds[0] = fds[1] = -1;
+    }
+
+    bool create(IpcTransport kind, uint32_t messageSize, uint32_t slots = kDefaultSlots) {
+        transport = kind;
+        messageSizeHint = messageSize > 0 ? messageSize : 1;
+        if (kind == IpcTransport::Pipe) {
+            return pipe(fds) == 0;
+        }
+        if (kind == IpcTransport::UnixSocket) {
+            if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) != 0) return false;
+            // Room for about as many messages as a ring has slots (the kernel caps this at
+            // net.core.wmem_max)
+            int bufferBytes = static_cast<int>(slots * kMaxMessageSize);
+            setsockopt(fds[1], SOL_SOCKET, SO_SNDBUF, &bufferBytes, sizeof(bufferBytes));
+            return true;
+        }
+        if (kind == IpcTransport::SharedRing) {
+            ring = ShmRing::create(kMaxMessageSize, slots);
+            return ring != nullptr;
+        }
+        return true;
+    }
+
+    void close() {
+        if (transport == IpcTransport::Pipe || transport == IpcTransport::UnixSocket) {
+            if (fds[0] >= 0) ::close(fds[0]);
+            if (fds[1] >= 0) ::close(fds[1]);
+        } else if (transport == IpcTransport::SharedRing) {
+            ShmRing::destroy(ring);
+        }
+        transport = IpcTransport::None;
+        fds[0] = fds[1] = -1;
+        ring = nullptr;
+    }
+
+    bool isOpen() const { return transport != IpcTransport::None; }
+    IpcTransport kind() const { return transport; }
+
+    // Blocks while the channel is full. Returns length, or -1 on error.
+    ssize_t write(const void* message, size_t length) {
+        struct iovec iov = {const_cast<void*>(message), length};
+        return writeBatch(&iov, 1, true) == 1 ? static_cast<ssize_t>(length) : -1;
+    }
+
+    // Never blocks; returns -1 with EAGAIN if the message does not fit right now
+    ssize_t tryWrite(const void* message, size_t length) {
+        struct iovec iov = {const_cast<void*>(message), length};
+        ssize_t sent = writeBatch(&iov, 1, false);
+        if (sent == 1) return static_cast<ssize_t>(length);
+        if (sent == 0) errno = EAGAIN;
+        return -1;
+    }
+
+    // Sends count messages, one per iovec, and returns the number sent. A ring publishes the
+    // whole batch with a single wakeup. A pipe sends up to kPipeBatchFrames frames per
+    // writev(), which may exceed PIPE_BUF; that is safe because each channel has a single
+    // writer and readers reassemble frames. A socket sends up to kSocketBatch packets per
+    // sendmmsg(). With wait false nothing blocks and the count of messages that fit is
+    // returned (pipe frames are then sent one by one, each below PIPE_BUF, so a frame is
+    // never left half written).
+    ssize_t writeBatch(const struct iovec* messages, int count, bool wait = true) {
+        if (transport == IpcTransport::SharedRing) {
+            return ring->push(messages, count, wait);
+        }
+        if (transport != IpcTransport::Pipe && transport != IpcTransport::UnixSocket) {
+            errno = EBADF;
+            return -1;
+        }
+        for (int i = 0; i < count; i++) {
+            if (messages[i].iov_len > kMaxMessageSize) {
+                errno = EMSGSIZE;
+                return -1;
+            }
+        }
+        if (transport == IpcTransport::UnixSocket) {
+            return sendPackets(messages, count, wait);
+        }
+        if (!wait) {
+            // Queued bytes say little about free space (the pipe fills page by page), so let
+            // the kernel decide
+            int flags = fcntl(fds[1], F_GETFL);
+            fcntl(fds[1], F_SETFL, flags | O_NONBLOCK);
+            int sent = 0;
+            for (; sent < count; sent++) {
+                uint32_t length = static_cast<uint32_t>(messages[sent].iov_len);
+                struct iovec frame[2] = {{&length, sizeof(length)}, messages[sent]};
+                if (!writeAll(frame, 2)) break;
+            }
+            int savedErrno = errno;
+            fcntl(fds[1], F_SETFL, flags);
+            errno = savedErrno;
+            return sent;
+        }
+        uint32_t lengths[kPipeBatchFrames];
+        struct iovec frames[2 * kPipeBatchFrames];
+        for (int first = 0; first < count; first += kPipeBatchFrames) {
+            int n = count - first < kPipeBatchFrames ? count - first : kPipeBatchFrames;
+            for (int i = 0; i < n; i++) {
+                lengths[i] = static_cast<uint32_t>(messages[first + i].iov_len);
+                frames[2 * i] = {&lengths[i], sizeof(uint32_t)};
+                frames[2 * i + 1] = messages[first + i];
+            }
+            if (!writeAll(frames, 2 * n)) return first > 0 ? first : -1;
+        }
+        return count;
+    }
+
+    // Blocks until a message arrives. Copies at most capacity bytes and returns the
+    // message length, or -1 on error/EOF.
+    ssize_t read(void* buffer, size_t capacity) {
+        if (transport == IpcTransport::SharedRing) {
+            return ring->pop(buffer, capacity, true);
+        }
+        if (transport == IpcTransport::UnixSocket) {
+            return receivePacket(buffer, capacity, true);
+        }
+        if (transport != IpcTransport::Pipe) {
+            errno = EBADF;
+            return -1;
+        }
+        uint32_t length;
+        if (!readFully(fds[0], &length, sizeof(length))) return -1;
+        char discard[kMaxMessageSize];
+        size_t kept = length < capacity ? length : capacity;
+        if (!readFully(fds[0], buffer, kept)) return -1;
+        if (length > kept && !readFully(fds[0], discard, length - kept)) return -1;
+        return length;
+    }
+
+    // Never blocks. Returns the next whole message like read(), or -1 with EAGAIN if none is
+    // complete yet (EPIPE once every writer has gone). Pipe bytes are pulled in PIPE_BUF
+    // chunks and reassembled here, so a frame split across reads is returned once complete.
+    // A consumer uses either read() or tryRead() on a channel, not both.
+    ssize_t tryRead(void* buffer, size_t capacity) {
+        if (transport == IpcTransport::SharedRing) {
+            return ring->pop(buffer, capacity, false);
+        }
+        if (transport == IpcTransport::UnixSocket) {
+            return receivePacket(buffer, capacity, false);
+        }
+        if (transport != IpcTransport::Pipe) {
+            errno = EBADF;
+            return -1;
+        }
+        if (!readNonBlocking) {
+            fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+            readNonBlocking = true;
+        }
+        while (true) {
+            size_t available = pending.size() - pendingOffset;
+            uint32_t length;
+            if (available >= sizeof(length)) {
+                memcpy(&length, &pending[pendingOffset], sizeof(length));
+                if (length > kMaxMessageSize) {
+                    resync(); // not a frame boundary
+                    continue;
+                }
+                if (available >= sizeof(length) + length) {
+                    memcpy(buffer, &pending[pendingOffset + sizeof(length)], length < capacity ? length : capacity);
+                    pendingOffset += sizeof(length) + length;
+                    if (pendingOffset == pending.size()) {
+                        pending.clear();
+                        pendingOffset = 0;
+                    }
+                    return length;
+                }
+            }
+            if (pendingOffset > 0) {
+                pending.erase(pending.begin(), pending.begin() + pendingOffset);
+                pendingOffset = 0;
+            }
+            char chunk[PIPE_BUF];
+            ssize_t n = ::read(fds[0], chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR) continue;
+            if (n == 0) errno = EPIPE;
+            if (n <= 0) return -1;
+            pending.insert(pending.end(), chunk, chunk + n);
+        }
+    }
+
+    // Pipe frames carry no marker to find a boundary by, so a consumer restarted after its
+    // predecessor died mid-frame starts reading in the middle of one. tryRead() calls this on
+    // a length no frame can have, and consumers call it when a message fails to decode: it
+    // throws away everything buffered and queued, and reading realigns at the writer's next
+    // frame. The messages discarded with it are lost. No-op on rings and sockets, which keep
+    // message boundaries themselves, and for read() consumers.
+    void resync() {
+        if (transport != IpcTransport::Pipe || !readNonBlocking) return;
+        pending.clear();
+        pendingOffset = 0;
+        char chunk[PIPE_BUF];
+        ssize_t n;
+        while ((n = ::read(fds[0], chunk, sizeof(chunk))) > 0 || (n < 0 && errno == EINTR)) {
+        }
+        resyncs++;
+    }
+
+    long resyncCount() const { return resyncs; }
+
+    // Descriptor that becomes readable when messages may be waiting: the pipe's read end,
+    // the socket's receiving end, or the ring's wakeup eventfd
+    int pollFd() const {
+        if (transport == IpcTransport::Pipe || transport == IpcTransport::UnixSocket) return fds[0];
+        if (transport == IpcTransport::SharedRing) return ring->dataFd;
+        return -1;
+    }
+
+    // Bracket a poll()/epoll_wait() on pollFd(). armWait() returns false if a message is
+    // already waiting, in which case the caller should not sleep.
+    bool armWait() {
+        if (transport == IpcTransport::SharedRing) return ring->armConsumerWait();
+        return true;
+    }
+
+    void disarmWait(bool woken) {
+        if (transport == IpcTransport::SharedRing) ring->disarmConsumerWait(woken);
+    }
+
+    // Messages queued but not yet read (estimated from queued bytes for pipes and sockets)
+    long backlog() const {
+        if (transport == IpcTransport::SharedRing) {
+            return static_cast<long>(ring->size());
+        }
+        int queuedBytes = 0;
+        if ((transport != IpcTransport::Pipe && transport != IpcTransport::UnixSocket) ||
+            ioctl(fds[0], FIONREAD, &queuedBytes) < 0) {
+            return 0;
+        }
+        size_t frameBytes = transport == IpcTransport::Pipe ? sizeof(uint32_t) + messageSizeHint : messageSizeHint;
+        return queuedBytes / static_cast<long>(frameBytes);
+    }
+};
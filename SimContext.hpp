@@ -0,0 +1,50 @@
+#pragma once
+#include <ctime>
+#include <cstdlib>
+#include <random>
+
+// Per-thread simulation context. The interactive simulation runs without one and uses the
+// wall clock, rand() and std::cout as before. A headless replication installs a context on
+// the thread that runs it, which gives it a virtual clock, its own seeded random stream and
+// silent logging, so several replications can run side by side in one process.
+struct SimContext {
+    time_t epoch;          // virtual time at the start of the replication
+    long long elapsedMs;   // advanced by the replication driver
+    std::mt19937 rng;
+    bool logging;
+
+    SimContext(unsigned seed, time_t epoch = 1000000000)
+        : epoch(epoch), elapsedMs(0), rng(seed), logging(false) {}
+
+    static SimContext*& current() {
+        thread_local SimContext* context = nullptr;
+        return context;
+    }
+};
+
+// Installs a context for the lifetime of the scope
+class ScopedSimContext {
+    SimContext* previous;
+public:
+    explicit ScopedSimContext(SimContext& context) : previous(SimContext::current()) {
+        SimContext::current() = &context;
+    }
+    ~ScopedSimContext() {
+        SimContext::current() = previous;
+    }
+};
+
+inline time_t simTime() {
+    SimContext* context = SimContext::current();
+    return context ? context->epoch + context->elapsedMs / 1000 : time(nullptr);
+}
+
+inline int simRand() {
+    SimContext* context = SimContext::current();
+    return context ? static_cast<int>(context->rng() & 0x7fffffff) : rand();
+}
+
+inline bool simLogging() {
+    SimContext* context = SimContext::current();
+    return !context || context->logging;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+// Bounded single-producer/single-consumer queue between two threads of one process.
+// push() and pop() never block and never take a lock: each side owns one index and
+// publishes it with a release store the other side reads with an acquire load.
+template <typename T>
+class SpscQueue {
+private:
+    static const size_t kCacheLine = 64;
+
+    std::vector<T> slots;
+    size_t mask;
+    alignas(kCacheLine) std::atomic<size_t> head; // next slot to pop, consumer-owned
+    alignas(kCacheLine) std::atomic<size_t> tail; // next slot to push, producer-owned
+
+public:
+    // capacity is rounded up to a power of two
+    explicit SpscQueue(size_t capacity) : head(0), tail(0) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    // Producer side; false if the queue is full
+    bool push(const T& value) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == slots.size()) return false;
+        slots[t & mask] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side; false if the queue is empty
+    bool pop(T& value) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        value = slots[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
@@ -4,74 +4,462 @@
 #include <unistd.h>
 #include <cstring>
 #include <ctime>
+#include <deque>
+#include <vector>
+#include <pthread.h>
+#include <poll.h>
 #include "MsgStructs.hpp"
+#include "ShmRing.hpp"
+#include "BroadcastLog.hpp"
+#include "WireFormat.hpp"
+#include "PaymentGateway.hpp"
+#include "PaymentJournal.hpp"
+#include "Heartbeat.hpp"
 
+struct StripeOptions {
+    int workers = 4;          // payments charged concurrently
+    int maxInFlight = 32;     // read from the log but not yet confirmed; reading pauses beyond this
+    int maxAttempts = 3;      // charges per AVN before it is reported "failed"
+    int retryBackoffMs = 100; // doubled after every declined attempt
+    JournalOptions journal;   // where settled payments are recorded
+};
+
+// Settles fines from the AVN broadcast logs, one per generator shard, read as one stream.
+// Each confirmation goes back to the shard that issued the AVN; the airline portal gets all
+// of them on one channel. The reader thread (run()) turns each notice
+// into a payment and hands it to worker (avnId % workers), so every payment for an AVN goes
+// through the same FIFO worker. Workers call the gateway concurrently and queue their
+// results; one sender thread records them in the payment journal and then writes the
+// confirmations, in completion order, to both channels (each channel has a single writer).
+// The sender never blocks on a generator shard, which may be waiting for this process to
+// read its log; confirmations a shard has no room for are queued and retried.
+// With the journal in sync mode no confirmation leaves before its payment is on disk.
+// An AVN is charged once: a notice for an AVN that is in flight or already paid (this run
+// or, per the journal, an earlier one) is skipped; a failed AVN may be charged again.
 class StripePayment {
 private:
-    int avn_to_stripe[2];
-    int stripe_to_avn[2];
-    int stripe_to_airline[2];
+    // A payment and the generator shard whose AVN it settles
+    struct Payment {
+        PaymentRequest request;
+        int shard;
+        TraceContext trace;
+        int64_t readNs;         // notice read from the log (traced payments only)
+    };
 
-public:
-    StripePayment(int* avn_to_stripe, int* stripe_to_avn, int* stripe_to_airline) {
-        // Initialize pipe file descriptors
-        this->avn_to_stripe[0] = avn_to_stripe[0];
-        this->avn_to_stripe[1] = avn_to_stripe[1];
-        this->stripe_to_avn[0] = stripe_to_avn[0];
-        this->stripe_to_avn[1] = stripe_to_avn[1];
-        this->stripe_to_airline[0] = stripe_to_airline[0];
-        this->stripe_to_airline[1] = stripe_to_airline[1];
+    struct Completion {
+        PaymentRequest request;
+        int shard;
+        bool approved;
+        int attempts;
+        std::string reason;
+        TraceContext trace;
+        int64_t chargedNs;      // gateway done (traced payments only)
+    };
+
+    struct Worker {
+        StripePayment* owner;
+        pthread_t thread;
+        pthread_cond_t ready;
+        std::deque<Payment> queue;
+    };
+
+    BroadcastMerge notices;  // AVN notices from the generator shards' broadcast logs
+    std::vector<IpcChannel> stripe_to_avn; // confirmations, one channel per shard
+    std::vector<std::deque<std::string>> unsentConfirmations; // by shard, sender thread only
+    IpcChannel stripe_to_airline;
+    PaymentGateway* gateway;
+    StripeOptions options;
+    PaymentJournal journal;
+
+    // One mutex for the worker queues, the completion queue and the in-flight count; it is
+    // never held while charging or writing
+    pthread_mutex_t mutex;
+    pthread_cond_t slotFree;
+    pthread_cond_t completionReady;
+    std::vector<Worker*> workers;
+    std::deque<Completion> completions;
+    AvnIdSet charged;   // AVNs in flight or paid
+    int inFlight;
+    bool stopping;      // no more payments will be dispatched
+    bool workersDone;   // every worker has exited
+    pthread_t senderThread;
+
+    static const size_t kConfirmationBatch = 64;
+    static const int kConfirmationRetryMs = 5;
+
+    long paidCount;
+    long failedCount;
+    long retryCount;
+    long duplicateCount;
+    long unrecordedCount; // sender thread: charged, but the journal failed, so never confirmed
+    long refusedCount;    // notices not charged because the journal had failed
+
+    static void* workerThreadFunc(void* arg) {
+        Worker* worker = static_cast<Worker*>(arg);
+        worker->owner->workerLoop(worker);
+        return nullptr;
     }
 
-    void run() {
-        // Process payments received from airline portal
-        std::cout << "StripePayment: Payment processing service started" << std::endl;
-        
-        while(1) {
-            // Read payment request from Airline Portal
-            PaymentRequest paymentRequest;
-            int bytesRead = read(avn_to_stripe[0], &paymentRequest, sizeof(paymentRequest));
-            
-            if (bytesRead > 0) {
-                // Process the payment
-                std::cout << "StripePayment: Processing payment for AVN ID: " << paymentRequest.avnId 
-                          << ", Aircraft: " << paymentRequest.aircraftId
-                          << ", Amount: $" << paymentRequest.totalFine << std::endl;
-                
-                // Simulate payment processing delay
-                sleep(2);
-                
-                // Create payment confirmation
-                PaymentConfirmation confirmation;
-                confirmation.avnId = paymentRequest.avnId;
-                strncpy(confirmation.status, "paid", sizeof(confirmation.status) - 1);
-                confirmation.status[sizeof(confirmation.status) - 1] = '\0'; // Ensure null termination
-                
-                // Send confirmation to AVN Generator
-                write(stripe_to_avn[1], &confirmation, sizeof(confirmation));
-                std::cout << "StripePayment: Payment confirmation sent to AVN Generator for AVN ID: " 
-                          << confirmation.avnId << std::endl;
-                
-                // Send confirmation to Airline Portal
-                write(stripe_to_airline[1], &confirmation, sizeof(confirmation));
-                std::cout << "StripePayment: Payment confirmation sent to Airline Portal for AVN ID: " 
-                          << confirmation.avnId << std::endl;
-                
-                // Record payment in a log file
-                FILE* file = fopen("payment_log.txt", "a");
-                if (file) {
-                    time_t now = time(0);
-                    fprintf(file, "Payment processed - AVN ID: %d, Aircraft ID: %d, Type: %s, Amount: $%.2f, Time: %s",
-                            confirmation.avnId, paymentRequest.aircraftId, paymentRequest.aircraftType, 
-                            paymentRequest.totalFine, ctime(&now));
-                    fclose(file);
+    static void* senderThreadFunc(void* arg) {
+        static_cast<StripePayment*>(arg)->senderLoop();
+        return nullptr;
+    }
+
+    void workerLoop(Worker* worker) {
+        while (true) {
+            pthread_mutex_lock(&mutex);
+            while (worker->queue.empty() && !stopping) {
+                pthread_cond_wait(&worker->ready, &mutex);
+            }
+            if (worker->queue.empty()) {
+                pthread_mutex_unlock(&mutex);
+                return;
+            }
+            Payment payment = worker->queue.front();
+            worker->queue.pop_front();
+            pthread_mutex_unlock(&mutex);
+
+            Completion completion = charge(payment);
+
+            pthread_mutex_lock(&mutex);
+            completions.push_back(completion);
+            pthread_cond_signal(&completionReady);
+            pthread_mutex_unlock(&mutex);
+        }
+    }
+
+    Completion charge(const Payment& payment) {
+        const PaymentRequest& request = payment.request;
+        Completion completion = {request, payment.shard, false, 0, "", payment.trace, 0};
+        int64_t startNs = payment.trace.traceId ? traceClockNs() : 0;
+        traceSpan(TraceStage::StripeQueue, payment.trace, payment.readNs, startNs);
+        int backoffMs = options.retryBackoffMs;
+        while (completion.attempts < options.maxAttempts) {
+            completion.attempts++;
+            PaymentResult result = gateway->charge(request);
+            completion.approved = result.approved;
+            completion.reason = result.reason;
+            if (result.approved || completion.attempts == options.maxAttempts) break;
+            if (backoffMs > 0) {
+                usleep(backoffMs * 1000);
+                backoffMs *= 2;
+            }
+        }
+        if (payment.trace.traceId) {
+            completion.chargedNs = traceClockNs();
+            traceSpan(TraceStage::GatewayCharge, payment.trace, startNs, completion.chargedNs);
+        }
+        return completion;
+    }
+
+    void senderLoop() {
+        std::vector<Completion> batch;
+        bool backlog = false; // confirmations queued for a shard that had no room
+        while (true) {
+            pthread_mutex_lock(&mutex);
+            while (completions.empty() && !workersDone) {
+                if (!backlog) {
+                    pthread_cond_wait(&completionReady, &mutex);
+                    continue;
+                }
+                timespec deadline = deadlineIn(kConfirmationRetryMs);
+                pthread_cond_timedwait(&completionReady, &mutex, &deadline);
+                pthread_mutex_unlock(&mutex);
+                backlog = !flushConfirmations(false);
+                pthread_mutex_lock(&mutex);
+            }
+            if (completions.empty()) {
+                pthread_mutex_unlock(&mutex);
+                // When stopping, the shards may already be gone: the journal has the payments
+                if (!flushConfirmations(!stopRequested())) {
+                    std::cerr << "StripePayment: some confirmations could not be sent to the AVN Generator" << std::endl;
+                }
+                return;
+            }
+            batch.assign(completions.begin(), completions.end());
+            completions.clear();
+            pthread_mutex_unlock(&mutex);
+
+            long unrecordedBefore = unrecordedCount;
+            backlog = !sendConfirmations(batch);
+            bool recorded = unrecordedCount == unrecordedBefore;
+
+            pthread_mutex_lock(&mutex);
+            inFlight -= static_cast<int>(batch.size());
+            for (const Completion& completion : batch) {
+                if (!recorded) {
+                    // Counted as unrecorded; keep it in charged either way
+                } else if (completion.approved) {
+                    paidCount++;
                 } else {
-                    std::cerr << "Failed to open payment_log.txt for writing" << std::endl;
+                    failedCount++;
+                    charged.erase(completion.request.avnId);
+                }
+                retryCount += completion.attempts - 1;
+            }
+            pthread_cond_broadcast(&slotFree);
+            pthread_mutex_unlock(&mutex);
+        }
+    }
+
+    // Returns false if some confirmations are still queued for a full shard channel
+    bool sendConfirmations(const std::vector<Completion>& batch) {
+        // Record the payments first; the whole batch shares one journal commit
+        timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        uint64_t lastSequence = 0;
+        for (const Completion& completion : batch) {
+            PaymentRecord record;
+            record.avnId = completion.request.avnId;
+            record.approved = completion.approved;
+            record.attempts = completion.attempts;
+            record.amount = completion.request.totalFine;
+            record.aircraftId = completion.request.aircraftId;
+            record.aircraftType = completion.request.aircraftType;
+            record.reason = completion.reason;
+            record.timeNs = now.tv_sec * 1000000000LL + now.tv_nsec;
+            lastSequence = journal.append(record);
+        }
+        // A confirmation is a promise that the payment survives a restart. Once the journal has
+        // failed it records nothing more, so hold the confirmations back; the AVNs stay in
+        // charged so they are not charged a second time either.
+        if (!journal.waitDurable(lastSequence) || journal.hasFailed()) {
+            std::cerr << "StripePayment: the payment journal failed, holding back " << batch.size()
+                      << " confirmation(s) up to journal record " << lastSequence << std::endl;
+            for (const Completion& completion : batch) {
+                std::cerr << "StripePayment: AVN ID " << completion.request.avnId << " "
+                          << (completion.approved ? "charged" : "declined") << " but not recorded" << std::endl;
+            }
+            unrecordedCount += static_cast<long>(batch.size());
+            return true;
+        }
+
+        std::string frames;
+        std::vector<size_t> ends;
+        int64_t sentNs = traceClockNs();
+        for (const Completion& completion : batch) {
+            traceSpan(TraceStage::JournalCommit, completion.trace, completion.chargedNs, sentNs);
+            PaymentConfirmation confirmation;
+            confirmation.avnId = completion.request.avnId;
+            confirmation.status = completion.approved ? "paid" : "failed";
+            confirmation.trace = traceForward(completion.trace, sentNs);
+            encode(frames, confirmation);
+            ends.push_back(frames.size());
+            std::cout << "StripePayment: AVN ID " << confirmation.avnId << " " << confirmation.status
+                      << " after " << completion.attempts << " attempt(s)" << std::endl;
+        }
+
+        std::vector<struct iovec> vectors(ends.size());
+        size_t start = 0;
+        for (size_t i = 0; i < ends.size(); i++) {
+            vectors[i] = {&frames[start], ends[i] - start};
+            start = ends[i];
+        }
+        int count = static_cast<int>(vectors.size());
+
+        // Send confirmations to the Airline Portal. It only displays them, so never block on it.
+        stripe_to_airline.writeBatch(vectors.data(), count, false);
+
+        // Queue confirmations for the AVN Generator shards, each in completion order, and send
+        // what fits. Never block on a shard: it may be waiting for this process to read its
+        // broadcast log, which stops if the in-flight payments are never confirmed.
+        for (int i = 0; i < count; i++) {
+            unsentConfirmations[batch[i].shard].emplace_back(static_cast<const char*>(vectors[i].iov_base), vectors[i].iov_len);
+        }
+        return flushConfirmations(false);
+    }
+
+    // Sender thread. Writes queued confirmations to their shards; true once none are left.
+    bool flushConfirmations(bool wait) {
+        bool flushed = true;
+        std::vector<struct iovec> vectors;
+        for (size_t shard = 0; shard < stripe_to_avn.size(); shard++) {
+            std::deque<std::string>& queue = unsentConfirmations[shard];
+            while (!queue.empty()) {
+                vectors.clear();
+                for (size_t i = 0; i < queue.size() && vectors.size() < kConfirmationBatch; i++) {
+                    vectors.push_back({&queue[i][0], queue[i].size()});
                 }
+                ssize_t sent = stripe_to_avn[shard].writeBatch(vectors.data(), static_cast<int>(vectors.size()), wait);
+                if (sent > 0) queue.erase(queue.begin(), queue.begin() + sent);
+                if (sent < static_cast<ssize_t>(vectors.size())) break;
             }
-            
-            // Small delay to avoid busy waiting
-            usleep(100000);
+            if (!queue.empty()) flushed = false;
+        }
+        return flushed;
+    }
+
+    static timespec deadlineIn(int ms) {
+        timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += ms / 1000;
+        deadline.tv_nsec += (ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        return deadline;
+    }
+
+    // Next notice from any shard's broadcast log and the shard it came from, waking at least
+    // once per heartbeat interval; 0 once every shard has closed its log, or once the logs are
+    // drained after the supervisor asked us to stop
+    ssize_t nextNotice(char* frame, size_t capacity, int& shard) {
+        std::vector<struct pollfd> fds;
+        while (true) {
+            ssize_t length = notices.tryRead(frame, capacity, &shard);
+            if (length >= 0 || errno != EAGAIN) return length;
+            if (stopRequested()) return 0;
+            fds.clear();
+            if (processStopFd() >= 0) fds.push_back({processStopFd(), POLLIN, 0});
+            if (notices.armWait(fds) && poll(fds.data(), fds.size(), heartbeatTimeout(-1)) < 0) {
+                for (struct pollfd& fd : fds) fd.revents = 0;
+            }
+            notices.disarmWait(fds);
+            heartbeat();
+        }
+    }
+
+    // Returns false (and dispatches nothing) if the AVN is already in flight or paid
+    bool dispatch(const Payment& payment) {
+        const PaymentRequest& request = payment.request;
+        pthread_mutex_lock(&mutex);
+        if (!charged.insert(request.avnId)) {
+            duplicateCount++;
+            pthread_mutex_unlock(&mutex);
+            return false;
+        }
+        while (inFlight >= options.maxInFlight) {
+            // Backpressure from the gateway or the generator; keep beating while it lasts
+            timespec deadline = deadlineIn(heartbeatTimeout(1000));
+            pthread_cond_timedwait(&slotFree, &mutex, &deadline);
+            heartbeat();
+        }
+        inFlight++;
+        Worker* worker = workers[request.avnId % workers.size()];
+        worker->queue.push_back(payment);
+        pthread_cond_signal(&worker->ready);
+        pthread_mutex_unlock(&mutex);
+        return true;
+    }
+
+public:
+    StripePayment(const BroadcastMerge& notices, const std::vector<IpcChannel>& stripe_to_avn, const IpcChannel& stripe_to_airline,
+                  PaymentGateway* gateway = nullptr, const StripeOptions& options = StripeOptions())
+        : notices(notices), stripe_to_avn(stripe_to_avn), unsentConfirmations(stripe_to_avn.size()),
+          stripe_to_airline(stripe_to_airline),
+          gateway(gateway ? gateway : new LocalGateway()), options(options), journal(options.journal), inFlight(0), stopping(false),
+          workersDone(false), paidCount(0), failedCount(0), retryCount(0), duplicateCount(0), unrecordedCount(0), refusedCount(0) {
+        if (this->options.workers < 1) this->options.workers = 1;
+        if (this->options.maxInFlight < 1) this->options.maxInFlight = 1;
+        if (this->options.maxAttempts < 1) this->options.maxAttempts = 1;
+        pthread_mutex_init(&mutex, NULL);
+        pthread_cond_init(&slotFree, NULL);
+        pthread_cond_init(&completionReady, NULL);
+    }
+
+    ~StripePayment() {
+        pthread_cond_destroy(&completionReady);
+        pthread_cond_destroy(&slotFree);
+        pthread_mutex_destroy(&mutex);
+        delete gateway;
+    }
+
+    void run() {
+        traceSetProcess("stripe");
+        std::cout << "StripePayment: Payment processing service started with " << options.workers
+                  << " workers, up to " << options.maxInFlight << " payments in flight" << std::endl;
+        long replayed = journal::replay(options.journal.directory, [&](const PaymentRecord& record) {
+            if (record.approved) charged.insert(record.avnId);
+        });
+        std::cout << "StripePayment: " << charged.size() << " AVNs already paid in " << replayed
+                  << " journal records (" << charged.runCount() << " ID ranges)" << std::endl;
+        if (!journal.open()) {
+            std::cerr << "StripePayment: payment journal unavailable, not processing payments" << std::endl;
+            return;
+        }
+
+        for (int i = 0; i < options.workers; i++) {
+            Worker* worker = new Worker();
+            worker->owner = this;
+            pthread_cond_init(&worker->ready, NULL);
+            workers.push_back(worker);
+            pthread_create(&worker->thread, NULL, workerThreadFunc, worker);
+        }
+        pthread_create(&senderThread, NULL, senderThreadFunc, this);
+
+        heartbeatReady();
+        char frame[IpcChannel::kMaxMessageSize];
+        while (true) {
+            // Read the next AVN notice from the AVN Generator's broadcast log
+            int shard = 0;
+            int bytesRead = nextNotice(frame, sizeof(frame), shard);
+            if (bytesRead <= 0) {
+                break; // every generator shard closed its log, or we are being stopped
+            }
+            AVNNoticeView notice;
+            const char* error = nullptr;
+            if (bytesRead > static_cast<int>(sizeof(frame)) || !decode(frame, bytesRead, notice, &error)) {
+                std::cerr << "StripePayment: dropped invalid notice frame ("
+                          << (error ? error : "oversized") << ")" << std::endl;
+                continue;
+            }
+
+            Payment payment;
+            payment.shard = shard;
+            payment.trace = notice.trace;
+            payment.readNs = notice.trace.traceId ? traceClockNs() : 0;
+            traceSpan(TraceStage::LogToStripe, notice.trace, notice.trace.sentNs, payment.readNs);
+
+            // Only what it takes to collect the fine
+            PaymentRequest& paymentRequest = payment.request;
+            paymentRequest.avnId = notice.avnId;
+            paymentRequest.aircraftId = std::string(notice.aircraftId);
+            paymentRequest.aircraftType = std::string(notice.aircraftType);
+            paymentRequest.totalFine = notice.totalFine;
+            if (journal.hasFailed()) {
+                std::cerr << "StripePayment: not charging AVN ID " << paymentRequest.avnId
+                          << ", the payment journal cannot record it" << std::endl;
+                refusedCount++;
+                continue;
+            }
+            if (!dispatch(payment)) {
+                std::cout << "StripePayment: AVN ID " << paymentRequest.avnId << " already charged, skipping" << std::endl;
+                continue;
+            }
+            std::cout << "StripePayment: Processing payment for AVN ID: " << paymentRequest.avnId
+                      << ", Aircraft: " << paymentRequest.aircraftId
+                      << ", Amount: $" << paymentRequest.totalFine << std::endl;
+        }
+
+        // Finish everything already dispatched, then let the sender drain
+        pthread_mutex_lock(&mutex);
+        stopping = true;
+        for (Worker* worker : workers) {
+            pthread_cond_signal(&worker->ready);
+        }
+        pthread_mutex_unlock(&mutex);
+        for (Worker* worker : workers) {
+            pthread_join(worker->thread, NULL);
+            pthread_cond_destroy(&worker->ready);
+            delete worker;
+        }
+        workers.clear();
+
+        pthread_mutex_lock(&mutex);
+        workersDone = true;
+        pthread_cond_signal(&completionReady);
+        pthread_mutex_unlock(&mutex);
+        pthread_join(senderThread, NULL);
+        journal.close();
+        journal.printStats(std::cout);
+
+        std::cout << "StripePayment: " << paidCount << " paid, " << failedCount << " failed, "
+                  << retryCount << " retries, " << duplicateCount << " duplicate notices skipped" << std::endl;
+        if (unrecordedCount > 0 || refusedCount > 0) {
+            std::cerr << "StripePayment: the payment journal failed: " << unrecordedCount
+                      << " payments were not recorded or confirmed, " << refusedCount
+                      << " notices were not charged" << std::endl;
         }
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,497 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <new>
+#include <iostream>
+#include <iomanip>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <sys/eventfd.h>
+#include "Heartbeat.hpp"
+#include "Trace.hpp"
+
+struct SupervisorOptions {
+    int heartbeatIntervalMs = 250;   // how often children beat (bounds their idle sleeps)
+    int heartbeatTimeoutMs = 10000;  // a ready child silent this long is killed and restarted
+    int startupTimeoutMs = 30000;    // a child not ready this long after its fork likewise
+    int restartBackoffMs = 250;      // delay before the first restart, doubled per repeated failure
+    int maxRestartBackoffMs = 10000;
+    int stableMs = 60000;            // a child up this long starts again from restartBackoffMs
+    int shutdownGraceMs = 3000;      // SIGTERM to SIGKILL in stop()
+    bool restart = true;             // false: report failures but leave the child down
+};
+
+// What the supervisor knows about one child, readable from other threads (the metrics server)
+struct SupervisedProcessStats {
+    std::string name;                      // fixed once added
+    std::atomic<int> pid{0};               // 0 while down
+    std::atomic<bool> up{false};           // running and reported ready
+    std::atomic<long> restarts{0};
+    std::atomic<long> heartbeatKills{0};   // restarts caused by a missed heartbeat or startup
+    std::atomic<long long> startupUs{0};   // fork to ready, latest start
+    std::atomic<long long> maxStartupUs{0};
+    std::atomic<long long> restartUs{0};   // failure detected to replacement ready, latest restart
+    std::atomic<long long> maxRestartUs{0};
+};
+
+// Forks the long-running child processes and keeps them running. Children are watched through
+// pidfds (SIGCHLD on kernels without pidfd_open) so an exit is noticed at once, and through
+// shared-memory heartbeats (Heartbeat.hpp) so a child that is alive but stuck is noticed too.
+// A child that exits with a non-zero status, dies from a signal or stops beating is forked
+// again after a backoff. It is forked from this process, which still holds every ring, pipe
+// and broadcast log reader the first one was started with, so the replacement comes up wired
+// to the same channels. Rings and sockets keep message boundaries across the restart; on
+// pipes (--pipes) a child that died mid-frame leaves its peer misaligned, and the peer's
+// IpcChannel::resync() discards what was queued to find the next frame.
+class Supervisor {
+private:
+    struct Child {
+        SupervisedProcessStats stats;
+        std::function<void()> body;
+        int slot;
+        pid_t pid;              // 0 while down
+        int pidfd;              // -1 while down or without pidfd support
+        bool finished;          // exited cleanly, or failed with restarts off; never forked again
+        bool restartable;       // false: forked once, from start(), and left down if it fails
+        bool ready;             // current incarnation has reported ready
+        bool killed;            // current incarnation was SIGKILLed for going quiet
+        int64_t startedNs;      // fork of the current incarnation
+        int64_t failedNs;       // when the previous incarnation's failure was noticed, 0 if none
+        int64_t restartAtNs;    // pending restart, 0 if none
+        int backoffMs;          // delay before the next restart
+    };
+
+    SupervisorOptions options;
+    std::vector<Child*> children;
+    HeartbeatSlot* slots;   // MAP_SHARED, one per child
+    pid_t parentPid;
+    int wakeFd;             // eventfd: stop() interrupts the monitor
+    bool usePidfd;
+    bool started;
+    std::atomic<bool> stopping;
+    pthread_t monitorThread;
+
+    static const int kMaxChildren = 16;
+
+    static int& sigchldReadFd() {
+        static int fd = -1;
+        return fd;
+    }
+
+    static int& sigchldWriteFd() {
+        static int fd = -1;
+        return fd;
+    }
+
+    static void onSigchld(int) {
+        int saved = errno;
+        char byte = 0;
+        if (write(sigchldWriteFd(), &byte, 1) < 0) {
+            // pipe full: a wakeup is already pending
+        }
+        errno = saved;
+    }
+
+    static int openPidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+        return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#else
+        (void)pid;
+        errno = ENOSYS;
+        return -1;
+#endif
+    }
+
+    // Fallback for kernels without pidfds: SIGCHLD pokes a self-pipe the monitor polls
+    bool installSigchldPipe() {
+        int fds[2];
+        if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0) {
+            perror("Supervisor: pipe");
+            return false;
+        }
+        sigchldReadFd() = fds[0];
+        sigchldWriteFd() = fds[1];
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = onSigchld;
+        action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+        sigemptyset(&action.sa_mask);
+        return sigaction(SIGCHLD, &action, nullptr) == 0;
+    }
+
+    static long long elapsedUs(int64_t fromNs, int64_t toNs) { return (toNs - fromNs) / 1000; }
+
+    static void raiseMax(std::atomic<long long>& max, long long value) {
+        long long current = max.load();
+        while (value > current && !max.compare_exchange_weak(current, value)) {
+        }
+    }
+
+    static std::string describeStatus(int status) {
+        if (WIFEXITED(status)) return "exited with status " + std::to_string(WEXITSTATUS(status));
+        if (WIFSIGNALED(status)) {
+            return "killed by signal " + std::to_string(WTERMSIG(status)) + " (" + strsignal(WTERMSIG(status)) + ")";
+        }
+        return "stopped";
+    }
+
+    bool spawn(Child* child) {
+        HeartbeatSlot& slot = slots[child->slot];
+        int64_t now = heartbeatClockNs();
+        slot.lastBeatNs.store(now);
+        slot.readyNs.store(0);
+        child->startedNs = now;
+        child->ready = false;
+        child->killed = false;
+        child->restartAtNs = 0;
+
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("Supervisor: fork");
+            return false;
+        }
+        if (pid == 0) {
+            runChild(child);
+        }
+        child->pid = pid;
+        child->pidfd = usePidfd ? openPidfd(pid) : -1;
+        child->stats.pid = pid;
+        return true;
+    }
+
+    [[noreturn]] void runChild(Child* child) {
+        // Go down with the supervisor rather than outlive it unsupervised
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        if (getppid() != parentPid) _exit(1);
+
+        // The supervisor's descriptors belong to the parent
+        ::close(wakeFd);
+        for (Child* other : children) {
+            if (other->pidfd >= 0) ::close(other->pidfd);
+        }
+        if (sigchldReadFd() >= 0) {
+            signal(SIGCHLD, SIG_DFL);
+            ::close(sigchldReadFd());
+            ::close(sigchldWriteFd());
+        }
+
+        processHeartbeat().slot = &slots[child->slot];
+        processHeartbeat().intervalMs = options.heartbeatIntervalMs;
+        // stop() asks with SIGTERM; the body sees it through processStopFd() and winds down
+        if (!installStopHandler()) {
+            perror("Supervisor: stop handler");
+        }
+        child->body();
+        // Skip the parent's static destructors: a restarted child was forked after main()
+        // opened its window and shares that display connection. Such a child must not use
+        // the display itself; one that does is added as not restartable.
+        std::cout.flush();
+        std::cerr.flush();
+        fflush(nullptr);
+        traceFlush();
+        _exit(0);
+    }
+
+    // Waits up to timeoutMs for a child to exit (or stop() to be called)
+    void waitForEvents(int timeoutMs) {
+        std::vector<struct pollfd> fds;
+        fds.push_back({wakeFd, POLLIN, 0});
+        if (usePidfd) {
+            for (Child* child : children) {
+                if (child->pidfd >= 0) fds.push_back({child->pidfd, POLLIN, 0});
+            }
+        } else {
+            fds.push_back({sigchldReadFd(), POLLIN, 0});
+        }
+        if (poll(fds.data(), fds.size(), timeoutMs) > 0 && !usePidfd && (fds[1].revents & POLLIN)) {
+            char drain[64];
+            while (read(sigchldReadFd(), drain, sizeof(drain)) > 0) {
+            }
+        }
+    }
+
+    // Reaps every child that has exited; returns how many are still running
+    int reap(int64_t now) {
+        int running = 0;
+        for (Child* child : children) {
+            if (child->pid == 0) continue;
+            int status = 0;
+            pid_t result = waitpid(child->pid, &status, WNOHANG);
+            if (result == 0 || (result < 0 && errno == EINTR)) {
+                running++;
+                continue;
+            }
+            if (result < 0) status = 0; // already reaped elsewhere; nothing to report
+            onExit(child, status, now);
+        }
+        return running;
+    }
+
+    void onExit(Child* child, int status, int64_t now) {
+        if (child->pidfd >= 0) ::close(child->pidfd);
+        child->pidfd = -1;
+        child->pid = 0;
+        child->stats.pid = 0;
+        child->stats.up = false;
+
+        bool failed = child->killed || !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+        if (stopping.load()) {
+            return;
+        }
+        if (!failed) {
+            std::cout << "Supervisor: " << child->stats.name << " exited" << std::endl;
+            child->finished = true;
+            return;
+        }
+        if (!options.restart || !child->restartable) {
+            std::cerr << "Supervisor: " << child->stats.name << " " << describeStatus(status)
+                      << (options.restart ? ", it cannot be restarted" : ", restarts are off") << std::endl;
+            child->finished = true;
+            return;
+        }
+        if (child->ready && (now - child->startedNs) / 1000000 >= options.stableMs) {
+            child->backoffMs = options.restartBackoffMs;
+        }
+        std::cerr << "Supervisor: " << child->stats.name << " " << describeStatus(status)
+                  << ", restarting in " << child->backoffMs << " ms" << std::endl;
+        child->failedNs = now;
+        child->restartAtNs = now + child->backoffMs * 1000000LL;
+        child->backoffMs = std::min(child->backoffMs * 2, options.maxRestartBackoffMs);
+    }
+
+    // Records children that came up, kills those that went quiet
+    void checkHealth(int64_t now) {
+        for (Child* child : children) {
+            if (child->pid == 0 || child->killed) continue;
+            HeartbeatSlot& slot = slots[child->slot];
+            if (!child->ready) {
+                int64_t readyNs = slot.readyNs.load(std::memory_order_acquire);
+                if (readyNs != 0) {
+                    onReady(child, readyNs);
+                } else if (now - child->startedNs > options.startupTimeoutMs * 1000000LL) {
+                    std::cerr << "Supervisor: " << child->stats.name << " not ready after "
+                              << options.startupTimeoutMs << " ms, killing it" << std::endl;
+                    killQuiet(child);
+                }
+                continue;
+            }
+            int64_t silentMs = (now - slot.lastBeatNs.load(std::memory_order_relaxed)) / 1000000;
+            if (silentMs > options.heartbeatTimeoutMs) {
+                std::cerr << "Supervisor: " << child->stats.name << " missed heartbeats for "
+                          << silentMs << " ms, killing it" << std::endl;
+                killQuiet(child);
+            }
+        }
+    }
+
+    void onReady(Child* child, int64_t readyNs) {
+        child->ready = true;
+        child->stats.up = true;
+        long long startupUs = elapsedUs(child->startedNs, readyNs);
+        child->stats.startupUs = startupUs;
+        raiseMax(child->stats.maxStartupUs, startupUs);
+        if (child->failedNs != 0) {
+            long long restartUs = elapsedUs(child->failedNs, readyNs);
+            child->stats.restartUs = restartUs;
+            raiseMax(child->stats.maxRestartUs, restartUs);
+            child->failedNs = 0;
+            std::cout << "Supervisor: " << child->stats.name << " restarted as pid " << child->pid
+                      << ", serving " << restartUs / 1000.0 << " ms after the failure" << std::endl;
+        }
+    }
+
+    void killQuiet(Child* child) {
+        child->killed = true;
+        child->stats.heartbeatKills++;
+        kill(child->pid, SIGKILL);
+    }
+
+    void monitorLoop() {
+        while (!stopping.load()) {
+            int64_t now = heartbeatClockNs();
+            reap(now);
+            checkHealth(now);
+
+            int timeoutMs = options.heartbeatIntervalMs;
+            for (Child* child : children) {
+                if (child->finished || child->pid != 0 || child->restartAtNs == 0) continue;
+                if (now >= child->restartAtNs) {
+                    child->stats.restarts++;
+                    if (!spawn(child)) {
+                        child->failedNs = child->failedNs ? child->failedNs : now;
+                        child->restartAtNs = now + child->backoffMs * 1000000LL;
+                        child->backoffMs = std::min(child->backoffMs * 2, options.maxRestartBackoffMs);
+                    }
+                    continue;
+                }
+                int untilMs = static_cast<int>((child->restartAtNs - now + 999999) / 1000000);
+                if (untilMs < timeoutMs) timeoutMs = untilMs;
+            }
+            waitForEvents(timeoutMs);
+        }
+    }
+
+    static void* monitorThreadFunc(void* arg) {
+        static_cast<Supervisor*>(arg)->monitorLoop();
+        return nullptr;
+    }
+
+public:
+    explicit Supervisor(const SupervisorOptions& options = SupervisorOptions())
+        : options(options), slots(nullptr), parentPid(getpid()), wakeFd(-1), usePidfd(false),
+          started(false), stopping(false) {
+        if (this->options.heartbeatIntervalMs < 1) this->options.heartbeatIntervalMs = 1;
+        if (this->options.restartBackoffMs < 1) this->options.restartBackoffMs = 1;
+        if (this->options.maxRestartBackoffMs < this->options.restartBackoffMs) {
+            this->options.maxRestartBackoffMs = this->options.restartBackoffMs;
+        }
+    }
+
+    ~Supervisor() {
+        stop();
+        for (Child* child : children) delete child;
+        if (slots) munmap(slots, sizeof(HeartbeatSlot) * kMaxChildren);
+    }
+
+    // Registers a child; body runs in the forked process, which exits when it returns.
+    // Call before start(). A child that is not restartable is only ever forked by start():
+    // one that opens a window must be, since a later fork would inherit the X connection of
+    // whatever window this process has opened since and write to it alongside this process.
+    bool add(const std::string& name, const std::function<void()>& body, bool restartable = true) {
+        if (started || children.size() >= static_cast<size_t>(kMaxChildren)) return false;
+        Child* child = new Child();
+        child->stats.name = name;
+        child->body = body;
+        child->slot = static_cast<int>(children.size());
+        child->pid = 0;
+        child->pidfd = -1;
+        child->finished = false;
+        child->restartable = restartable;
+        child->ready = false;
+        child->killed = false;
+        child->startedNs = 0;
+        child->failedNs = 0;
+        child->restartAtNs = 0;
+        child->backoffMs = options.restartBackoffMs;
+        children.push_back(child);
+        return true;
+    }
+
+    // Forks every child from the calling thread, then watches them from a monitor thread
+    bool start() {
+        if (started) return false;
+        void* memory = mmap(nullptr, sizeof(HeartbeatSlot) * kMaxChildren, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            perror("Supervisor: mmap heartbeats");
+            return false;
+        }
+        slots = new (memory) HeartbeatSlot[kMaxChildren];
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wakeFd < 0) {
+            perror("Supervisor: eventfd");
+            return false;
+        }
+        int probe = openPidfd(getpid());
+        usePidfd = probe >= 0;
+        if (usePidfd) {
+            ::close(probe);
+        } else if (!installSigchldPipe()) {
+            return false;
+        }
+        parentPid = getpid();
+        started = true;
+
+        for (Child* child : children) {
+            if (!spawn(child) && !child->restartable) {
+                std::cerr << "Supervisor: " << child->stats.name << " did not start and cannot be restarted" << std::endl;
+                child->finished = true;
+            } else if (child->pid == 0) {
+                child->failedNs = heartbeatClockNs();
+                child->restartAtNs = child->failedNs + child->backoffMs * 1000000LL;
+            }
+        }
+        if (pthread_create(&monitorThread, NULL, monitorThreadFunc, this) != 0) {
+            std::cerr << "Supervisor: monitor thread failed, children are unsupervised" << std::endl;
+            stopping = true;
+        }
+        return true;
+    }
+
+    // Stops supervising, then SIGTERMs the children, waits up to the grace period for them to
+    // exit and SIGKILLs whatever is left. The SIGTERM only requests a stop (Heartbeat.hpp): a
+    // child's loop notices it, flushes and closes its outputs and returns. Safe to call more
+    // than once.
+    void stop() {
+        if (!started || stopping.exchange(true)) return;
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) < 0) {
+            perror("Supervisor: wake monitor");
+        }
+        pthread_join(monitorThread, NULL);
+        // Count startups completed since the monitor's last pass
+        for (Child* child : children) {
+            int64_t readyNs = slots[child->slot].readyNs.load(std::memory_order_acquire);
+            if (child->pid != 0 && !child->ready && readyNs != 0) onReady(child, readyNs);
+        }
+        if (read(wakeFd, &one, sizeof(one)) < 0) {
+            // nothing pending
+        }
+
+        for (Child* child : children) {
+            if (child->pid != 0) kill(child->pid, SIGTERM);
+        }
+        int64_t deadline = heartbeatClockNs() + options.shutdownGraceMs * 1000000LL;
+        int64_t now;
+        while (reap(now = heartbeatClockNs()) > 0 && now < deadline) {
+            waitForEvents(static_cast<int>((deadline - now + 999999) / 1000000));
+        }
+        for (Child* child : children) {
+            if (child->pid == 0) continue;
+            std::cerr << "Supervisor: " << child->stats.name << " ignored SIGTERM, killing it" << std::endl;
+            kill(child->pid, SIGKILL);
+            int status;
+            while (waitpid(child->pid, &status, 0) < 0 && errno == EINTR) {
+            }
+            onExit(child, status, heartbeatClockNs());
+        }
+        ::close(wakeFd);
+        wakeFd = -1;
+    }
+
+    size_t processCount() const { return children.size(); }
+    const SupervisedProcessStats& processStats(size_t index) const { return children[index]->stats; }
+
+    void printStats(std::ostream& out) const {
+        for (const Child* child : children) {
+            const SupervisedProcessStats& stats = child->stats;
+            out << "Supervisor: " << stats.name << ": " << std::fixed << std::setprecision(1);
+            if (stats.maxStartupUs.load() > 0) {
+                out << "started in " << stats.startupUs.load() / 1000.0 << " ms (max " << stats.maxStartupUs.load() / 1000.0 << " ms), ";
+            } else {
+                out << "never reported ready, ";
+            }
+            out << stats.restarts.load() << " restarts (" << stats.heartbeatKills.load() << " for missed heartbeats)";
+            if (stats.maxRestartUs.load() > 0) {
+                out << ", back in service " << stats.restartUs.load() / 1000.0 << " ms after the latest failure (max "
+                    << stats.maxRestartUs.load() / 1000.0 << " ms)";
+            }
+            out << std::defaultfloat << std::endl;
+        }
+    }
+};
@@ -0,0 +1,261 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstdint>
+#include <cerrno>
+#include <cctype>
+#include <ctime>
+#include <csignal>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+// End-to-end latency tracing of an AVN, from the radar spotting the violation to the airline
+// seeing it paid and ATCS clearing the flight. Off unless main() calls traceEnable().
+//
+// Every message on the AVN path carries a TraceContext: the trace ID (the AVN ID), the time
+// the violation was detected and the time the sender handed the message over. Timestamps are
+// CLOCK_MONOTONIC nanoseconds, which every process on the host shares. Each process records
+// the spans it can measure (see TraceStage) into directory/<process>-<pid>.spans:
+//
+//   header  magic "ACXTRC01"
+//   spans   fixed-size TraceSpans in the order they were flushed
+//
+// Recording only appends to a buffer under a mutex; a background thread writes it out every
+// kTraceFlushMs, and traceFlush() writes the rest. ./trace_report turns the files of a run
+// into per-stage latency histograms.
+struct TraceContext {
+    uint64_t traceId = 0;   // 0: not traced
+    int64_t originNs = 0;   // violation detected
+    int64_t sentNs = 0;     // message handed to the channel (or queued for it)
+};
+
+enum class TraceStage : uint16_t {
+    AtcsToGenerator = 1, // detected -> generator reads the notice (outbox + channel)
+    GeneratorBatch,      // generator reads the notice -> appends it to the broadcast log
+    LogToStripe,         // appended -> Stripe reads it
+    LogToPortal,         // appended -> portal reads it
+    StripeQueue,         // Stripe reads it -> a worker starts charging (in-flight limit + queue)
+    GatewayCharge,       // charging, retries included
+    JournalCommit,       // charged -> the payment is durable and the confirmation is sent
+    StripeToGenerator,   // confirmation sent -> generator reads it
+    StripeToPortal,      // confirmation sent -> portal reads it
+    GeneratorToAtcs,     // clearance queued -> applied by ATCS
+    DetectToPaid,        // end to end: detected -> the portal shows it paid
+    DetectToCleared      // end to end: detected -> ATCS clears the flight
+};
+const int kTraceStageCount = 12;
+
+inline const char* traceStageName(int stage) {
+    static const char* names[kTraceStageCount] = {
+        "atcs->generator", "generator batch", "log->stripe", "log->portal",
+        "stripe queue", "gateway charge", "journal commit", "stripe->generator",
+        "stripe->portal", "generator->atcs", "detect->paid", "detect->cleared"
+    };
+    return stage >= 1 && stage <= kTraceStageCount ? names[stage - 1] : "unknown";
+}
+
+struct TraceSpan {
+    uint64_t traceId;
+    int64_t startNs;
+    int64_t endNs;
+    uint16_t stage;
+    uint16_t reserved[3];
+};
+
+const char kTraceMagic[8] = {'A', 'C', 'X', 'T', 'R', 'C', '0', '1'};
+const int kTraceFlushMs = 200;
+const size_t kMaxBufferedSpans = 1 << 16; // beyond this spans are dropped, never waited for
+
+inline int64_t traceClockNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+class TraceRecorder {
+private:
+    bool enabled;
+    std::string directory;
+    std::string process;        // file name prefix, set by each process as it starts
+    pthread_mutex_t mutex;
+    std::vector<TraceSpan> buffer;
+    long dropped;
+    int fd;
+    bool flusherStarted;
+    pthread_t flusherThread;
+
+    static void* flusherThreadFunc(void* arg) {
+        TraceRecorder* recorder = static_cast<TraceRecorder*>(arg);
+        while (true) {
+            usleep(kTraceFlushMs * 1000);
+            recorder->flush();
+        }
+        return nullptr;
+    }
+
+    // Caller holds mutex
+    bool openFile() {
+        if (fd >= 0) return true;
+        std::string path = directory + "/" + (process.empty() ? "process" : process) + "-" + std::to_string(getpid()) + ".spans";
+        fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            std::cerr << "Trace: cannot open " << path << std::endl;
+            enabled = false;
+            return false;
+        }
+        if (write(fd, kTraceMagic, sizeof(kTraceMagic)) != static_cast<ssize_t>(sizeof(kTraceMagic))) {
+            std::cerr << "Trace: cannot write " << path << std::endl;
+        }
+        return true;
+    }
+
+    // fork() only copies the forking thread: the child must not inherit a held mutex, the
+    // parent's unflushed spans or its file, and it needs a flusher thread of its own
+    static void prepareFork() { pthread_mutex_lock(&traceRecorder().mutex); }
+    static void parentAfterFork() { pthread_mutex_unlock(&traceRecorder().mutex); }
+    static void childAfterFork() {
+        TraceRecorder& recorder = traceRecorder();
+        pthread_mutex_init(&recorder.mutex, NULL);
+        recorder.buffer.clear();
+        recorder.dropped = 0;
+        if (recorder.fd >= 0) close(recorder.fd);
+        recorder.fd = -1;
+        recorder.flusherStarted = false;
+    }
+
+    // The supervisor stops a process with SIGTERM, which would lose the spans of the last
+    // flush interval. Best effort: write what is buffered unless a thread is recording or
+    // flushing right now, then die of the signal as before.
+    static void terminateHandler(int sig) {
+        TraceRecorder& recorder = traceRecorder();
+        if (recorder.fd >= 0 && pthread_mutex_trylock(&recorder.mutex) == 0) {
+            ssize_t written = write(recorder.fd, recorder.buffer.data(), recorder.buffer.size() * sizeof(TraceSpan));
+            (void)written;
+        }
+        signal(sig, SIG_DFL);
+        raise(sig);
+    }
+
+public:
+    TraceRecorder() : enabled(false), dropped(0), fd(-1), flusherStarted(false) {
+        pthread_mutex_init(&mutex, NULL);
+    }
+
+    static TraceRecorder& traceRecorder() {
+        static TraceRecorder recorder;
+        return recorder;
+    }
+
+    // main(), before the forks
+    bool enable(const std::string& dir) {
+        if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+            std::cerr << "Trace: cannot create " << dir << std::endl;
+            return false;
+        }
+        directory = dir;
+        enabled = true;
+        pthread_atfork(prepareFork, parentAfterFork, childAfterFork);
+        return true;
+    }
+
+    bool isEnabled() const { return enabled; }
+
+    // Names this process's span file and opens it; call once the process is set up
+    void setProcess(const std::string& name) {
+        if (!enabled) return;
+        pthread_mutex_lock(&mutex);
+        process.clear();
+        for (char c : name) {
+            if (isalnum(static_cast<unsigned char>(c))) process.push_back(static_cast<char>(tolower(c)));
+            else if (!process.empty() && process.back() != '-') process.push_back('-');
+        }
+        while (!process.empty() && process.back() == '-') process.pop_back();
+        if (fd >= 0) close(fd);
+        fd = -1;
+        openFile();
+        pthread_mutex_unlock(&mutex);
+
+        struct sigaction current;
+        if (sigaction(SIGTERM, nullptr, &current) == 0 && current.sa_handler == SIG_DFL) {
+            signal(SIGTERM, terminateHandler);
+        }
+    }
+
+    void record(TraceStage stage, uint64_t traceId, int64_t startNs, int64_t endNs) {
+        TraceSpan span = {traceId, startNs, endNs, static_cast<uint16_t>(stage), {0, 0, 0}};
+        pthread_mutex_lock(&mutex);
+        if (!flusherStarted) {
+            flusherStarted = pthread_create(&flusherThread, NULL, flusherThreadFunc, this) == 0;
+            if (flusherStarted) pthread_detach(flusherThread);
+        }
+        if (buffer.size() < kMaxBufferedSpans) {
+            buffer.push_back(span);
+        } else {
+            dropped++;
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+
+    // Writes every buffered span; the buffer is swapped out so recording never waits on disk
+    void flush() {
+        std::vector<TraceSpan> spans;
+        pthread_mutex_lock(&mutex);
+        if (!enabled || buffer.empty() || !openFile()) {
+            pthread_mutex_unlock(&mutex);
+            return;
+        }
+        spans.swap(buffer);
+        buffer.reserve(spans.size());
+        int out = fd;
+        long lost = dropped;
+        dropped = 0;
+        pthread_mutex_unlock(&mutex);
+
+        if (lost > 0) {
+            std::cerr << "Trace: " << lost << " spans dropped, the buffer was full" << std::endl;
+        }
+        const char* data = reinterpret_cast<const char*>(spans.data());
+        size_t remaining = spans.size() * sizeof(TraceSpan);
+        while (remaining > 0) {
+            ssize_t written = write(out, data, remaining);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) {
+                std::cerr << "Trace: write failed, " << remaining / sizeof(TraceSpan) << " spans lost" << std::endl;
+                break;
+            }
+            data += written;
+            remaining -= written;
+        }
+    }
+};
+
+inline bool traceEnable(const std::string& directory) { return TraceRecorder::traceRecorder().enable(directory); }
+inline bool traceEnabled() { return TraceRecorder::traceRecorder().isEnabled(); }
+inline void traceSetProcess(const std::string& name) { TraceRecorder::traceRecorder().setProcess(name); }
+inline void traceFlush() { TraceRecorder::traceRecorder().flush(); }
+
+// A new trace, started where the violation is detected; untraced when tracing is off
+inline TraceContext traceStart(uint64_t traceId) {
+    TraceContext trace;
+    if (!traceEnabled()) return trace;
+    trace.traceId = traceId;
+    trace.originNs = traceClockNs();
+    trace.sentNs = trace.originNs;
+    return trace;
+}
+
+// The context to send on: same trace, sent now
+inline TraceContext traceForward(const TraceContext& trace, int64_t sentNs) {
+    TraceContext next = trace;
+    if (next.traceId != 0) next.sentNs = sentNs;
+    return next;
+}
+
+inline void traceSpan(TraceStage stage, const TraceContext& trace, int64_t startNs, int64_t endNs) {
+    if (trace.traceId != 0 && traceEnabled()) {
+        TraceRecorder::traceRecorder().record(stage, trace.traceId, startNs, endNs);
+    }
+}
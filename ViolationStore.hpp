@@ -0,0 +1,722 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <utility>
+#include <unordered_map>
+#include <atomic>
+#include <iostream>
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "MsgStructs.hpp"
+#include "AsyncFileWriter.hpp"
+
+// Binary store of every AVN issued, replacing the free-form violations.txt.
+//
+//   directory/strings.dict          every string (airline, flight, aircraft, type) once:
+//                                   length:u32 bytes; the n-th entry has id n (1-based)
+//   directory/segment-NNNNNN.vst    header (magic "AXVS" version:u32 segment:u64), then
+//                                   fixed-size ViolationRecords in append order
+//   directory/segment-NNNNNN.vsi    index of a sealed (full) segment, see IndexHeader
+//
+// AVN IDs are unique across runs (AvnId.hpp); the run ID additionally groups the AVNs of
+// one run of the generator. A sharded generator (AvnShard.hpp) gives each shard a store of
+// its own in directory/shard-N; readers open the root and every shard as parts of one store.
+// Only the AVN generator writes, through an AsyncFileWriter so it never waits on the disk;
+// avnquery and other readers may read at the same time and simply see the records that
+// were complete when they opened the store. A segment is sealed once it holds
+// kRecordsPerSegment records, on a thread of its own while appends go on into the next
+// segment; until its index is written a full segment is scanned like the active one.
+
+struct ViolationRecord {
+    int64_t timestamp;          // seconds since the epoch
+    int64_t fineCents;
+    uint64_t avnId;
+    uint32_t runId;
+    uint32_t airline;           // string ids in strings.dict
+    uint32_t flight;
+    uint32_t aircraft;
+    uint32_t aircraftType;
+    int32_t recordedSpeedCenti; // hundredths of a km/h
+    int32_t allowedSpeedCenti;
+    uint32_t reserved;
+};
+static_assert(sizeof(ViolationRecord) == 56, "ViolationRecord is stored as-is");
+
+namespace vstore {
+
+const char kSegmentMagic[4] = {'A', 'X', 'V', 'S'};
+const char kIndexMagic[4] = {'A', 'X', 'V', 'I'};
+const uint32_t kVersion = 2;   // 1 had 32-bit AVN IDs; such segments are left unread
+const size_t kSegmentHeaderBytes = 16;
+const uint32_t kRecordsPerSegment = 65536;
+const uint32_t kBlockRecords = 256;   // zone map granularity
+
+// Sealed segment index (.vsi):
+//   header     magic version:u32 recordCount:u32 blockCount:u32 airlineKeys:u32 flightKeys:u32
+//   zoneMap    blockCount x {minTime:i64 maxTime:i64}, one per kBlockRecords records
+//   airlines   airlineKeys x KeyEntry, sorted by key
+//   flights    flightKeys x KeyEntry, sorted by key
+//   postings   u32 record numbers within the segment, each key's list in record order
+struct IndexHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t recordCount;
+    uint32_t blockCount;
+    uint32_t airlineKeys;
+    uint32_t flightKeys;
+};
+
+struct ZoneEntry {
+    int64_t minTime;
+    int64_t maxTime;
+};
+
+struct KeyEntry {
+    uint32_t key;
+    uint32_t count;
+    int64_t fineCents;
+    uint32_t firstPosting; // index into postings
+    uint32_t reserved;
+};
+
+inline std::string segmentPath(const std::string& directory, uint64_t number, const char* extension) {
+    char name[40];
+    snprintf(name, sizeof(name), "segment-%06llu.%s", static_cast<unsigned long long>(number), extension);
+    return directory + "/" + name;
+}
+
+inline std::string shardDirectory(const std::string& root, int shard, int shards) {
+    return shards > 1 ? root + "/shard-" + std::to_string(shard) : root;
+}
+
+// The root, if it holds segments, then each shard-N below it in shard order
+inline std::vector<std::string> storeParts(const std::string& root) {
+    std::vector<std::string> parts;
+    std::vector<int> shards;
+    DIR* dir = opendir(root.c_str());
+    if (!dir) return parts;
+    bool rootSegments = false;
+    while (struct dirent* entry = readdir(dir)) {
+        int shard;
+        char rest;
+        if (sscanf(entry->d_name, "shard-%d%c", &shard, &rest) == 1 && shard >= 0) {
+            shards.push_back(shard);
+        } else if (strncmp(entry->d_name, "segment-", 8) == 0) {
+            rootSegments = true;
+        }
+    }
+    closedir(dir);
+    std::sort(shards.begin(), shards.end());
+    if (rootSegments) parts.push_back(root);
+    for (int shard : shards) parts.push_back(root + "/shard-" + std::to_string(shard));
+    return parts;
+}
+
+inline bool makeDirectories(const std::string& path) {
+    for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1)) {
+        std::string prefix = path.substr(0, slash);
+        if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) return false;
+        if (slash == std::string::npos) return true;
+    }
+}
+
+inline std::vector<uint64_t> listSegments(const std::string& directory) {
+    std::vector<uint64_t> numbers;
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) return numbers;
+    while (struct dirent* entry = readdir(dir)) {
+        unsigned long long number;
+        char suffix[8];
+        if (sscanf(entry->d_name, "segment-%llu.%7s", &number, suffix) == 2 && strcmp(suffix, "vst") == 0) {
+            numbers.push_back(number);
+        }
+    }
+    closedir(dir);
+    std::sort(numbers.begin(), numbers.end());
+    return numbers;
+}
+
+// True if a mapped segment has the header of this format version
+inline bool currentFormat(const char* data, size_t size) {
+    uint32_t version;
+    if (size < kSegmentHeaderBytes || memcmp(data, kSegmentMagic, 4) != 0) return false;
+    memcpy(&version, data + 4, sizeof(version));
+    return version == kVersion;
+}
+
+inline bool writeFile(const std::string& path, const std::string& data) {
+    std::string temporary = path + ".tmp";
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = write(fd, data.data() + written, data.size() - written);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) break;
+        written += n;
+    }
+    bool ok = written == data.size() && fsync(fd) == 0;
+    close(fd);
+    return ok && rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+template <typename T>
+inline void appendRaw(std::string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Builds the .vsi of a segment from its records
+inline std::string buildIndex(const ViolationRecord* records, uint32_t count) {
+    std::vector<ZoneEntry> zones;
+    for (uint32_t i = 0; i < count; i++) {
+        if (i % kBlockRecords == 0) zones.push_back({INT64_MAX, INT64_MIN});
+        zones.back().minTime = std::min(zones.back().minTime, records[i].timestamp);
+        zones.back().maxTime = std::max(zones.back().maxTime, records[i].timestamp);
+    }
+    std::map<uint32_t, std::vector<uint32_t>> airlines, flights;
+    for (uint32_t i = 0; i < count; i++) {
+        airlines[records[i].airline].push_back(i);
+        flights[records[i].flight].push_back(i);
+    }
+
+    IndexHeader header;
+    memcpy(header.magic, kIndexMagic, sizeof(header.magic));
+    header.version = kVersion;
+    header.recordCount = count;
+    header.blockCount = static_cast<uint32_t>(zones.size());
+    header.airlineKeys = static_cast<uint32_t>(airlines.size());
+    header.flightKeys = static_cast<uint32_t>(flights.size());
+
+    std::string out;
+    appendRaw(out, header);
+    for (const ZoneEntry& zone : zones) appendRaw(out, zone);
+    uint32_t posting = 0;
+    for (auto* lists : {&airlines, &flights}) {
+        for (const auto& list : *lists) {
+            KeyEntry entry = {list.first, static_cast<uint32_t>(list.second.size()), 0, posting, 0};
+            for (uint32_t record : list.second) entry.fineCents += records[record].fineCents;
+            appendRaw(out, entry);
+            posting += entry.count;
+        }
+    }
+    for (auto* lists : {&airlines, &flights}) {
+        for (const auto& list : *lists) {
+            out.append(reinterpret_cast<const char*>(list.second.data()), list.second.size() * sizeof(uint32_t));
+        }
+    }
+    return out;
+}
+
+// Read-only view of a file, mapped whole
+struct MappedFile {
+    const char* data = nullptr;
+    size_t size = 0;
+
+    bool map(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            close(fd);
+            return false;
+        }
+        void* memory = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (memory == MAP_FAILED) return false;
+        data = static_cast<const char*>(memory);
+        size = info.st_size;
+        return true;
+    }
+
+    void unmap() {
+        if (data) munmap(const_cast<char*>(data), size);
+        data = nullptr;
+        size = 0;
+    }
+};
+
+} // namespace vstore
+
+// Writer side, owned by the AVN generator
+class ViolationStore {
+private:
+    std::string directory;
+    int dictionaryFd;
+    off_t dictionaryBytes;
+    int segmentFd;
+    uint64_t segmentNumber;
+    uint32_t segmentRecords;
+    uint32_t runId;
+    std::unordered_map<std::string, uint32_t> stringIds;
+    uint32_t nextStringId;
+    AsyncFileWriter writer;
+    std::atomic<bool> writeFailed;  // set by the writer thread, reported by the next append()
+
+    // Sealer thread: indexes full segments off the generator's reactor
+    pthread_t sealThread;
+    pthread_mutex_t sealMutex;
+    pthread_cond_t sealReady;
+    std::deque<std::pair<uint64_t, int>> sealQueue; // segment number, its fd to close (-1 if none)
+    bool sealStopping;
+    bool sealStarted;
+
+    bool loadDictionary() {
+        std::string path = directory + "/strings.dict";
+        dictionaryFd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (dictionaryFd < 0) return false;
+        vstore::MappedFile file;
+        size_t valid = 0;
+        if (file.map(path)) {
+            size_t offset = 0;
+            while (offset + sizeof(uint32_t) <= file.size) {
+                uint32_t length;
+                memcpy(&length, file.data + offset, sizeof(length));
+                if (offset + sizeof(length) + length > file.size) break;
+                stringIds.emplace(std::string(file.data + offset + sizeof(length), length), nextStringId++);
+                offset += sizeof(length) + length;
+            }
+            valid = offset;
+            file.unmap();
+        }
+        // Drop an entry torn by a crash so appends stay aligned
+        dictionaryBytes = static_cast<off_t>(valid);
+        return ftruncate(dictionaryFd, valid) == 0;
+    }
+
+    uint32_t intern(const std::string& value, std::string& newEntries) {
+        auto found = stringIds.find(value);
+        if (found != stringIds.end()) return found->second;
+        uint32_t length = static_cast<uint32_t>(value.size());
+        vstore::appendRaw(newEntries, length);
+        newEntries.append(value);
+        stringIds.emplace(value, nextStringId);
+        return nextStringId++;
+    }
+
+    bool openSegment(uint64_t number) {
+        std::string path = vstore::segmentPath(directory, number, "vst");
+        segmentFd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (segmentFd < 0) return false;
+        struct stat info;
+        if (fstat(segmentFd, &info) != 0) return false;
+        if (info.st_size < static_cast<off_t>(vstore::kSegmentHeaderBytes)) {
+            char header[vstore::kSegmentHeaderBytes];
+            memcpy(header, vstore::kSegmentMagic, 4);
+            memcpy(header + 4, &vstore::kVersion, 4);
+            memcpy(header + 8, &number, 8);
+            if (pwrite(segmentFd, header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) return false;
+            segmentRecords = 0;
+        } else {
+            segmentRecords = static_cast<uint32_t>((info.st_size - vstore::kSegmentHeaderBytes) / sizeof(ViolationRecord));
+        }
+        // A record torn by a crash is cut off
+        if (ftruncate(segmentFd, vstore::kSegmentHeaderBytes + static_cast<off_t>(segmentRecords) * sizeof(ViolationRecord)) != 0) {
+            return false;
+        }
+        segmentNumber = number;
+        return true;
+    }
+
+    bool seal(uint64_t number) {
+        vstore::MappedFile segment;
+        if (!segment.map(vstore::segmentPath(directory, number, "vst"))) return false;
+        if (!vstore::currentFormat(segment.data, segment.size)) {
+            segment.unmap();
+            return false;
+        }
+        uint32_t count = static_cast<uint32_t>((segment.size - vstore::kSegmentHeaderBytes) / sizeof(ViolationRecord));
+        std::string index = vstore::buildIndex(
+            reinterpret_cast<const ViolationRecord*>(segment.data + vstore::kSegmentHeaderBytes), count);
+        segment.unmap();
+        return vstore::writeFile(vstore::segmentPath(directory, number, "vsi"), index);
+    }
+
+    // Any thread, including the writer's completions
+    void queueSeal(uint64_t number, int fd) {
+        pthread_mutex_lock(&sealMutex);
+        sealQueue.emplace_back(number, fd);
+        pthread_cond_signal(&sealReady);
+        pthread_mutex_unlock(&sealMutex);
+    }
+
+    // Seals everything queued, including what is queued after stopSealer() was called
+    void sealLoop() {
+        pthread_mutex_lock(&sealMutex);
+        while (true) {
+            while (sealQueue.empty() && !sealStopping) {
+                pthread_cond_wait(&sealReady, &sealMutex);
+            }
+            if (sealQueue.empty()) break;
+            std::pair<uint64_t, int> next = sealQueue.front();
+            sealQueue.pop_front();
+            pthread_mutex_unlock(&sealMutex);
+            if (next.second >= 0) ::close(next.second);
+            if (!seal(next.first)) {
+                std::cerr << "Violation store: cannot index segment " << next.first << std::endl;
+            }
+            pthread_mutex_lock(&sealMutex);
+        }
+        pthread_mutex_unlock(&sealMutex);
+    }
+
+    static void* sealThreadFunc(void* arg) {
+        static_cast<ViolationStore*>(arg)->sealLoop();
+        return nullptr;
+    }
+
+    void stopSealer() {
+        if (!sealStarted) return;
+        pthread_mutex_lock(&sealMutex);
+        sealStopping = true;
+        pthread_cond_signal(&sealReady);
+        pthread_mutex_unlock(&sealMutex);
+        pthread_join(sealThread, NULL);
+        sealStarted = false;
+    }
+
+public:
+    explicit ViolationStore(const std::string& directory = "violation_store")
+        : directory(directory), dictionaryFd(-1), dictionaryBytes(0), segmentFd(-1), segmentNumber(0), segmentRecords(0),
+          runId(0), nextStringId(1), writeFailed(false), sealStopping(false), sealStarted(false) {
+        pthread_mutex_init(&sealMutex, NULL);
+        pthread_cond_init(&sealReady, NULL);
+    }
+
+    ~ViolationStore() {
+        close();
+        pthread_cond_destroy(&sealReady);
+        pthread_mutex_destroy(&sealMutex);
+    }
+
+    bool open() {
+        if (!vstore::makeDirectories(directory)) return false;
+        if (!loadDictionary()) return false;
+        if (!writer.start()) return false;
+        sealStopping = false;
+        sealStarted = pthread_create(&sealThread, NULL, sealThreadFunc, this) == 0;
+        if (!sealStarted) return false;
+
+        std::vector<uint64_t> segments = vstore::listSegments(directory);
+        // The last run ID in the store, from the newest non-empty segment
+        for (size_t i = segments.size(); i-- > 0 && runId == 0;) {
+            vstore::MappedFile segment;
+            if (!segment.map(vstore::segmentPath(directory, segments[i], "vst"))) continue;
+            if (!vstore::currentFormat(segment.data, segment.size)) {
+                segment.unmap();
+                continue;
+            }
+            size_t count = (segment.size - std::min(segment.size, vstore::kSegmentHeaderBytes)) / sizeof(ViolationRecord);
+            if (count > 0) {
+                ViolationRecord last;
+                memcpy(&last, segment.data + vstore::kSegmentHeaderBytes + (count - 1) * sizeof(ViolationRecord), sizeof(last));
+                runId = last.runId;
+            }
+            segment.unmap();
+        }
+        runId++;
+
+        // Seal any full segment whose index is missing (interrupted rotation)
+        for (size_t i = 0; i + 1 < segments.size(); i++) {
+            if (access(vstore::segmentPath(directory, segments[i], "vsi").c_str(), F_OK) != 0) {
+                queueSeal(segments[i], -1);
+            }
+        }
+        if (segments.empty()) return openSegment(1);
+        // A last segment in an older format is left as it is; appends go to a new one
+        vstore::MappedFile last;
+        bool reuse = !last.map(vstore::segmentPath(directory, segments.back(), "vst")) ||
+                     vstore::currentFormat(last.data, last.size);
+        last.unmap();
+        return openSegment(reuse ? segments.back() : segments.back() + 1);
+    }
+
+    // Waits for the writes still in flight and the segments still being sealed
+    void close() {
+        writer.stop();
+        stopSealer();
+        if (segmentFd >= 0) ::close(segmentFd);
+        if (dictionaryFd >= 0) ::close(dictionaryFd);
+        segmentFd = dictionaryFd = -1;
+    }
+
+    uint32_t currentRun() const { return runId; }
+    const char* writerBackend() const { return writer.backendName(); }
+
+    // Queues one dictionary append (new strings only) and one segment append per batch as
+    // one ordered chain; new strings are written first so a record never refers to an
+    // unknown id. Returns false if the batch could not be queued or an earlier one failed.
+    bool append(const std::vector<AVNNotice>& notices) {
+        if (segmentFd < 0) return false;
+        size_t done = 0;
+        while (done < notices.size()) {
+            if (segmentRecords >= vstore::kRecordsPerSegment) {
+                // Sealing reads the segment back: it and the dictionary must be complete
+                // and, since the index is durable, durable too. The ordered sync runs after
+                // every write queued so far; its completion hands the segment to the sealer
+                // thread, and appends go on into the next segment in the meantime.
+                AsyncWriteChain sync;
+                sync.sync(dictionaryFd);
+                sync.sync(segmentFd);
+                int fullFd = segmentFd;
+                uint64_t fullNumber = segmentNumber;
+                bool queued = writer.submit(sync, [this, fullFd, fullNumber](bool ok) {
+                    if (!ok) writeFailed = true;
+                    queueSeal(fullNumber, fullFd);
+                }, true);
+                if (!queued) {
+                    writer.drain();
+                    queueSeal(fullNumber, fullFd);
+                }
+                segmentFd = -1;
+                if (!openSegment(segmentNumber + 1)) return false;
+            }
+            size_t take = std::min<size_t>(notices.size() - done, vstore::kRecordsPerSegment - segmentRecords);
+            std::string newStrings;
+            std::vector<ViolationRecord> records(take);
+            for (size_t i = 0; i < take; i++) {
+                const AVNNotice& notice = notices[done + i];
+                ViolationRecord& record = records[i];
+                record.timestamp = notice.timestamp;
+                record.fineCents = std::llround(notice.totalFine * 100.0);
+                record.runId = runId;
+                record.avnId = notice.avnId;
+                record.airline = intern(notice.AirlineName, newStrings);
+                record.flight = intern(notice.flightNumber, newStrings);
+                record.aircraft = intern(notice.aircraftId, newStrings);
+                record.aircraftType = intern(notice.aircraftType, newStrings);
+                record.recordedSpeedCenti = static_cast<int32_t>(std::lround(notice.recordedSpeed * 100.0));
+                record.allowedSpeedCenti = static_cast<int32_t>(std::lround(notice.allowedSpeed * 100.0));
+            }
+            AsyncWriteChain chain;
+            chain.write(dictionaryFd, dictionaryBytes, newStrings.data(), newStrings.size());
+            chain.write(segmentFd, vstore::kSegmentHeaderBytes + static_cast<off_t>(segmentRecords) * sizeof(ViolationRecord),
+                        records.data(), take * sizeof(ViolationRecord));
+            if (!writer.submit(chain, [this](bool ok) { if (!ok) writeFailed = true; }, true)) {
+                return false;
+            }
+            dictionaryBytes += static_cast<off_t>(newStrings.size());
+            segmentRecords += static_cast<uint32_t>(take);
+            done += take;
+        }
+        return !writeFailed.exchange(false);
+    }
+};
+
+struct ViolationQuery {
+    std::string airline;        // empty = any
+    std::string flight;         // empty = any
+    int64_t from = INT64_MIN;   // inclusive, seconds since the epoch
+    int64_t to = INT64_MAX;     // inclusive
+};
+
+struct OffenderCount {
+    uint32_t key;
+    uint64_t count;
+    int64_t fineCents;
+};
+
+// Read side, used by avnquery. Maps every segment and its index; queries go through the
+// posting lists and zone maps of sealed segments and scan only the active one.
+class ViolationStoreReader {
+private:
+    struct Segment {
+        uint64_t number;
+        vstore::MappedFile data;
+        vstore::MappedFile index;
+        const ViolationRecord* records;
+        uint32_t count;
+        const vstore::IndexHeader* header; // null when unsealed
+        const vstore::ZoneEntry* zones;
+        const vstore::KeyEntry* airlines;
+        const vstore::KeyEntry* flights;
+        const uint32_t* postings;
+    };
+
+    std::vector<std::string> strings; // by id; strings[0] = "" (unknown)
+    std::unordered_map<std::string, uint32_t> ids;
+    std::vector<Segment> segments;
+
+    static const vstore::KeyEntry* findKey(const vstore::KeyEntry* entries, uint32_t count, uint32_t key) {
+        const vstore::KeyEntry* end = entries + count;
+        const vstore::KeyEntry* found = std::lower_bound(entries, end, key,
+            [](const vstore::KeyEntry& entry, uint32_t value) { return entry.key < value; });
+        return found != end && found->key == key ? found : nullptr;
+    }
+
+    // 0 if the string never occurred, so no record can match
+    uint32_t lookup(const std::string& value) const {
+        auto found = ids.find(value);
+        return found == ids.end() ? 0 : found->second;
+    }
+
+    static bool inRange(const ViolationRecord& record, const ViolationQuery& query) {
+        return record.timestamp >= query.from && record.timestamp <= query.to;
+    }
+
+public:
+    ~ViolationStoreReader() {
+        for (Segment& segment : segments) {
+            segment.data.unmap();
+            segment.index.unmap();
+        }
+    }
+
+    bool open(const std::string& directory) {
+        strings.assign(1, std::string("?"));
+        vstore::MappedFile dictionary;
+        if (dictionary.map(directory + "/strings.dict")) {
+            size_t offset = 0;
+            while (offset + sizeof(uint32_t) <= dictionary.size) {
+                uint32_t length;
+                memcpy(&length, dictionary.data + offset, sizeof(length));
+                if (offset + sizeof(length) + length > dictionary.size) break;
+                strings.emplace_back(dictionary.data + offset + sizeof(length), length);
+                ids.emplace(strings.back(), static_cast<uint32_t>(strings.size() - 1));
+                offset += sizeof(length) + length;
+            }
+            dictionary.unmap();
+        }
+
+        for (uint64_t number : vstore::listSegments(directory)) {
+            Segment segment = {};
+            segment.number = number;
+            if (!segment.data.map(vstore::segmentPath(directory, number, "vst")) ||
+                !vstore::currentFormat(segment.data.data, segment.data.size)) {
+                segment.data.unmap();
+                continue;
+            }
+            segment.records = reinterpret_cast<const ViolationRecord*>(segment.data.data + vstore::kSegmentHeaderBytes);
+            segment.count = static_cast<uint32_t>((segment.data.size - vstore::kSegmentHeaderBytes) / sizeof(ViolationRecord));
+            if (segment.index.map(vstore::segmentPath(directory, number, "vsi")) &&
+                segment.index.size >= sizeof(vstore::IndexHeader)) {
+                const vstore::IndexHeader* header = reinterpret_cast<const vstore::IndexHeader*>(segment.index.data);
+                size_t needed = sizeof(vstore::IndexHeader) + header->blockCount * sizeof(vstore::ZoneEntry) +
+                                (static_cast<size_t>(header->airlineKeys) + header->flightKeys) * sizeof(vstore::KeyEntry);
+                if (memcmp(header->magic, vstore::kIndexMagic, 4) == 0 && header->recordCount == segment.count &&
+                    segment.index.size >= needed) {
+                    segment.header = header;
+                    segment.zones = reinterpret_cast<const vstore::ZoneEntry*>(header + 1);
+                    segment.airlines = reinterpret_cast<const vstore::KeyEntry*>(segment.zones + header->blockCount);
+                    segment.flights = segment.airlines + header->airlineKeys;
+                    segment.postings = reinterpret_cast<const uint32_t*>(segment.flights + header->flightKeys);
+                }
+            }
+            segments.push_back(segment);
+        }
+        return true;
+    }
+
+    const std::string& name(uint32_t id) const {
+        return id < strings.size() ? strings[id] : strings[0];
+    }
+
+    size_t segmentCount() const { return segments.size(); }
+    size_t sealedCount() const {
+        size_t sealed = 0;
+        for (const Segment& segment : segments) sealed += segment.header != nullptr;
+        return sealed;
+    }
+    uint64_t recordCount() const {
+        uint64_t total = 0;
+        for (const Segment& segment : segments) total += segment.count;
+        return total;
+    }
+
+    // Calls visit(record) for every matching record in store order; visit returns false
+    // to stop early
+    template <typename Visitor>
+    void query(const ViolationQuery& query, Visitor visit) const {
+        uint32_t airline = query.airline.empty() ? 0 : lookup(query.airline);
+        uint32_t flight = query.flight.empty() ? 0 : lookup(query.flight);
+        if ((!query.airline.empty() && airline == 0) || (!query.flight.empty() && flight == 0)) return;
+
+        auto matches = [&](const ViolationRecord& record) {
+            return (airline == 0 || record.airline == airline) && (flight == 0 || record.flight == flight) &&
+                   inRange(record, query);
+        };
+
+        for (const Segment& segment : segments) {
+            if (segment.header && (airline != 0 || flight != 0)) {
+                // Walk the shorter posting list
+                const vstore::KeyEntry* byAirline = airline ? findKey(segment.airlines, segment.header->airlineKeys, airline) : nullptr;
+                const vstore::KeyEntry* byFlight = flight ? findKey(segment.flights, segment.header->flightKeys, flight) : nullptr;
+                if ((airline && !byAirline) || (flight && !byFlight)) continue;
+                const vstore::KeyEntry* list = !byAirline ? byFlight : !byFlight ? byAirline
+                                             : byAirline->count <= byFlight->count ? byAirline : byFlight;
+                for (uint32_t i = 0; i < list->count; i++) {
+                    const ViolationRecord& record = segment.records[segment.postings[list->firstPosting + i]];
+                    if (matches(record) && !visit(record)) return;
+                }
+            } else if (segment.header) {
+                // Time range only: skip blocks the zone map rules out
+                for (uint32_t block = 0; block < segment.header->blockCount; block++) {
+                    if (segment.zones[block].maxTime < query.from || segment.zones[block].minTime > query.to) continue;
+                    uint32_t end = std::min(segment.count, (block + 1) * vstore::kBlockRecords);
+                    for (uint32_t i = block * vstore::kBlockRecords; i < end; i++) {
+                        if (matches(segment.records[i]) && !visit(segment.records[i])) return;
+                    }
+                }
+            } else {
+                for (uint32_t i = 0; i < segment.count; i++) {
+                    if (matches(segment.records[i]) && !visit(segment.records[i])) return;
+                }
+            }
+        }
+    }
+
+    // AVN count and total fine per airline (byFlight = false) or flight, highest count
+    // first. Without a time range sealed segments answer from their index alone.
+    std::vector<OffenderCount> topOffenders(bool byFlight, const ViolationQuery& range, size_t limit) const {
+        std::unordered_map<uint32_t, OffenderCount> totals;
+        bool wholeTime = range.from == INT64_MIN && range.to == INT64_MAX;
+        for (const Segment& segment : segments) {
+            if (segment.header && wholeTime) {
+                const vstore::KeyEntry* entries = byFlight ? segment.flights : segment.airlines;
+                uint32_t keys = byFlight ? segment.header->flightKeys : segment.header->airlineKeys;
+                for (uint32_t i = 0; i < keys; i++) {
+                    OffenderCount& total = totals[entries[i].key];
+                    total.key = entries[i].key;
+                    total.count += entries[i].count;
+                    total.fineCents += entries[i].fineCents;
+                }
+                continue;
+            }
+            for (uint32_t i = 0; i < segment.count; i++) {
+                const ViolationRecord& record = segment.records[i];
+                if (segment.header) {
+                    const vstore::ZoneEntry& zone = segment.zones[i / vstore::kBlockRecords];
+                    if (zone.maxTime < range.from || zone.minTime > range.to) {
+                        i = (i / vstore::kBlockRecords + 1) * vstore::kBlockRecords - 1;
+                        continue;
+                    }
+                }
+                if (!inRange(record, range)) continue;
+                uint32_t key = byFlight ? record.flight : record.airline;
+                OffenderCount& total = totals[key];
+                total.key = key;
+                total.count++;
+                total.fineCents += record.fineCents;
+            }
+        }
+        std::vector<OffenderCount> ranked;
+        for (const auto& total : totals) ranked.push_back(total.second);
+        std::sort(ranked.begin(), ranked.end(), [](const OffenderCount& a, const OffenderCount& b) {
+            return a.count != b.count ? a.count > b.count : a.fineCents > b.fineCents;
+        });
+        if (ranked.size() > limit) ranked.resize(limit);
+        return ranked;
+    }
+};
@@ -0,0 +1,353 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+#include "MsgStructs.hpp"
+
+// Compact, versioned encoding of the IPC messages.
+//
+//   frame   = version:u8 type:u8 bodyLength:varint body
+//   varint  = unsigned LEB128, at most 10 bytes
+//   signed  = zigzag, then varint
+//   string  = length:varint bytes (no terminator, no fixed width)
+//   speeds  = signed hundredths of a km/h; fines = signed cents; times = signed seconds
+//   trace   = traceId:varint, then originNs:signed sentNs:signed unless traceId is 0
+//
+// Decoding validates the whole frame in a single pass (version, type, declared length,
+// every field in bounds, no trailing bytes) and fills a *View whose strings point into
+// the caller's buffer, so nothing is copied until toMessage() is called.
+
+const uint8_t kWireVersion = 2; // 2: AVN path messages carry a TraceContext
+const uint32_t kTypicalFrameBytes = 64; // used to estimate pipe backlog in messages
+
+enum class MsgType : uint8_t {
+    AVNNotice = 1,
+    PaymentRequest = 2,
+    PaymentConfirmation = 3,
+    ViolationClearance = 4
+};
+
+class WireWriter {
+private:
+    std::string& out;
+
+public:
+    explicit WireWriter(std::string& out) : out(out) {}
+
+    void putVarint(uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    void putSigned(int64_t value) {
+        putVarint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+    }
+
+    void putFixed2(double value) {
+        putSigned(static_cast<int64_t>(std::llround(value * 100.0)));
+    }
+
+    void putString(std::string_view value) {
+        putVarint(value.size());
+        out.append(value.data(), value.size());
+    }
+
+    void putTrace(const TraceContext& trace) {
+        putVarint(trace.traceId);
+        if (trace.traceId == 0) return;
+        putSigned(trace.originNs);
+        putSigned(trace.sentNs);
+    }
+};
+
+class WireReader {
+private:
+    const char* cursor;
+    const char* end;
+    bool ok;
+
+public:
+    WireReader(const char* data, size_t length) : cursor(data), end(data + length), ok(true) {}
+
+    bool good() const { return ok; }
+    bool atEnd() const { return cursor == end; }
+
+    uint64_t getVarint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (cursor == end) break;
+            uint8_t byte = static_cast<uint8_t>(*cursor++);
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        ok = false;
+        return 0;
+    }
+
+    int64_t getSigned() {
+        uint64_t raw = getVarint();
+        return static_cast<int64_t>((raw >> 1) ^ (~(raw & 1) + 1));
+    }
+
+    double getFixed2() {
+        return getSigned() / 100.0;
+    }
+
+    std::string_view getString() {
+        uint64_t length = getVarint();
+        if (!ok || length > static_cast<uint64_t>(end - cursor)) {
+            ok = false;
+            return std::string_view();
+        }
+        std::string_view value(cursor, length);
+        cursor += length;
+        return value;
+    }
+
+    TraceContext getTrace() {
+        TraceContext trace;
+        trace.traceId = getVarint();
+        if (trace.traceId == 0) return trace;
+        trace.originNs = getSigned();
+        trace.sentNs = getSigned();
+        return trace;
+    }
+
+    uint8_t getByte() {
+        if (cursor == end) {
+            ok = false;
+            return 0;
+        }
+        return static_cast<uint8_t>(*cursor++);
+    }
+
+    const char* position() const { return cursor; }
+};
+
+struct AVNNoticeView {
+    AvnId avnId;
+    std::string_view aircraftId;
+    std::string_view airlineName;
+    std::string_view aircraftType;
+    std::string_view flightNumber;
+    double recordedSpeed;
+    double allowedSpeed;
+    double totalFine;
+    time_t timestamp;
+    TraceContext trace;
+
+    AVNNotice toMessage() const {
+        AVNNotice notice;
+        notice.avnId = avnId;
+        notice.aircraftId = std::string(aircraftId);
+        notice.AirlineName = std::string(airlineName);
+        notice.aircraftType = std::string(aircraftType);
+        notice.flightNumber = std::string(flightNumber);
+        notice.recordedSpeed = recordedSpeed;
+        notice.allowedSpeed = allowedSpeed;
+        notice.totalFine = totalFine;
+        notice.timestamp = timestamp;
+        notice.trace = trace;
+        return notice;
+    }
+};
+
+struct PaymentRequestView {
+    AvnId avnId;
+    std::string_view aircraftId;
+    std::string_view aircraftType;
+    double totalFine;
+
+    PaymentRequest toMessage() const {
+        PaymentRequest request;
+        request.avnId = avnId;
+        request.aircraftId = std::string(aircraftId);
+        request.aircraftType = std::string(aircraftType);
+        request.totalFine = totalFine;
+        return request;
+    }
+};
+
+struct PaymentConfirmationView {
+    AvnId avnId;
+    std::string_view status;
+    TraceContext trace;
+
+    PaymentConfirmation toMessage() const {
+        PaymentConfirmation confirmation;
+        confirmation.avnId = avnId;
+        confirmation.status = std::string(status);
+        confirmation.trace = trace;
+        return confirmation;
+    }
+};
+
+struct ViolationClearanceView {
+    AvnId avnId;
+    std::string_view aircraftId;
+    std::string_view status;
+    TraceContext trace;
+
+    ViolationClearance toMessage() const {
+        ViolationClearance clearance;
+        clearance.avnId = avnId;
+        clearance.aircraftId = std::string(aircraftId);
+        clearance.status = std::string(status);
+        clearance.trace = trace;
+        return clearance;
+    }
+};
+
+namespace wire {
+
+// Appends the frame header once the body is known; the body is built in place after a
+// one-byte length guess and shifted only if its varint needs more room.
+template <typename BodyWriter>
+inline void appendFrame(std::string& out, MsgType type, BodyWriter writeBody) {
+    out.push_back(static_cast<char>(kWireVersion));
+    out.push_back(static_cast<char>(type));
+    size_t lengthAt = out.size();
+    out.push_back('\0');
+    size_t bodyAt = out.size();
+    WireWriter writer(out);
+    writeBody(writer);
+    size_t bodyLength = out.size() - bodyAt;
+    std::string length;
+    WireWriter(length).putVarint(bodyLength);
+    out.replace(lengthAt, 1, length);
+}
+
+// Checks version, type and declared length; body/bodyLength then cover exactly the body
+inline bool openFrame(const char* data, size_t length, MsgType expected, const char*& body, size_t& bodyLength,
+                      const char** error) {
+    WireReader header(data, length);
+    uint8_t version = header.getByte();
+    uint8_t type = header.getByte();
+    uint64_t declared = header.getVarint();
+    const char* reason = nullptr;
+    if (!header.good()) reason = "truncated header";
+    else if (version != kWireVersion) reason = "unsupported version";
+    else if (type != static_cast<uint8_t>(expected)) reason = "unexpected message type";
+    else if (declared != static_cast<uint64_t>(data + length - header.position())) reason = "length mismatch";
+    if (reason) {
+        if (error) *error = reason;
+        return false;
+    }
+    body = header.position();
+    bodyLength = declared;
+    return true;
+}
+
+inline bool closeFrame(const WireReader& reader, const char** error) {
+    if (!reader.good()) {
+        if (error) *error = "truncated field";
+        return false;
+    }
+    if (!reader.atEnd()) {
+        if (error) *error = "trailing bytes";
+        return false;
+    }
+    return true;
+}
+
+} // namespace wire
+
+inline void encode(std::string& out, const AVNNotice& notice) {
+    wire::appendFrame(out, MsgType::AVNNotice, [&](WireWriter& w) {
+        w.putVarint(notice.avnId);
+        w.putString(notice.aircraftId);
+        w.putString(notice.AirlineName);
+        w.putString(notice.aircraftType);
+        w.putString(notice.flightNumber);
+        w.putFixed2(notice.recordedSpeed);
+        w.putFixed2(notice.allowedSpeed);
+        w.putFixed2(notice.totalFine);
+        w.putSigned(notice.timestamp);
+        w.putTrace(notice.trace);
+    });
+}
+
+inline void encode(std::string& out, const PaymentRequest& request) {
+    wire::appendFrame(out, MsgType::PaymentRequest, [&](WireWriter& w) {
+        w.putVarint(request.avnId);
+        w.putString(request.aircraftId);
+        w.putString(request.aircraftType);
+        w.putFixed2(request.totalFine);
+    });
+}
+
+inline void encode(std::string& out, const PaymentConfirmation& confirmation) {
+    wire::appendFrame(out, MsgType::PaymentConfirmation, [&](WireWriter& w) {
+        w.putVarint(confirmation.avnId);
+        w.putString(confirmation.status);
+        w.putTrace(confirmation.trace);
+    });
+}
+
+inline void encode(std::string& out, const ViolationClearance& clearance) {
+    wire::appendFrame(out, MsgType::ViolationClearance, [&](WireWriter& w) {
+        w.putVarint(clearance.avnId);
+        w.putString(clearance.aircraftId);
+        w.putString(clearance.status);
+        w.putTrace(clearance.trace);
+    });
+}
+
+inline bool decode(const char* data, size_t length, AVNNoticeView& view, const char** error = nullptr) {
+    const char* body;
+    size_t bodyLength;
+    if (!wire::openFrame(data, length, MsgType::AVNNotice, body, bodyLength, error)) return false;
+    WireReader r(body, bodyLength);
+    view.avnId = r.getVarint();
+    view.aircraftId = r.getString();
+    view.airlineName = r.getString();
+    view.aircraftType = r.getString();
+    view.flightNumber = r.getString();
+    view.recordedSpeed = r.getFixed2();
+    view.allowedSpeed = r.getFixed2();
+    view.totalFine = r.getFixed2();
+    view.timestamp = static_cast<time_t>(r.getSigned());
+    view.trace = r.getTrace();
+    return wire::closeFrame(r, error);
+}
+
+inline bool decode(const char* data, size_t length, PaymentRequestView& view, const char** error = nullptr) {
+    const char* body;
+    size_t bodyLength;
+    if (!wire::openFrame(data, length, MsgType::PaymentRequest, body, bodyLength, error)) return false;
+    WireReader r(body, bodyLength);
+    view.avnId = r.getVarint();
+    view.aircraftId = r.getString();
+    view.aircraftType = r.getString();
+    view.totalFine = r.getFixed2();
+    return wire::closeFrame(r, error);
+}
+
+inline bool decode(const char* data, size_t length, PaymentConfirmationView& view, const char** error = nullptr) {
+    const char* body;
+    size_t bodyLength;
+    if (!wire::openFrame(data, length, MsgType::PaymentConfirmation, body, bodyLength, error)) return false;
+    WireReader r(body, bodyLength);
+    view.avnId = r.getVarint();
+    view.status = r.getString();
+    view.trace = r.getTrace();
+    return wire::closeFrame(r, error);
+}
+
+inline bool decode(const char* data, size_t length, ViolationClearanceView& view, const char** error = nullptr) {
+    const char* body;
+    size_t bodyLength;
+    if (!wire::openFrame(data, length, MsgType::ViolationClearance, body, bodyLength, error)) return false;
+    WireReader r(body, bodyLength);
+    view.avnId = r.getVarint();
+    view.aircraftId = r.getString();
+    view.status = r.getString();
+    view.trace = r.getTrace();
+    return wire::closeFrame(r, error);
+}
@@ -0,0 +1,162 @@
+// Queries the violation store written by the AVN generator.
+//
+//   ./avnquery [--dir violation_store] list [--airline NAME] [--flight NUMBER]
+//                                           [--from TIME] [--to TIME] [--limit N]
+//   ./avnquery [--dir violation_store] top [--by airline|flight] [--from TIME] [--to TIME] [--limit N]
+//   ./avnquery [--dir violation_store] stats
+//
+// TIME is seconds since the epoch or local "YYYY-MM-DD[ HH:MM[:SS]]". Results go to stdout;
+// the number of matches and the query time go to stderr. A store written by a sharded
+// generator is queried as a whole: list goes through the shards in turn, top and stats
+// combine them.
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include "ViolationStore.hpp"
+
+static bool parseTime(const char* text, int64_t& out) {
+    char* end;
+    long long seconds = strtoll(text, &end, 10);
+    if (*end == '\0' && end != text) {
+        out = seconds;
+        return true;
+    }
+    const char* formats[] = {"%Y-%m-%d %H:%M:%S", "%Y-%m-%d %H:%M", "%Y-%m-%d"};
+    for (const char* format : formats) {
+        struct tm parts;
+        memset(&parts, 0, sizeof(parts));
+        const char* rest = strptime(text, format, &parts);
+        if (rest && *rest == '\0') {
+            parts.tm_isdst = -1;
+            out = mktime(&parts);
+            return true;
+        }
+    }
+    return false;
+}
+
+static std::string formatTime(int64_t seconds) {
+    time_t value = static_cast<time_t>(seconds);
+    char text[32];
+    strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", localtime(&value));
+    return text;
+}
+
+static double elapsedMs(const timespec& start) {
+    timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+static int usage(const char* program) {
+    std::cerr << "Usage: " << program << " [--dir DIRECTORY] list [--airline NAME] [--flight NUMBER]"
+              << " [--from TIME] [--to TIME] [--limit N]\n"
+              << "       " << program << " [--dir DIRECTORY] top [--by airline|flight] [--from TIME] [--to TIME] [--limit N]\n"
+              << "       " << program << " [--dir DIRECTORY] stats\n"
+              << "TIME is seconds since the epoch or \"YYYY-MM-DD[ HH:MM[:SS]]\" (local time)" << std::endl;
+    return 1;
+}
+
+int main(int argc, char* argv[]) {
+    std::string directory = "violation_store";
+    std::string command;
+    ViolationQuery query;
+    bool byFlight = false;
+    long limit = -1;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--dir") == 0 && hasValue) {
+            directory = argv[++i];
+        } else if (strcmp(argv[i], "--airline") == 0 && hasValue) {
+            query.airline = argv[++i];
+        } else if (strcmp(argv[i], "--flight") == 0 && hasValue) {
+            query.flight = argv[++i];
+        } else if (strcmp(argv[i], "--from") == 0 && hasValue) {
+            if (!parseTime(argv[++i], query.from)) return usage(argv[0]);
+        } else if (strcmp(argv[i], "--to") == 0 && hasValue) {
+            if (!parseTime(argv[++i], query.to)) return usage(argv[0]);
+        } else if (strcmp(argv[i], "--limit") == 0 && hasValue) {
+            limit = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--by") == 0 && hasValue) {
+            i++;
+            if (strcmp(argv[i], "flight") == 0) byFlight = true;
+            else if (strcmp(argv[i], "airline") != 0) return usage(argv[0]);
+        } else if (command.empty() && argv[i][0] != '-') {
+            command = argv[i];
+        } else {
+            return usage(argv[0]);
+        }
+    }
+
+    timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    // One reader per part: the root store, or one per generator shard
+    std::deque<ViolationStoreReader> parts;
+    for (const std::string& part : vstore::storeParts(directory)) {
+        parts.emplace_back();
+        parts.back().open(part);
+    }
+
+    if (command == "list") {
+        long matched = 0;
+        for (const ViolationStoreReader& store : parts) {
+            store.query(query, [&](const ViolationRecord& record) {
+                if (limit >= 0 && matched >= limit) return false;
+                matched++;
+                printf("Run %u AVN ID: %s, Aircraft ID: %s, Airline: %s, Flight: %s, Type: %s, Recorded Speed: %.2f, Allowed Speed: %.2f, Fine: $%.2f, Time: %s\n",
+                       record.runId, formatAvnId(record.avnId).c_str(), store.name(record.aircraft).c_str(), store.name(record.airline).c_str(),
+                       store.name(record.flight).c_str(), store.name(record.aircraftType).c_str(),
+                       record.recordedSpeedCenti / 100.0, record.allowedSpeedCenti / 100.0, record.fineCents / 100.0,
+                       formatTime(record.timestamp).c_str());
+                return true;
+            });
+        }
+        fflush(stdout);
+        std::cerr << matched << " AVNs in " << elapsedMs(start) << " ms" << std::endl;
+    } else if (command == "top") {
+        if (!query.airline.empty() || !query.flight.empty()) return usage(argv[0]);
+        // String ids are per part, so totals are combined by name
+        std::map<std::string, OffenderCount> totals;
+        for (const ViolationStoreReader& store : parts) {
+            for (const OffenderCount& count : store.topOffenders(byFlight, query, SIZE_MAX)) {
+                OffenderCount& total = totals[store.name(count.key)];
+                total.count += count.count;
+                total.fineCents += count.fineCents;
+            }
+        }
+        std::vector<std::pair<std::string, OffenderCount>> ranked(totals.begin(), totals.end());
+        std::sort(ranked.begin(), ranked.end(), [](const std::pair<std::string, OffenderCount>& a,
+                                                   const std::pair<std::string, OffenderCount>& b) {
+            return a.second.count != b.second.count ? a.second.count > b.second.count : a.second.fineCents > b.second.fineCents;
+        });
+        if (ranked.size() > static_cast<size_t>(limit < 0 ? 10 : limit)) ranked.resize(limit < 0 ? 10 : limit);
+        printf("%-4s %-20s %10s %16s\n", "Rank", byFlight ? "Flight" : "Airline", "AVNs", "Fines");
+        for (size_t i = 0; i < ranked.size(); i++) {
+            printf("%-4zu %-20s %10llu %16.2f\n", i + 1, ranked[i].first.c_str(),
+                   static_cast<unsigned long long>(ranked[i].second.count), ranked[i].second.fineCents / 100.0);
+        }
+        fflush(stdout);
+        std::cerr << "Ranked in " << elapsedMs(start) << " ms" << std::endl;
+    } else if (command == "stats") {
+        unsigned long long records = 0;
+        size_t segments = 0, sealed = 0;
+        for (const ViolationStoreReader& store : parts) {
+            records += store.recordCount();
+            segments += store.segmentCount();
+            sealed += store.sealedCount();
+        }
+        printf("Store: %s\nParts: %zu\nRecords: %llu\nSegments: %zu (%zu sealed)\n", directory.c_str(),
+               parts.size(), records, segments, sealed);
+    } else {
+        return usage(argv[0]);
+    }
+    return 0;
+}
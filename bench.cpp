@@ -0,0 +1,365 @@
+// Microbenchmarks for the scheduling and compliance hot paths.
+//
+//   ./bench [--max-fleet N] [--min-time SECONDS] [--filter SUBSTRING] [--json] [--out FILE]
+//
+// Every benchmark runs against a headless ATCSystem fleet of 10 .. --max-fleet flights
+// (default 1M, growing by 10x). Flight state touched by a benchmark is restored between
+// iterations outside the timed region, so each iteration measures the same work.
+// The IpcChannel benchmarks stream encoded AVNNotice frames to a forked consumer that
+// decodes them, over each transport; N is the message count there and ns/item the cost
+// per message including encode and decode.
+// --json emits a machine-readable report to stdout (or --out) for tracking regressions.
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include "ATCSystem.hpp"
+#include "SimContext.hpp"
+
+struct BenchOptions {
+    size_t maxFleet = 1000000;
+    double minTimeSeconds = 0.2;
+    std::string filter;
+    bool json = false;
+    std::string outFile;
+};
+
+struct BenchResult {
+    std::string name;
+    size_t fleetSize;
+    long iterations;
+    double nsPerIteration;
+    double nsPerFlight;
+};
+
+static double nowSeconds() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Keeps benchmark results alive so the compiler cannot drop the measured work
+static volatile long benchSink = 0;
+
+// Saved per-flight fields that the benchmarks mutate
+struct FlightSnapshot {
+    AirCraftState state;
+    double speed;
+    int altitude;
+    int priority;
+    bool hasActiveAVN;
+    time_t scheduleTime;
+};
+
+class Fleet {
+public:
+    ATCSystem sim;
+    std::vector<Flight*> order; // original fleet order
+    std::vector<FlightSnapshot> snapshot;
+    std::mt19937 shuffleRng;
+
+    explicit Fleet(size_t size) : sim(true), shuffleRng(7) {
+        sim.flights.reserve(size);
+        for (size_t i = 0; i < size; i++) {
+            Airline& airline = sim.airlines[i % sim.airlines.size()];
+            Direction direction = static_cast<Direction>(simRand() % 4);
+            Flight* flight = new Flight(airline.name + "-" + std::to_string(100 + i), &airline, direction,
+                                        simRand() % 10 == 0);
+            // Spread flights over the whole state machine, not just the initial states
+            int steps = simRand() % 6;
+            for (int s = 0; s < steps; s++) {
+                flight->updateState();
+            }
+            flight->scheduleTime = simTime() - (simRand() % 600);
+            sim.flights.push_back(flight);
+        }
+        save();
+    }
+
+    void save() {
+        order = sim.flights;
+        snapshot.resize(sim.flights.size());
+        for (size_t i = 0; i < sim.flights.size(); i++) {
+            Flight* f = sim.flights[i];
+            snapshot[i] = {f->state, f->speed, f->altitude, f->priority, f->hasActiveAVN, f->scheduleTime};
+        }
+    }
+
+    // Restores flight order as well as state, since some benchmarks sort the fleet
+    void restore() {
+        sim.flights = order;
+        for (size_t i = 0; i < sim.flights.size(); i++) {
+            Flight* f = sim.flights[i];
+            const FlightSnapshot& s = snapshot[i];
+            f->state = s.state;
+            f->speed = s.speed;
+            f->altitude = s.altitude;
+            f->priority = s.priority;
+            f->hasActiveAVN = s.hasActiveAVN;
+            f->scheduleTime = s.scheduleTime;
+        }
+        sim.avns.clear();
+        sim.arrivalCompletionTimes.clear();
+        sim.departureCompletionTimes.clear();
+        sim.runwayStatus[0] = sim.runwayStatus[1] = sim.runwayStatus[2] = false;
+    }
+};
+
+class BenchRunner {
+private:
+    BenchOptions options;
+    std::vector<BenchResult> results;
+
+public:
+    explicit BenchRunner(const BenchOptions& options) : options(options) {}
+
+    const std::vector<BenchResult>& getResults() const { return results; }
+
+    // body runs one iteration over the fleet; reset restores state outside the timed region
+    void run(const std::string& name, Fleet& fleet,
+             const std::function<void(Fleet&)>& body, const std::function<void(Fleet&)>& reset) {
+        if (!selected(name)) {
+            return;
+        }
+        size_t fleetSize = fleet.sim.flights.size();
+
+        double timed = 0;
+        long iterations = 0;
+        while (timed < options.minTimeSeconds || iterations < 3) {
+            reset(fleet);
+            double start = nowSeconds();
+            body(fleet);
+            timed += nowSeconds() - start;
+            iterations++;
+        }
+        reset(fleet);
+
+        BenchResult result;
+        result.name = name;
+        result.fleetSize = fleetSize;
+        result.iterations = iterations;
+        result.nsPerIteration = timed * 1e9 / iterations;
+        result.nsPerFlight = fleetSize ? result.nsPerIteration / fleetSize : 0;
+        record(result);
+    }
+
+    bool selected(const std::string& name) const {
+        return options.filter.empty() || name.find(options.filter) != std::string::npos;
+    }
+
+    void record(const BenchResult& result) {
+        results.push_back(result);
+
+        if (!options.json) {
+            char line[256];
+            snprintf(line, sizeof(line), "%-40s %10zu %10ld %16.0f %12.2f\n", result.name.c_str(),
+                     result.fleetSize, result.iterations, result.nsPerIteration, result.nsPerFlight);
+            std::cout << line << std::flush;
+        }
+    }
+};
+
+static void runFleetBenchmarks(BenchRunner& runner, size_t fleetSize) {
+    Fleet fleet(fleetSize);
+    std::string suffix = "/" + std::to_string(fleetSize);
+    auto restore = [](Fleet& f) { f.restore(); };
+
+    runner.run("Flight::updateState" + suffix, fleet, [](Fleet& f) {
+        for (auto flight : f.sim.flights) {
+            flight->updateState();
+        }
+        benchSink = benchSink + f.sim.flights.front()->altitude;
+    }, restore);
+
+    runner.run("Flight::speedViolation" + suffix, fleet, [](Fleet& f) {
+        long violations = 0;
+        for (auto flight : f.sim.flights) {
+            violations += flight->speedViolation();
+        }
+        benchSink = benchSink + violations;
+    }, [](Fleet&) {});
+
+    // Shuffled input: the worst case for the re-sort done on every scheduling pass
+    runner.run("ATCSystem::comparisonFunction+sort" + suffix, fleet, [](Fleet& f) {
+        std::sort(f.sim.flights.begin(), f.sim.flights.end(), ATCSystem::comparisonFunction);
+        benchSink = benchSink + f.sim.flights.front()->priority;
+    }, [](Fleet& f) {
+        std::shuffle(f.sim.flights.begin(), f.sim.flights.end(), f.shuffleRng);
+    });
+
+    runner.run("ATCSystem::assignRunway" + suffix, fleet, [](Fleet& f) {
+        long assigned = 0;
+        for (auto flight : f.sim.flights) {
+            Runway runway = f.sim.assignRunway(flight);
+            assigned += static_cast<int>(runway);
+            // Free it again so every call takes the same branch as the first one
+            f.sim.releaseRunway(runway);
+        }
+        benchSink = benchSink + assigned;
+    }, restore);
+
+    // Headless instances have no atcs_to_avn pipe, so the write is skipped
+    runner.run("ATCSystem::issueSpeedViolationAVN" + suffix, fleet, [](Fleet& f) {
+        for (auto flight : f.sim.flights) {
+            f.sim.issueSpeedViolationAVN(flight);
+        }
+        benchSink = benchSink + f.sim.avns.size();
+    }, restore);
+
+    runner.run("ATCSystem::processFlights" + suffix, fleet, [](Fleet& f) {
+        f.sim.processFlights();
+        benchSink = benchSink + f.sim.flights.size();
+    }, restore);
+
+    fleet.restore(); // the ATCSystem destructor deletes every flight in the original order
+}
+
+// One producer (this process) and one consumer (a child) per iteration; the clock stops
+// once the consumer has read every message and exited
+static void runIpcBenchmark(BenchRunner& runner, IpcTransport transport, const char* transportName, long messages) {
+    std::string name = std::string("IpcChannel(") + transportName + ")::AVNNotice/" + std::to_string(messages);
+    if (!runner.selected(name)) {
+        return;
+    }
+
+    double timed = 0;
+    long iterations = 0;
+    while (iterations < 3) {
+        IpcChannel channel;
+        if (!channel.create(transport, kTypicalFrameBytes)) {
+            std::cerr << "Failed to create " << transportName << " channel" << std::endl;
+            return;
+        }
+        AVNNotice notice;
+        notice.aircraftId = notice.flightNumber = "PIA-101";
+        notice.AirlineName = "PIA";
+        notice.aircraftType = "Commercial";
+        notice.recordedSpeed = 612.5;
+        notice.allowedSpeed = 600;
+        notice.totalFine = 575000;
+        notice.timestamp = time(nullptr);
+        std::string frame;
+
+        double start = nowSeconds();
+        pid_t consumer = fork();
+        if (consumer == 0) {
+            char buffer[IpcChannel::kMaxMessageSize];
+            AVNNoticeView received;
+            for (long i = 0; i < messages; i++) {
+                ssize_t length = channel.read(buffer, sizeof(buffer));
+                if (length <= 0 || !decode(buffer, length, received) || received.avnId != static_cast<AvnId>(i)) _exit(1);
+            }
+            _exit(0);
+        }
+        for (long i = 0; i < messages; i++) {
+            notice.avnId = static_cast<AvnId>(i);
+            frame.clear();
+            encode(frame, notice);
+            channel.write(frame.data(), frame.size());
+        }
+        int status = 0;
+        waitpid(consumer, &status, 0);
+        timed += nowSeconds() - start;
+        iterations++;
+        channel.close();
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            std::cerr << name << ": consumer saw missing or reordered messages" << std::endl;
+            return;
+        }
+    }
+
+    BenchResult result;
+    result.name = name;
+    result.fleetSize = messages;
+    result.iterations = iterations;
+    result.nsPerIteration = timed * 1e9 / iterations;
+    result.nsPerFlight = result.nsPerIteration / messages;
+    runner.record(result);
+}
+
+static std::string jsonEscape(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+static void writeJson(std::ostream& out, const std::vector<BenchResult>& results) {
+    char date[64];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+    utsname host;
+    uname(&host);
+
+    out << "{\n  \"context\": {\n"
+        << "    \"date\": \"" << date << "\",\n"
+        << "    \"host\": \"" << jsonEscape(host.nodename) << "\",\n"
+        << "    \"cpus\": " << sysconf(_SC_NPROCESSORS_ONLN) << ",\n"
+        << "    \"compiler\": \"" << jsonEscape(__VERSION__) << "\"\n"
+        << "  },\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        out << "    {\"name\": \"" << jsonEscape(r.name) << "\", \"fleet_size\": " << r.fleetSize
+            << ", \"iterations\": " << r.iterations
+            << ", \"ns_per_iteration\": " << r.nsPerIteration
+            << ", \"ns_per_flight\": " << r.nsPerFlight << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--json") options.json = true;
+        else if (arg == "--max-fleet" && i + 1 < argc) options.maxFleet = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--min-time" && i + 1 < argc) options.minTimeSeconds = atof(argv[++i]);
+        else if (arg == "--filter" && i + 1 < argc) options.filter = argv[++i];
+        else if (arg == "--out" && i + 1 < argc) options.outFile = argv[++i];
+        else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--max-fleet N] [--min-time SECONDS] [--filter SUBSTRING] [--json] [--out FILE]" << std::endl;
+            return 1;
+        }
+    }
+
+    // Fixed seed, virtual clock and no console output for the whole run
+    SimContext context(42);
+    ScopedSimContext scoped(context);
+
+    BenchRunner runner(options);
+    if (!options.json) {
+        char line[256];
+        snprintf(line, sizeof(line), "%-40s %10s %10s %16s %12s\n",
+                 "Benchmark", "N", "Iters", "ns/iteration", "ns/item");
+        std::cout << line;
+    }
+    for (size_t fleetSize = 10; fleetSize <= options.maxFleet; fleetSize *= 10) {
+        runFleetBenchmarks(runner, fleetSize);
+    }
+    for (long messages : {1000L, 100000L}) {
+        runIpcBenchmark(runner, IpcTransport::Pipe, "pipe", messages);
+        runIpcBenchmark(runner, IpcTransport::SharedRing, "ring", messages);
+    }
+
+    if (options.json) {
+        if (!options.outFile.empty()) {
+            std::ofstream file(options.outFile);
+            writeJson(file, runner.getResults());
+        } else {
+            writeJson(std::cout, runner.getResults());
+        }
+    }
+    return 0;
+}
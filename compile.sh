@@ -2,13 +2,57 @@
 
 echo "Compiling AirControlX application with integrated ATCSystem..."
 
+# Optional flags:
+#   PROFILE_LOCKS=1 ./compile.sh   -> record mutex wait/hold times and print a report at the end of the run
+EXTRA_FLAGS=""
+if [ "$PROFILE_LOCKS" = "1" ]; then
+    EXTRA_FLAGS="$EXTRA_FLAGS -DLOCK_PROFILING"
+    echo "Lock contention profiling enabled"
+fi
+
 # Compile the SFML menu with integrated ATCSystem using pthreads
-g++ -o sfml_menu source.cpp -lsfml-graphics -lsfml-window -lsfml-system -pthread -Wall
+g++ -o sfml_menu source.cpp -lsfml-graphics -lsfml-window -lsfml-system -pthread -Wall $EXTRA_FLAGS
 
 # Check if compilation was successful
 if [ $? -eq 0 ]; then
     echo "Compilation successful!"
-    echo "To run the application, execute: ./sfml_menu"
+    echo "To run the application, execute: ./sfml_menu [--pipes|--sockets] [--no-audio] [--avn-shards N] [--avn-batch N] [--avn-flush-ms MS]"
+    echo "                                 [--avn-log-retention N] [--outbox-capacity N] [--outbox-policy block|coalesce|spill]"
+    echo "                                 [--stripe-workers N] [--stripe-inflight N]"
+    echo "                                 [--gateway-latency-ms MS] [--gateway-jitter-ms MS] [--gateway-failure-rate P]"
+    echo "                                 [--journal-durability none|group|sync] [--journal-window-ms MS]"
+    echo "                                 [--heartbeat-timeout-ms MS] [--no-restart] [--trace DIR] [--file-io auto|uring|threads]"
+    echo "Headless wait-time estimate: ./sfml_menu --montecarlo [--replications N] [--threshold X]"
 else
     echo "Compilation failed. Please check for errors."
-fi
\ No newline at end of file
+fi
+
+# Microbenchmarks for the scheduling/compliance hot paths (./bench --json for regression tracking)
+g++ -O2 -o bench bench.cpp -lsfml-graphics -lsfml-window -lsfml-system -pthread -Wall $EXTRA_FLAGS
+if [ $? -eq 0 ]; then
+    echo "Benchmarks built: ./bench [--max-fleet N] [--json --out results.json]"
+fi
+
+# Text export of the binary payment journal written by the StripePay process
+g++ -O2 -o journal_export journal_export.cpp -Wall
+if [ $? -eq 0 ]; then
+    echo "Journal exporter built: ./journal_export [--dir payment_journal] [--from SEQUENCE]"
+fi
+
+# Queries over the violation store written by the AVN generator
+g++ -O2 -o avnquery avnquery.cpp -Wall
+if [ $? -eq 0 ]; then
+    echo "Violation query tool built: ./avnquery [--dir violation_store] list|top|stats [--airline NAME] [--flight NUMBER] [--from TIME] [--to TIME]"
+fi
+
+# Per-stage latency histograms from the span files written with --trace DIR
+g++ -O2 -o trace_report trace_report.cpp -Wall
+if [ $? -eq 0 ]; then
+    echo "Trace report tool built: ./trace_report [--dir DIRECTORY] [--stage NAME]"
+fi
+
+# Round-trip throughput, latency and CPU cost of the IPC transports (pipe, Unix socket, shared-memory ring)
+g++ -O2 -o ipc_bench ipc_bench.cpp -pthread -Wall
+if [ $? -eq 0 ]; then
+    echo "IPC transport benchmark built: ./ipc_bench [--messages N] [--transports pipe,socket,ring] [--sizes 64,256,1000] [--batches 1,16,64] [--window N] [--json --out FILE]"
+fi
@@ -0,0 +1,413 @@
+// Round-trip benchmark of the IpcChannel transports on the AVN payment flow.
+//
+//   ./ipc_bench [--messages N] [--transports pipe,socket,ring] [--sizes 64,256,1000]
+//               [--batches 1,16,64] [--window N] [--json] [--out FILE]
+//
+// Three forked processes play the payment path over one transport: the driver sends
+// AVNNotices to a "portal" process, which turns each into a PaymentRequest for a "stripe"
+// process, which answers the driver with a PaymentConfirmation. Every hop decodes and
+// re-encodes, drains whatever is waiting and forwards it in writes of up to the batch size;
+// the driver sends in batches of that size too and keeps at most --window messages in flight.
+//
+//   msgs/s   round trips completed per second
+//   p50..    latency of one round trip, from the driver's write to the confirmation's arrival
+//   CPU      user + system time of all three processes per round trip
+//
+// The size is that of the AVNNotice frame (the aircraft ID is padded to reach it); requests
+// are about as large, confirmations a few bytes.
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "ShmRing.hpp"
+#include "WireFormat.hpp"
+
+struct IpcBenchOptions {
+    long messages = 50000;
+    std::vector<IpcTransport> transports = {IpcTransport::Pipe, IpcTransport::UnixSocket, IpcTransport::SharedRing};
+    std::vector<int> sizes = {64, 256, 1000};
+    std::vector<int> batches = {1, 16, 64};
+    long window = 256;
+    bool json = false;
+    std::string outFile;
+};
+
+struct IpcBenchResult {
+    std::string transport;
+    size_t frameBytes;
+    int batch;
+    double messagesPerSecond;
+    double p50Us, p99Us, p999Us;
+    double cpuUsPerMessage;
+};
+
+static const char* transportName(IpcTransport transport) {
+    switch (transport) {
+        case IpcTransport::Pipe: return "pipe";
+        case IpcTransport::UnixSocket: return "socket";
+        case IpcTransport::SharedRing: return "ring";
+        default: return "none";
+    }
+}
+
+static int64_t nowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static double cpuSeconds(const struct rusage& usage) {
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+// Sleeps until the channel may have a message; for consumers that use tryRead()
+static void waitReadable(IpcChannel& channel) {
+    if (!channel.armWait()) return;
+    struct pollfd fd = {channel.pollFd(), POLLIN, 0};
+    if (poll(&fd, 1, -1) < 0) fd.revents = 0;
+    channel.disarmWait(fd.revents & POLLIN);
+}
+
+// Frames back to back in one string, one iovec per frame
+struct FrameBatch {
+    std::string frames;
+    std::vector<size_t> ends;
+    std::vector<struct iovec> vectors;
+
+    void clear() {
+        frames.clear();
+        ends.clear();
+    }
+    void endFrame() { ends.push_back(frames.size()); }
+    struct iovec* iov() {
+        vectors.resize(ends.size());
+        size_t start = 0;
+        for (size_t i = 0; i < ends.size(); i++) {
+            vectors[i] = {&frames[start], ends[i] - start};
+            start = ends[i];
+        }
+        return vectors.data();
+    }
+    int count() const { return static_cast<int>(ends.size()); }
+};
+
+// Portal and Stripe stand-ins: forward messages until `messages` have passed through
+template <typename View, typename Convert>
+[[noreturn]] static void runHop(IpcChannel& in, IpcChannel& out, long messages, int batch, Convert convert) {
+    char frame[IpcChannel::kMaxMessageSize];
+    FrameBatch outgoing;
+    long forwarded = 0;
+    while (forwarded < messages) {
+        outgoing.clear();
+        while (outgoing.count() < batch) {
+            ssize_t length = in.tryRead(frame, sizeof(frame));
+            if (length < 0 && errno == EAGAIN) break;
+            View view;
+            if (length <= 0 || length > static_cast<ssize_t>(sizeof(frame)) || !decode(frame, length, view)) _exit(1);
+            encode(outgoing.frames, convert(view));
+            outgoing.endFrame();
+        }
+        if (outgoing.count() == 0) {
+            waitReadable(in);
+            continue;
+        }
+        if (out.writeBatch(outgoing.iov(), outgoing.count()) != outgoing.count()) _exit(1);
+        forwarded += outgoing.count();
+    }
+    _exit(0);
+}
+
+// Driver state shared by its sender and receiver threads
+struct Driver {
+    IpcChannel* notices;
+    IpcChannel* confirmations;
+    long messages;
+    int batch;
+    long window;
+    AVNNotice notice;
+    std::vector<int64_t> sentNs;     // by AVN ID
+    std::vector<int64_t> latencyNs;  // in arrival order
+    bool failed;
+    pthread_mutex_t mutex;
+    pthread_cond_t windowOpen;
+    long received;
+};
+
+static void* driverSend(void* arg) {
+    Driver* driver = static_cast<Driver*>(arg);
+    FrameBatch outgoing;
+    for (long sent = 0; sent < driver->messages;) {
+        int count = static_cast<int>(std::min<long>(driver->batch, driver->messages - sent));
+        pthread_mutex_lock(&driver->mutex);
+        while (sent + count - driver->received > driver->window && !driver->failed) {
+            pthread_cond_wait(&driver->windowOpen, &driver->mutex);
+        }
+        bool failed = driver->failed;
+        pthread_mutex_unlock(&driver->mutex);
+        if (failed) break;
+
+        outgoing.clear();
+        for (int i = 0; i < count; i++) {
+            driver->notice.avnId = static_cast<AvnId>(sent + i);
+            encode(outgoing.frames, driver->notice);
+            outgoing.endFrame();
+        }
+        int64_t now = nowNs();
+        for (int i = 0; i < count; i++) driver->sentNs[sent + i] = now;
+        if (driver->notices->writeBatch(outgoing.iov(), count) != count) break;
+        sent += count;
+    }
+    return nullptr;
+}
+
+static void* driverReceive(void* arg) {
+    Driver* driver = static_cast<Driver*>(arg);
+    char frame[IpcChannel::kMaxMessageSize];
+    std::vector<bool> seen(driver->messages, false);
+    for (long i = 0; i < driver->messages; i++) {
+        ssize_t length = driver->confirmations->read(frame, sizeof(frame));
+        int64_t now = nowNs();
+        PaymentConfirmationView confirmation;
+        bool valid = length > 0 && length <= static_cast<ssize_t>(sizeof(frame)) && decode(frame, length, confirmation) &&
+                     confirmation.avnId < static_cast<AvnId>(driver->messages) && !seen[confirmation.avnId];
+        pthread_mutex_lock(&driver->mutex);
+        if (!valid) {
+            driver->failed = true;
+        } else {
+            seen[confirmation.avnId] = true;
+            driver->latencyNs.push_back(now - driver->sentNs[confirmation.avnId]);
+            driver->received++;
+        }
+        pthread_cond_signal(&driver->windowOpen);
+        pthread_mutex_unlock(&driver->mutex);
+        if (!valid) break;
+    }
+    return nullptr;
+}
+
+// One transport, frame size and batch size; false if a process failed or lost a message
+static bool runRoundTrip(const IpcBenchOptions& options, IpcTransport transport, int frameSize, int batch,
+                         IpcBenchResult& result) {
+    IpcChannel notices, requests, confirmations;
+    if (!notices.create(transport, frameSize) || !requests.create(transport, frameSize) ||
+        !confirmations.create(transport, kTypicalFrameBytes)) {
+        std::cerr << transportName(transport) << ": cannot create channels" << std::endl;
+        return false;
+    }
+
+    Driver driver;
+    driver.notices = &notices;
+    driver.confirmations = &confirmations;
+    driver.messages = options.messages;
+    driver.batch = batch;
+    driver.window = std::max<long>(options.window, batch);
+    driver.notice.AirlineName = "PIA";
+    driver.notice.aircraftType = "Commercial";
+    driver.notice.flightNumber = "PIA-101";
+    driver.notice.recordedSpeed = 612.5;
+    driver.notice.allowedSpeed = 600;
+    driver.notice.totalFine = 575000;
+    driver.notice.timestamp = time(nullptr);
+    driver.notice.avnId = static_cast<AvnId>(options.messages);
+    std::string probe;
+    encode(probe, driver.notice);
+    if (frameSize > static_cast<int>(probe.size())) {
+        driver.notice.aircraftId.assign(frameSize - probe.size(), 'A');
+    }
+    probe.clear();
+    encode(probe, driver.notice);
+    driver.sentNs.assign(options.messages, 0);
+    driver.latencyNs.reserve(options.messages);
+    driver.failed = false;
+    driver.received = 0;
+    pthread_mutex_init(&driver.mutex, NULL);
+    pthread_cond_init(&driver.windowOpen, NULL);
+
+    long messages = options.messages;
+    pid_t portal = fork();
+    if (portal == 0) {
+        runHop<AVNNoticeView>(notices, requests, messages, batch, [](const AVNNoticeView& notice) {
+            PaymentRequest request;
+            request.avnId = notice.avnId;
+            request.aircraftId = std::string(notice.aircraftId);
+            request.aircraftType = std::string(notice.aircraftType);
+            request.totalFine = notice.totalFine;
+            return request;
+        });
+    }
+    pid_t stripe = fork();
+    if (stripe == 0) {
+        runHop<PaymentRequestView>(requests, confirmations, messages, batch, [](const PaymentRequestView& request) {
+            PaymentConfirmation confirmation;
+            confirmation.avnId = request.avnId;
+            confirmation.status = "paid";
+            return confirmation;
+        });
+    }
+
+    struct rusage selfStart, selfEnd;
+    getrusage(RUSAGE_SELF, &selfStart);
+    int64_t start = nowNs();
+    pthread_t sender, receiver;
+    pthread_create(&receiver, NULL, driverReceive, &driver);
+    pthread_create(&sender, NULL, driverSend, &driver);
+    pthread_join(receiver, NULL);
+    int64_t elapsed = nowNs() - start;
+    getrusage(RUSAGE_SELF, &selfEnd);
+    if (driver.failed) {
+        // Unblock the sender if it is waiting on a hop that has died
+        notices.close();
+        requests.close();
+        confirmations.close();
+        kill(portal, SIGKILL);
+        kill(stripe, SIGKILL);
+    }
+    pthread_join(sender, NULL);
+
+    double childCpu = 0;
+    bool childrenOk = true;
+    for (pid_t child : {portal, stripe}) {
+        int status = 0;
+        struct rusage usage;
+        if (child < 0 || wait4(child, &status, 0, &usage) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            childrenOk = false;
+        } else {
+            childCpu += cpuSeconds(usage);
+        }
+    }
+    notices.close();
+    requests.close();
+    confirmations.close();
+    pthread_cond_destroy(&driver.windowOpen);
+    pthread_mutex_destroy(&driver.mutex);
+    if (driver.failed || !childrenOk) {
+        std::cerr << transportName(transport) << " size " << frameSize << " batch " << batch
+                  << ": a process failed or a message was lost" << std::endl;
+        return false;
+    }
+
+    std::vector<int64_t>& latencies = driver.latencyNs;
+    std::sort(latencies.begin(), latencies.end());
+    auto percentileUs = [&](double p) {
+        return latencies[static_cast<size_t>(p * (latencies.size() - 1) + 0.5)] / 1000.0;
+    };
+    result.transport = transportName(transport);
+    result.frameBytes = probe.size();
+    result.batch = batch;
+    result.messagesPerSecond = messages * 1e9 / elapsed;
+    result.p50Us = percentileUs(0.50);
+    result.p99Us = percentileUs(0.99);
+    result.p999Us = percentileUs(0.999);
+    result.cpuUsPerMessage = (cpuSeconds(selfEnd) - cpuSeconds(selfStart) + childCpu) * 1e6 / messages;
+    return true;
+}
+
+static void writeJson(std::ostream& out, const IpcBenchOptions& options, const std::vector<IpcBenchResult>& results) {
+    out << "{\n  \"context\": {\"messages\": " << options.messages << ", \"window\": " << options.window
+        << ", \"cpus\": " << sysconf(_SC_NPROCESSORS_ONLN) << "},\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const IpcBenchResult& r = results[i];
+        out << "    {\"transport\": \"" << r.transport << "\", \"frame_bytes\": " << r.frameBytes
+            << ", \"batch\": " << r.batch << ", \"msgs_per_s\": " << r.messagesPerSecond
+            << ", \"p50_us\": " << r.p50Us << ", \"p99_us\": " << r.p99Us << ", \"p999_us\": " << r.p999Us
+            << ", \"cpu_us_per_msg\": " << r.cpuUsPerMessage << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+static bool parseList(const char* text, std::vector<int>& values) {
+    values.clear();
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        int value = atoi(item.c_str());
+        if (value <= 0) return false;
+        values.push_back(value);
+    }
+    return !values.empty();
+}
+
+static bool parseTransports(const char* text, std::vector<IpcTransport>& transports) {
+    transports.clear();
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (item == "pipe") transports.push_back(IpcTransport::Pipe);
+        else if (item == "socket") transports.push_back(IpcTransport::UnixSocket);
+        else if (item == "ring") transports.push_back(IpcTransport::SharedRing);
+        else return false;
+    }
+    return !transports.empty();
+}
+
+int main(int argc, char** argv) {
+    IpcBenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--messages" && hasValue) options.messages = atol(argv[++i]);
+        else if (arg == "--transports" && hasValue && parseTransports(argv[i + 1], options.transports)) i++;
+        else if (arg == "--sizes" && hasValue && parseList(argv[i + 1], options.sizes)) i++;
+        else if (arg == "--batches" && hasValue && parseList(argv[i + 1], options.batches)) i++;
+        else if (arg == "--window" && hasValue) options.window = atol(argv[++i]);
+        else if (arg == "--json") options.json = true;
+        else if (arg == "--out" && hasValue) options.outFile = argv[++i];
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--messages N] [--transports pipe,socket,ring] [--sizes 64,256,1000]\n"
+                      << "       " << std::string(strlen(argv[0]), ' ')
+                      << " [--batches 1,16,64] [--window N] [--json] [--out FILE]" << std::endl;
+            return 1;
+        }
+    }
+    if (options.messages < 1) options.messages = 1;
+    if (options.window < 1) options.window = 1;
+    for (int& size : options.sizes) size = std::min<int>(size, IpcChannel::kMaxMessageSize);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (!options.json) {
+        printf("%-8s %7s %6s %12s %10s %10s %10s %12s\n", "Transport", "Bytes", "Batch", "msgs/s", "p50 us", "p99 us",
+               "p99.9 us", "CPU us/msg");
+        fflush(stdout);
+    }
+    std::vector<IpcBenchResult> results;
+    bool allOk = true;
+    for (int size : options.sizes) {
+        for (int batch : options.batches) {
+            for (IpcTransport transport : options.transports) {
+                IpcBenchResult result;
+                if (!runRoundTrip(options, transport, size, batch, result)) {
+                    allOk = false;
+                    continue;
+                }
+                results.push_back(result);
+                if (!options.json) {
+                    printf("%-8s %7zu %6d %12.0f %10.1f %10.1f %10.1f %12.2f\n", result.transport.c_str(), result.frameBytes,
+                           result.batch, result.messagesPerSecond, result.p50Us, result.p99Us, result.p999Us,
+                           result.cpuUsPerMessage);
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+
+    if (options.json) {
+        if (!options.outFile.empty()) {
+            std::ofstream file(options.outFile);
+            writeJson(file, options, results);
+        } else {
+            writeJson(std::cout, options, results);
+        }
+    }
+    return allOk ? 0 : 1;
+}
@@ -10,8 +10,9 @@
 #include "AVNGenerator.hpp"
 #include "AirlinePortal.hpp"
 #include "StripePayment.hpp"
+#include "MonteCarlo.hpp"
+#include "Supervisor.hpp"
 #include <sys/types.h>
-#include <sys/wait.h>
 
 // Global ATCSystem instance that can be accessed by the SFML interface
 ATCSystem* ATCS = nullptr;
@@ -22,20 +23,16 @@ AVNGenerator *avnGen = nullptr;
 AirlinePortal *airlinePortal = nullptr;
 StripePayment *stripePayment = nullptr;
 
-pid_t avnGen_id;
-pid_t airlinePortal_id;
-pid_t stripePayment_id;
-
 const float speed = 2;
 
 
-// Pipe file descriptors
-int atcs_to_avn[2];      // ATCS Controller to AVN Generator
-int avn_to_airline[2];   // AVN Generator to Airline Portal
-int avn_to_stripe[2];    // AVN Generator to StripePay Process
-int stripe_to_avn[2];    // StripePay Process to AVN Generator
-int stripe_to_airline[2]; // StripePay Process to Airline Portal
-int avn_to_atcs[2];      // AVN Generator to ATCS Controller
+// IPC channels between the processes (shared-memory rings by default, pipes with --pipes).
+// Those to and from the AVN Generator come once per generator shard (--avn-shards).
+std::vector<IpcChannel> atcs_to_avn;   // ATCS Controller to AVN Generator
+std::vector<BroadcastLog*> avn_logs;   // AVN Generator to Airline Portal and StripePay Process (shared memory)
+std::vector<IpcChannel> stripe_to_avn; // StripePay Process to AVN Generator
+IpcChannel stripe_to_airline;          // StripePay Process to Airline Portal
+std::vector<IpcChannel> avn_to_atcs;   // AVN Generator to ATCS Controller
 
 
 // Thread function to run the simulation
@@ -46,10 +43,10 @@ void* runSimulationThread(void* arg) {
     ATCS->startSimulation();
     
     // When simulation is done
-    pthread_mutex_lock(&atcMutex);
+    PROFILED_LOCK(atcMutex);
     simulationRunning = false;
     std::cout << "Simulation thread completed" << std::endl;
-    pthread_mutex_unlock(&atcMutex);
+    PROFILED_UNLOCK(atcMutex);
     
     return nullptr;
 }
@@ -247,7 +244,7 @@ public:
         }
         lastUpdateTime = now;
         
-        pthread_mutex_lock(&atcMutex);
+        PROFILED_LOCK(atcMutex);
         
         // Update timer
         time_t elapsedTime = difftime(now, ATCS->getSimulationStartTime());
@@ -396,7 +393,7 @@ public:
             avnTableRows.push_back(row);
         }
         
-        pthread_mutex_unlock(&atcMutex);
+        PROFILED_UNLOCK(atcMutex);
         
         dataInitialized = true;
     }
@@ -477,41 +474,150 @@ public:
     }
 };
 
-int main() {
+int main(int argc, char** argv) {
+    // Headless capacity-planning mode: no window, no child processes
+    if (argc > 1 && strcmp(argv[1], "--montecarlo") == 0) {
+        return runMonteCarlo(argc, argv);
+    }
+
     srand(time(0)); // Seed the random number generator
 
     ///////////////////
 
-    if (pipe(atcs_to_avn) < 0 || pipe(avn_to_airline) < 0 ||
-        pipe(avn_to_stripe) < 0 || pipe(stripe_to_avn) < 0 ||
-        pipe(stripe_to_airline) < 0 || pipe(avn_to_atcs) < 0){
+    IpcTransport transport = IpcTransport::SharedRing;
+    AVNBatchOptions avnBatchOptions;
+    OutboxOptions outboxOptions;
+    bool audioAlerts = true;
+    uint32_t avnLogRetention = 4096;
+    StripeOptions stripeOptions;
+    LocalGatewayOptions gatewayOptions;
+    SupervisorOptions supervisorOptions;
+    int avnShards = 1;
+    const char* traceDirectory = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--pipes") == 0) {
+            transport = IpcTransport::Pipe;
+        } else if (strcmp(argv[i], "--sockets") == 0) {
+            transport = IpcTransport::UnixSocket;
+        } else if (strcmp(argv[i], "--no-audio") == 0) {
+            audioAlerts = false;
+        } else if (strcmp(argv[i], "--avn-batch") == 0 && i + 1 < argc) {
+            avnBatchOptions.maxBatch = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--avn-flush-ms") == 0 && i + 1 < argc) {
+            avnBatchOptions.flushLatencyMs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--avn-shards") == 0 && i + 1 < argc) {
+            avnShards = std::max(1, std::min(atoi(argv[++i]), kMaxAvnShards));
+        } else if (strcmp(argv[i], "--avn-log-retention") == 0 && i + 1 < argc) {
+            avnLogRetention = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--stripe-workers") == 0 && i + 1 < argc) {
+            stripeOptions.workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--stripe-inflight") == 0 && i + 1 < argc) {
+            stripeOptions.maxInFlight = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--gateway-latency-ms") == 0 && i + 1 < argc) {
+            gatewayOptions.latencyMs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--gateway-jitter-ms") == 0 && i + 1 < argc) {
+            gatewayOptions.jitterMs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--gateway-failure-rate") == 0 && i + 1 < argc) {
+            gatewayOptions.failureRate = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--journal-durability") == 0 && i + 1 < argc &&
+                   parseJournalDurability(argv[i + 1], stripeOptions.journal.durability)) {
+            i++;
+        } else if (strcmp(argv[i], "--journal-window-ms") == 0 && i + 1 < argc) {
+            stripeOptions.journal.commitWindowMs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--outbox-capacity") == 0 && i + 1 < argc) {
+            outboxOptions.capacity = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--outbox-policy") == 0 && i + 1 < argc &&
+                   parseOutboxPolicy(argv[i + 1], outboxOptions.policy)) {
+            i++;
+        } else if (strcmp(argv[i], "--heartbeat-timeout-ms") == 0 && i + 1 < argc) {
+            supervisorOptions.heartbeatTimeoutMs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--no-restart") == 0) {
+            supervisorOptions.restart = false;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            traceDirectory = argv[++i];
+        } else if (strcmp(argv[i], "--file-io") == 0 && i + 1 < argc &&
+                   parseAsyncWriterBackend(argv[i + 1], asyncWriterDefaults().backend)) {
+            i++;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--pipes|--sockets] [--no-audio] [--avn-shards N] [--avn-batch N] [--avn-flush-ms MS]"
+                      << " [--avn-log-retention N] [--outbox-capacity N] [--outbox-policy block|coalesce|spill]\n"
+                      << "       " << std::string(strlen(argv[0]), ' ') << " [--stripe-workers N] [--stripe-inflight N]"
+                      << " [--gateway-latency-ms MS] [--gateway-jitter-ms MS] [--gateway-failure-rate P]\n"
+                      << "       " << std::string(strlen(argv[0]), ' ') << " [--journal-durability none|group|sync]"
+                      << " [--journal-window-ms MS] [--heartbeat-timeout-ms MS] [--no-restart] [--trace DIR]\n"
+                      << "       " << std::string(strlen(argv[0]), ' ') << " [--file-io auto|uring|threads]\n"
+                      << "       " << argv[0] << " --montecarlo [options]" << std::endl;
+            return 1;
+        }
+    }
+
+    // Every process inherits tracing; each writes its own span file into the directory
+    if (traceDirectory) {
+        if (!traceEnable(traceDirectory)) return 1;
+        traceSetProcess("atcs");
+        std::cout << "Tracing AVNs into " << traceDirectory << "/ (./trace_report --dir " << traceDirectory << ")" << std::endl;
+    }
 
-        std::cerr << "Pipe creation failed\n";
+    // Must exist before the forks so every process shares the same rings/pipes
+    atcs_to_avn.resize(avnShards);
+    stripe_to_avn.resize(avnShards);
+    avn_to_atcs.resize(avnShards);
+    if (!stripe_to_airline.create(transport, kTypicalFrameBytes)) {
+        std::cerr << "IPC channel creation failed\n";
         return 1;
     }
-    if (avnGen == nullptr) {
-        avnGen_id = fork();
-        if (avnGen_id == 0) {
-            avnGen = new AVNGenerator(atcs_to_avn, avn_to_atcs, avn_to_airline, avn_to_stripe, stripe_to_avn);
-            avnGen->run();
-            exit(0);
+    for (int shard = 0; shard < avnShards; shard++) {
+        if (!atcs_to_avn[shard].create(transport, kTypicalFrameBytes) || !stripe_to_avn[shard].create(transport, kTypicalFrameBytes) ||
+            !avn_to_atcs[shard].create(transport, kTypicalFrameBytes)) {
+            std::cerr << "IPC channel creation failed\n";
+            return 1;
         }
     }
-    if (airlinePortal == nullptr) {
-        airlinePortal_id = fork();
-        if (airlinePortal_id == 0) {
-            airlinePortal = new AirlinePortal(avn_to_airline, stripe_to_airline);
-            airlinePortal->run();
-            exit(0);
+    // The portal only displays notices, so it may fall behind and skip some; Stripe must see
+    // every one, so the generator waits for it. Each reads every shard's log as one stream.
+    std::vector<BroadcastCursor> airlineCursors, stripeCursors;
+    for (int shard = 0; shard < avnShards; shard++) {
+        // Slots as large as any message, so every notice the generator can encode fits
+        BroadcastLog* log = BroadcastLog::create(IpcChannel::kMaxMessageSize, avnLogRetention, 2000);
+        int airlineReader = log ? log->addReader("airline-portal", false) : -1;
+        int stripeReader = log ? log->addReader("stripe", true) : -1;
+        if (airlineReader < 0 || stripeReader < 0) {
+            std::cerr << "AVN broadcast log creation failed\n";
+            return 1;
         }
+        avn_logs.push_back(log);
+        airlineCursors.push_back(BroadcastCursor(log, airlineReader));
+        stripeCursors.push_back(BroadcastCursor(log, stripeReader));
     }
-    if (stripePayment == nullptr) {
-        stripePayment_id = fork();
-        if (stripePayment_id == 0) {
-            stripePayment = new StripePayment(avn_to_stripe, stripe_to_avn, stripe_to_airline);
-            stripePayment->run();
-            exit(0);
-        }
+    // AVN IDs come from one shared counter, whichever process issues the AVN
+    avnIdAllocator() = AvnIdAllocator::create();
+    if (avnIdAllocator() == nullptr) {
+        std::cerr << "AVN ID allocator creation failed\n";
+        return 1;
+    }
+    // The child processes are forked, health-checked and restarted by the supervisor; a
+    // restarted one picks up the same channels and broadcast log reader
+    Supervisor supervisor(supervisorOptions);
+    for (int shard = 0; shard < avnShards; shard++) {
+        supervisor.add(avnShardName(shard, avnShards), [&, shard]() {
+            avnGen = new AVNGenerator(atcs_to_avn[shard], avn_to_atcs[shard], avn_logs[shard], stripe_to_avn[shard],
+                                      avnBatchOptions, audioAlerts, shard, avnShards);
+            avnGen->run();
+        });
+    }
+    // The portal opens a window of its own, so it is not restarted once the main window is up
+    supervisor.add("Airline Portal", [&]() {
+        airlinePortal = new AirlinePortal(BroadcastMerge(airlineCursors), stripe_to_airline);
+        airlinePortal->run();
+    }, false);
+    supervisor.add("StripePay", [&]() {
+        stripePayment = new StripePayment(BroadcastMerge(stripeCursors), stripe_to_avn, stripe_to_airline,
+                                          new LocalGateway(gatewayOptions), stripeOptions);
+        stripePayment->run();
+    });
+    if (!supervisor.start()) {
+        std::cerr << "Starting the child processes failed\n";
+        return 1;
     }
 
     // Create the main window 
@@ -566,18 +672,8 @@ int main() {
                     delete ATCS;
                     ATCS = nullptr;
                 }
-                if (avnGen != nullptr) {
-                    kill(avnGen_id, SIGTERM);
-                    avnGen = nullptr;
-                }
-                if (airlinePortal != nullptr) {
-                    kill(airlinePortal_id, SIGTERM);
-                    airlinePortal = nullptr;
-                }
-                if (stripePayment != nullptr) {
-                    kill(stripePayment_id, SIGTERM);
-                    stripePayment = nullptr;
-                }
+                // Terminate child processes
+                supervisor.stop();
                 
                 window.close();
             }
@@ -596,18 +692,8 @@ int main() {
                     delete ATCS;
                     ATCS = nullptr;
                 }
-                if (avnGen != nullptr) {
-                    kill(avnGen_id, SIGTERM);
-                    avnGen = nullptr;
-                }
-                if (airlinePortal != nullptr) {
-                    kill(airlinePortal_id, SIGTERM);
-                    airlinePortal = nullptr;
-                }
-                if (stripePayment != nullptr) {
-                    kill(stripePayment_id, SIGTERM);
-                    stripePayment = nullptr;
-                }
+                // Terminate child processes
+                supervisor.stop();
 
                 
                 window.close();
@@ -643,7 +729,7 @@ int main() {
 
                                     if (ATCS == nullptr) {
 
-                                        ATCS = new ATCSystem(atcs_to_avn, avn_to_atcs);
+                                        ATCS = new ATCSystem(atcs_to_avn, avn_to_atcs, outboxOptions, &supervisor);
                                     }
                                     
                                     // Set the simulation running flag
@@ -664,7 +750,7 @@ int main() {
                             case 1: // Airline Portal
                                 std::cout << "Opening Airline Portal..." << std::endl;
                                 // Call the static method to launch the airline portal in a child process
-                                //AirlinePortal::launchPortal(avn_to_airline, stripe_to_airline);
+                                //AirlinePortal::launchPortal(BroadcastMerge(airlineCursors), stripe_to_airline);
                                 break;
                             case 2: // Settings
                                 std::cout << "Opening settings..." << std::endl;
@@ -691,24 +777,20 @@ int main() {
                                     ATCS = nullptr;
                                 }
                                 
-                                // Close all the pipes
-                                close(atcs_to_avn[0]);
-                                close(atcs_to_avn[1]);
-                                close(avn_to_atcs[0]);
-                                close(avn_to_atcs[1]);
-                                close(avn_to_airline[0]);
-                                close(avn_to_airline[1]);
-                                close(avn_to_stripe[0]);
-                                close(avn_to_stripe[1]);
-                                close(stripe_to_avn[0]);
-                                close(stripe_to_avn[1]);
-                                close(stripe_to_airline[0]);
-                                close(stripe_to_airline[1]);
-                                
-                                // Terminate child processes
-                                kill(avnGen_id, SIGTERM);
-                                kill(airlinePortal_id, SIGTERM);
-                                kill(stripePayment_id, SIGTERM);
+                                // Terminate child processes before their channels go away
+                                supervisor.stop();
+
+                                // Close all the channels
+                                for (int shard = 0; shard < avnShards; shard++) {
+                                    atcs_to_avn[shard].close();
+                                    avn_to_atcs[shard].close();
+                                    BroadcastLog::destroy(avn_logs[shard]);
+                                    stripe_to_avn[shard].close();
+                                }
+                                avn_logs.clear();
+                                AvnIdAllocator::destroy(avnIdAllocator());
+                                avnIdAllocator() = nullptr;
+                                stripe_to_airline.close();
                                 
                                 window.close();
                                 break;
@@ -733,7 +815,7 @@ int main() {
             
             // Safely draw plane sprites with proper mutex locking
             if (ATCS != nullptr) {
-                pthread_mutex_lock(&atcMutex);
+                PROFILED_LOCK(atcMutex);
                 for(auto& plane : ATCS->flights){
                     if (plane != nullptr && plane->airline != nullptr && (plane->state == AirCraftState::landing || plane->state == AirCraftState::takeoff_roll)) {
                         // Draw the sprite
@@ -755,7 +837,7 @@ int main() {
                         window.draw(plane->planeSprite);
                     }
                 }
-                pthread_mutex_unlock(&atcMutex);
+                PROFILED_UNLOCK(atcMutex);
             }
         } else {
             // Draw background if texture loaded successfully
@@ -773,9 +855,8 @@ int main() {
     
     // Clean up mutex
     pthread_mutex_destroy(&atcMutex);
-    waitpid(avnGen_id, NULL, 0);
-    waitpid(airlinePortal_id, NULL, 0);
-    waitpid(stripePayment_id, NULL, 0);
+    supervisor.stop();
+    supervisor.printStats(std::cout);
     
     return 0;
 }
\ No newline at end of file
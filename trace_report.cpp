@@ -0,0 +1,155 @@
+// Per-stage latency report over the span files a run wrote with --trace DIR (Trace.hpp).
+//
+//   ./trace_report [--dir traces] [--stage NAME]
+//
+// Prints count, mean, p50/p90/p99/p99.9 and max for every stage of the AVN path, then a
+// log2 histogram per stage (or only for --stage NAME). The queueing stages (stripe queue,
+// journal commit, log->stripe) growing while gateway charge stays flat means Stripe needs
+// more workers or in-flight slots; the channel hops growing means their buffers are full.
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "Trace.hpp"
+
+static int usage(const char* program) {
+    std::cerr << "Usage: " << program << " [--dir DIRECTORY] [--stage NAME]" << std::endl;
+    return 1;
+}
+
+// Appends every span of one file; false if it is not a span file
+static bool readSpans(const std::string& path, std::vector<TraceSpan>& spans) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    char magic[sizeof(kTraceMagic)];
+    bool valid = read(fd, magic, sizeof(magic)) == static_cast<ssize_t>(sizeof(magic)) &&
+                 memcmp(magic, kTraceMagic, sizeof(magic)) == 0;
+    TraceSpan buffer[1024];
+    ssize_t length;
+    while (valid && (length = read(fd, buffer, sizeof(buffer))) > 0) {
+        // A torn final span (the process was killed mid-write) is ignored
+        spans.insert(spans.end(), buffer, buffer + length / sizeof(TraceSpan));
+    }
+    close(fd);
+    return valid;
+}
+
+static double percentileUs(const std::vector<int64_t>& sorted, double p) {
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[index] / 1000.0;
+}
+
+static void printHistogram(const char* name, const std::vector<int64_t>& sorted) {
+    // Bucket b holds durations in [2^(b-1), 2^b) microseconds; bucket 0 is under 1 us
+    std::vector<long> buckets;
+    for (int64_t ns : sorted) {
+        int64_t us = ns / 1000;
+        size_t bucket = 0;
+        while (us > 0) {
+            us >>= 1;
+            bucket++;
+        }
+        if (bucket >= buckets.size()) buckets.resize(bucket + 1, 0);
+        buckets[bucket]++;
+    }
+    long peak = *std::max_element(buckets.begin(), buckets.end());
+    printf("\n%s (%zu spans)\n", name, sorted.size());
+    size_t first = 0;
+    while (buckets[first] == 0) first++;
+    for (size_t bucket = first; bucket < buckets.size(); bucket++) {
+        long upper = 1L << bucket;
+        char label[32];
+        if (upper < 1000) snprintf(label, sizeof(label), "< %ld us", upper);
+        else if (upper < 1000000) snprintf(label, sizeof(label), "< %.1f ms", upper / 1000.0);
+        else snprintf(label, sizeof(label), "< %.1f s", upper / 1000000.0);
+        int width = static_cast<int>(50.0 * buckets[bucket] / peak + 0.5);
+        printf("  %12s %9ld %5.1f%% %s\n", label, buckets[bucket], 100.0 * buckets[bucket] / sorted.size(),
+               std::string(width, '#').c_str());
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::string directory = "traces";
+    std::string stageFilter;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc) {
+            directory = argv[++i];
+        } else if (strcmp(argv[i], "--stage") == 0 && i + 1 < argc) {
+            stageFilter = argv[++i];
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if (!stageFilter.empty()) {
+        bool known = false;
+        for (int stage = 1; stage <= kTraceStageCount; stage++) known |= stageFilter == traceStageName(stage);
+        if (!known) {
+            std::cerr << "Unknown stage '" << stageFilter << "'; stages are:";
+            for (int stage = 1; stage <= kTraceStageCount; stage++) std::cerr << " '" << traceStageName(stage) << "'";
+            std::cerr << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<TraceSpan> spans;
+    int files = 0;
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) {
+        std::cerr << "Cannot open " << directory << std::endl;
+        return 1;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() < 6 || name.compare(name.size() - 6, 6, ".spans") != 0) continue;
+        if (readSpans(directory + "/" + name, spans)) {
+            files++;
+        } else {
+            std::cerr << directory << "/" << name << ": not a span file, skipped" << std::endl;
+        }
+    }
+    closedir(dir);
+    if (spans.empty()) {
+        std::cerr << "No spans in " << directory << std::endl;
+        return 1;
+    }
+
+    std::vector<std::vector<int64_t>> durations(kTraceStageCount + 1);
+    std::set<uint64_t> traces;
+    long invalid = 0;
+    for (const TraceSpan& span : spans) {
+        if (span.stage < 1 || span.stage > kTraceStageCount || span.startNs <= 0 || span.endNs < span.startNs) {
+            invalid++;
+            continue;
+        }
+        durations[span.stage].push_back(span.endNs - span.startNs);
+        traces.insert(span.traceId);
+    }
+
+    printf("%zu spans from %d processes, %zu traces", spans.size(), files, traces.size());
+    if (invalid > 0) printf(", %ld invalid spans ignored", invalid);
+    printf("\n\n%-18s %9s %10s %10s %10s %10s %10s %10s\n", "stage (ms)", "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+    for (int stage = 1; stage <= kTraceStageCount; stage++) {
+        std::vector<int64_t>& sorted = durations[stage];
+        if (sorted.empty()) continue;
+        std::sort(sorted.begin(), sorted.end());
+        double total = 0;
+        for (int64_t ns : sorted) total += ns;
+        printf("%-18s %9zu %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n", traceStageName(stage), sorted.size(),
+               total / sorted.size() / 1e6, percentileUs(sorted, 0.50) / 1000, percentileUs(sorted, 0.90) / 1000,
+               percentileUs(sorted, 0.99) / 1000, percentileUs(sorted, 0.999) / 1000, sorted.back() / 1e6);
+    }
+
+    for (int stage = 1; stage <= kTraceStageCount; stage++) {
+        if (durations[stage].empty()) continue;
+        if (!stageFilter.empty() && stageFilter != traceStageName(stage)) continue;
+        printHistogram(traceStageName(stage), durations[stage]);
+    }
+    return 0;
+}